@@ -12,6 +12,24 @@
 #include <math.h>
 #include <string.h>
 
+// Options are priced in the lanes of GCC vector types, __builtin_convertvector
+// needs GCC 9 or clang. Other compilers price one option at a time.
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 9)
+#define ENABLE_SIMD_LANES
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+#endif
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "optionfile.h"
+
 #ifdef ENABLE_PARSEC_HOOKS
 #include <hooks.h>
 #endif
@@ -51,6 +69,13 @@ using namespace tbb;
 
 #define NUM_RUNS 100
 
+//Number of fptype arrays the options are stored in
+#ifdef ERR_CHK
+#define NUM_COLUMNS 6
+#else
+#define NUM_COLUMNS 5
+#endif
+
 typedef struct OptionData_ {
         fptype s;          // spot price
         fptype strike;     // strike price
@@ -74,9 +99,275 @@ fptype * strike;
 fptype * rate;
 fptype * volatility;
 fptype * otime;
+#ifdef ERR_CHK
+fptype * refval;
+#endif
 int numError = 0;
 int nThreads;
 
+#ifdef ENABLE_TBB
+//Partitioner shared by the initialization and the computation so both
+//assign the same options to the same threads
+static tbb::affinity_partitioner partitioner;
+#endif //ENABLE_TBB
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// Options are priced SIMD_WIDTH at a time, one per lane of a vector. The width
+// follows the instruction set the compiler targets (16 with AVX-512, 8 with AVX,
+// 4 otherwise) and can be set with -DSIMD_WIDTH. Every lane performs the same
+// operations, so the price of an option does not depend on which lane or
+// thread computes it. Without ENABLE_SIMD_LANES the scalar functions below
+// are used instead.
+
+#ifdef ENABLE_SIMD_LANES
+#ifndef SIMD_WIDTH
+#if defined(__AVX512F__)
+#define SIMD_WIDTH 16
+#elif defined(__AVX__)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+#endif
+
+typedef fptype vfptype __attribute__((vector_size(SIMD_WIDTH*sizeof(fptype))));
+typedef int vint __attribute__((vector_size(SIMD_WIDTH*sizeof(int))));
+
+#define VSET(x) ((vfptype){} + (fptype)(x))
+#define VSET_INT(x) ((vint){} + (int)(x))
+
+// Square root, exact
+static inline vfptype vsqrt( vfptype x )
+{
+#if defined(__AVX512F__) && SIMD_WIDTH == 16
+    return (vfptype)_mm512_sqrt_ps((__m512)x);
+#elif defined(__AVX__) && SIMD_WIDTH == 8
+    return (vfptype)_mm256_sqrt_ps((__m256)x);
+#elif defined(__SSE__) && SIMD_WIDTH == 4
+    return (vfptype)_mm_sqrt_ps((__m128)x);
+#else
+    int i;
+    for (i=0; i<SIMD_WIDTH; i++) {
+        x[i] = sqrtf(x[i]);
+    }
+    return x;
+#endif
+}
+
+// Exponential function, within 2 ulp of expf for -87 < x < 88
+// The argument is split into n*ln(2) + r with |r| <= ln(2)/2 and e^r is
+// approximated by a polynomial (Cephes expf)
+static inline vfptype vexp( vfptype x )
+{
+    vfptype fn, r, y;
+    vint n;
+
+    x = x < VSET(88.3762626647949f) ? x : VSET(88.3762626647949f);
+    x = x > VSET(-87.3365447504019f) ? x : VSET(-87.3365447504019f);
+
+    // n = round(x / ln(2))
+    fn = x * VSET(1.44269504088896341f) + VSET(0.5f);
+    n = __builtin_convertvector(fn, vint);
+    n -= (vint)(__builtin_convertvector(n, vfptype) > fn) & 1;
+    fn = __builtin_convertvector(n, vfptype);
+
+    // ln(2) is split in two parts to keep r exact
+    r = x - fn * VSET(0.693359375f);
+    r = r - fn * VSET(-2.12194440e-4f);
+
+    y = VSET(1.9875691500e-4f);
+    y = y * r + VSET(1.3981999507e-3f);
+    y = y * r + VSET(8.3334519073e-3f);
+    y = y * r + VSET(4.1665795894e-2f);
+    y = y * r + VSET(1.6666665459e-1f);
+    y = y * r + VSET(5.0000001201e-1f);
+    y = y * r * r + r + VSET(1.0f);
+
+    // multiply by 2^n
+    return (vfptype)((vint)y + ((n) << 23));
+}
+
+// Natural logarithm of positive normal numbers, within 2 ulp of logf
+// The argument is split into 2^e * m with sqrt(1/2) <= m < sqrt(2) and
+// log(m) is approximated by a polynomial in m - 1 (Cephes logf)
+static inline vfptype vlog( vfptype x )
+{
+    vint bits = (vint)x;
+    vint e, small;
+    vfptype m, fe, z, y;
+
+    // m in [0.5, 1)
+    e = ((bits >> 23) & 0xff) - 126;
+    m = (vfptype)((bits & 0x007fffff) | 0x3f000000);
+    small = (vint)(m < VSET(0.707106781186547524f));
+    e += small;
+    m = m + (vfptype)((vint)m & small) - VSET(1.0f);
+    fe = __builtin_convertvector(e, vfptype);
+
+    z = m * m;
+    y = VSET(7.0376836292e-2f);
+    y = y * m + VSET(-1.1514610310e-1f);
+    y = y * m + VSET(1.1676998740e-1f);
+    y = y * m + VSET(-1.2420140846e-1f);
+    y = y * m + VSET(1.4249322787e-1f);
+    y = y * m + VSET(-1.6668057665e-1f);
+    y = y * m + VSET(2.0000714765e-1f);
+    y = y * m + VSET(-2.4999993993e-1f);
+    y = y * m + VSET(3.3333331174e-1f);
+    y = y * m * z;
+
+    y = y + fe * VSET(-2.12194440e-4f);
+    y = y - VSET(0.5f) * z;
+    return m + y + fe * VSET(0.693359375f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// Cumulative Normal Distribution Function
+// See Hull, Section 11.8, P.243-244
+#define inv_sqrt_2xPI 0.39894228040143270286
+
+static inline vfptype CNDF ( vfptype InputX ) 
+{
+    vint sign;
+
+    vfptype OutputX;
+    vfptype xInput;
+    vfptype xNPrimeofX;
+    vfptype expValues;
+    vfptype xK2;
+    vfptype xK2_2, xK2_3;
+    vfptype xK2_4, xK2_5;
+    vfptype xLocal, xLocal_1;
+    vfptype xLocal_2, xLocal_3;
+
+    // Check for negative value of InputX
+    sign = (vint)(InputX < VSET(0.0));
+    InputX = (vfptype)((vint)InputX & VSET_INT(0x7fffffff));
+
+    xInput = InputX;
+ 
+    // Compute NPrimeX term common to both four & six decimal accuracy calcs
+    expValues = vexp(VSET(-0.5f) * InputX * InputX);
+    xNPrimeofX = expValues;
+    xNPrimeofX = xNPrimeofX * VSET(inv_sqrt_2xPI);
+
+    xK2 = VSET(0.2316419) * xInput;
+    xK2 = VSET(1.0) + xK2;
+    xK2 = VSET(1.0) / xK2;
+    xK2_2 = xK2 * xK2;
+    xK2_3 = xK2_2 * xK2;
+    xK2_4 = xK2_3 * xK2;
+    xK2_5 = xK2_4 * xK2;
+    
+    xLocal_1 = xK2 * VSET(0.319381530);
+    xLocal_2 = xK2_2 * VSET(-0.356563782);
+    xLocal_3 = xK2_3 * VSET(1.781477937);
+    xLocal_2 = xLocal_2 + xLocal_3;
+    xLocal_3 = xK2_4 * VSET(-1.821255978);
+    xLocal_2 = xLocal_2 + xLocal_3;
+    xLocal_3 = xK2_5 * VSET(1.330274429);
+    xLocal_2 = xLocal_2 + xLocal_3;
+
+    xLocal_1 = xLocal_2 + xLocal_1;
+    xLocal   = xLocal_1 * xNPrimeofX;
+    xLocal   = VSET(1.0) - xLocal;
+
+    OutputX  = xLocal;
+    
+    // OutputX = 1.0 - OutputX for negative inputs
+    OutputX = (vfptype)(((vint)OutputX & ~sign) | ((vint)(VSET(1.0) - OutputX) & sign));
+    
+    return OutputX;
+} 
+
+//////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////
+static inline vfptype BlkSchlsEqEuroNoDiv( vfptype sptprice,
+                            vfptype strike, vfptype rate, vfptype volatility,
+                            vfptype time, vint otype, float timet )
+{
+    vfptype OptionPrice;
+    vfptype CallPrice;
+    vfptype PutPrice;
+
+    // local private working variables for the calculation
+    vfptype xStockPrice;
+    vfptype xStrikePrice;
+    vfptype xRiskFreeRate;
+    vfptype xVolatility;
+    vfptype xTime;
+    vfptype xSqrtTime;
+
+    vfptype logValues;
+    vfptype xLogTerm;
+    vfptype xD1; 
+    vfptype xD2;
+    vfptype xPowerTerm;
+    vfptype xDen;
+    vfptype d1;
+    vfptype d2;
+    vfptype FutureValueX;
+    vfptype NofXd1;
+    vfptype NofXd2;
+    vfptype NegNofXd1;
+    vfptype NegNofXd2;    
+    vint isPut;
+    
+    xStockPrice = sptprice;
+    xStrikePrice = strike;
+    xRiskFreeRate = rate;
+    xVolatility = volatility;
+
+    xTime = time;
+    xSqrtTime = vsqrt(xTime);
+
+    logValues = vlog( sptprice / strike );
+        
+    xLogTerm = logValues;
+        
+    
+    xPowerTerm = xVolatility * xVolatility;
+    xPowerTerm = xPowerTerm * VSET(0.5);
+        
+    xD1 = xRiskFreeRate + xPowerTerm;
+    xD1 = xD1 * xTime;
+    xD1 = xD1 + xLogTerm;
+
+    xDen = xVolatility * xSqrtTime;
+    xD1 = xD1 / xDen;
+    xD2 = xD1 -  xDen;
+
+    d1 = xD1;
+    d2 = xD2;
+    
+    NofXd1 = CNDF( d1 );
+    NofXd2 = CNDF( d2 );
+
+    FutureValueX = strike * ( vexp( -(rate)*(time) ) );        
+    CallPrice = (sptprice * NofXd1) - (FutureValueX * NofXd2);
+    NegNofXd1 = (VSET(1.0) - NofXd1);
+    NegNofXd2 = (VSET(1.0) - NofXd2);
+    PutPrice = (FutureValueX * NegNofXd2) - (sptprice * NegNofXd1);
+
+    // otype is 1 for puts and 0 for calls
+    isPut = -otype;
+    OptionPrice = (vfptype)(((vint)CallPrice & ~isPut) | ((vint)PutPrice & isPut));
+    
+    return OptionPrice;
+}
+
+#else //ENABLE_SIMD_LANES
+#undef SIMD_WIDTH
+#define SIMD_WIDTH 1
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -216,36 +507,191 @@ fptype BlkSchlsEqEuroNoDiv( fptype sptprice,
     
     return OptionPrice;
 }
+#endif //ENABLE_SIMD_LANES
+
+#ifdef ERR_CHK
+// The TBB version always reported errors on stderr and with a tighter bound
+#ifdef ENABLE_TBB
+#define ERR_CHK_BOUND 1e-5
+#define ERR_CHK_STREAM stderr
+#else
+#define ERR_CHK_BOUND 1e-4
+#define ERR_CHK_STREAM stdout
+#endif
+
+//Compare the prices of options first..last-1 with the reference values
+static void CheckPrices( int first, int last )
+{
+    int i;
+
+    for (i=first; i<last; i++) {
+        fptype priceDelta = refval[i] - prices[i];
+        if( fabs(priceDelta) >= ERR_CHK_BOUND ){
+            fprintf(ERR_CHK_STREAM, "Error on %d. Computed=%.5f, Ref=%.5f, Delta=%.5f\n",
+                   i, prices[i], refval[i], priceDelta);
+            numError ++;
+        }
+    }
+}
+#endif //ERR_CHK
+
+//////////////////////////////////////////////////////////////////////////////////////
+// Price options first..last-1 and store them in prices
+// A partial vector at the end is filled up with copies of the last option
+//////////////////////////////////////////////////////////////////////////////////////
+static void BlkSchlsEqEuroNoDivBatch( int first, int last )
+{
+#ifdef ENABLE_SIMD_LANES
+    int i, k, n;
+    vfptype vsptprice, vstrike, vrate, vvolatility, votime, vprice;
+    vint votype;
+    fptype tail[5][SIMD_WIDTH];
+    int tailtype[SIMD_WIDTH];
+
+    for (i=first; i<last; i+=SIMD_WIDTH) {
+        n = last - i < SIMD_WIDTH ? last - i : SIMD_WIDTH;
+        if (n == SIMD_WIDTH) {
+            memcpy(&vsptprice, &sptprice[i], sizeof(vfptype));
+            memcpy(&vstrike, &strike[i], sizeof(vfptype));
+            memcpy(&vrate, &rate[i], sizeof(vfptype));
+            memcpy(&vvolatility, &volatility[i], sizeof(vfptype));
+            memcpy(&votime, &otime[i], sizeof(vfptype));
+            memcpy(&votype, &otype[i], sizeof(vint));
+        } else {
+            for (k=0; k<SIMD_WIDTH; k++) {
+                int j = i + (k < n ? k : n - 1);
+                tail[0][k] = sptprice[j];
+                tail[1][k] = strike[j];
+                tail[2][k] = rate[j];
+                tail[3][k] = volatility[j];
+                tail[4][k] = otime[j];
+                tailtype[k] = otype[j];
+            }
+            memcpy(&vsptprice, tail[0], sizeof(vfptype));
+            memcpy(&vstrike, tail[1], sizeof(vfptype));
+            memcpy(&vrate, tail[2], sizeof(vfptype));
+            memcpy(&vvolatility, tail[3], sizeof(vfptype));
+            memcpy(&votime, tail[4], sizeof(vfptype));
+            memcpy(&votype, tailtype, sizeof(vint));
+        }
+
+        /* Calling main function to calculate option value based on 
+         * Black & Scholes's equation.
+         */
+        vprice = BlkSchlsEqEuroNoDiv( vsptprice, vstrike, vrate, vvolatility,
+                                      votime, votype, 0);
+        memcpy(&prices[i], &vprice, n * sizeof(fptype));
+
+#ifdef ERR_CHK
+        CheckPrices(i, i + n);
+#endif
+    }
+#else
+    int i;
+
+    for (i=first; i<last; i++) {
+        /* Calling main function to calculate option value based on 
+         * Black & Scholes's equation.
+         */
+        prices[i] = BlkSchlsEqEuroNoDiv( sptprice[i], strike[i], rate[i],
+                                         volatility[i], otime[i], otype[i], 0);
+    }
+#ifdef ERR_CHK
+    CheckPrices(first, last);
+#endif
+#endif //ENABLE_SIMD_LANES
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+// The arrays used by the computation are filled in parallel, every thread
+// copies the options it prices later. With a first-touch page placement
+// policy the pages of each thread's slice are allocated on its NUMA node.
+// Options come either from data, which holds the options of a text input
+// file, or from the columns of a memory-mapped binary input file.
+static const void *column[OPTFILE_COLUMNS];
+
+static void InitOptions(int first, int last)
+{
+    int i;
+
+    if (data != NULL) {
+        for (i=first; i<last; i++) {
+            otype[i]      = (data[i].OptionType == 'P') ? 1 : 0;
+            sptprice[i]   = data[i].s;
+            strike[i]     = data[i].strike;
+            rate[i]       = data[i].r;
+            volatility[i] = data[i].v;
+            otime[i]      = data[i].t;
+#ifdef ERR_CHK
+            refval[i]     = data[i].DGrefval;
+#endif
+        }
+    } else {
+        size_t n = (last - first) * sizeof(fptype);
+        memcpy(&sptprice[first], (const fptype *)column[OPTFILE_SPTPRICE] + first, n);
+        memcpy(&strike[first], (const fptype *)column[OPTFILE_STRIKE] + first, n);
+        memcpy(&rate[first], (const fptype *)column[OPTFILE_RATE] + first, n);
+        memcpy(&volatility[first], (const fptype *)column[OPTFILE_VOLATILITY] + first, n);
+        memcpy(&otime[first], (const fptype *)column[OPTFILE_OTIME] + first, n);
+        memcpy(&otype[first], (const int *)column[OPTFILE_OTYPE] + first, (last - first) * sizeof(int));
+#ifdef ERR_CHK
+        memcpy(&refval[first], (const fptype *)column[OPTFILE_DGREFVAL] + first, n);
+#endif
+    }
+    memset(&prices[first], 0, (last - first) * sizeof(fptype));
+}
+
+#ifndef WIN32
+//Maps a binary input file and points column to its columns
+//Returns the size of the mapping, the number of options is stored in numOptions
+static size_t MapOptions(const char *inputFile, void **map)
+{
+    struct stat st;
+    const OptionFileHeader *header;
+    int fd;
+    int c;
+
+    fd = open(inputFile, O_RDONLY);
+    if(fd < 0 || fstat(fd, &st) != 0) {
+      printf("ERROR: Unable to open file `%s'.\n", inputFile);
+      exit(1);
+    }
+    if((size_t)st.st_size < sizeof(OptionFileHeader)) {
+      printf("ERROR: Unable to read from file `%s'.\n", inputFile);
+      exit(1);
+    }
+    *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(*map == MAP_FAILED) {
+      printf("ERROR: Unable to map file `%s'.\n", inputFile);
+      exit(1);
+    }
+    header = (const OptionFileHeader *)*map;
+    numOptions = header->numOptions;
+    if(numOptions < 1 || (size_t)st.st_size < OPTFILE_SIZE(numOptions)) {
+      printf("ERROR: Unable to read from file `%s'.\n", inputFile);
+      exit(1);
+    }
+    for(c=0; c<OPTFILE_COLUMNS; c++) {
+      column[c] = (const char *)*map + OPTFILE_COLUMN_OFFSET(numOptions, c);
+    }
+    return st.st_size;
+}
+#endif //WIN32
 
 #ifdef ENABLE_TBB
+struct initWork {
+  void operator()(const tbb::blocked_range<int> &range) const {
+    InitOptions(range.begin(), range.end());
+  }
+};
+
 struct mainWork {
   mainWork() {}
   mainWork(mainWork &w, tbb::split) {}
 
   void operator()(const tbb::blocked_range<int> &range) const {
-    fptype price;
-    int begin = range.begin();
-    int end = range.end();
-
-    for (int i=begin; i!=end; i++) {
-      /* Calling main function to calculate option value based on 
-       * Black & Scholes's equation.
-       */
-
-      price = BlkSchlsEqEuroNoDiv( sptprice[i], strike[i],
-                                   rate[i], volatility[i], otime[i], 
-                                   otype[i], 0);
-      prices[i] = price;
-
-#ifdef ERR_CHK 
-      fptype priceDelta = data[i].DGrefval - price;
-      if( fabs(priceDelta) >= 1e-5 ){
-        fprintf(stderr,"Error on %d. Computed=%.5f, Ref=%.5f, Delta=%.5f\n",
-               i, price, data[i].DGrefval, priceDelta);
-        numError ++;
-      }
-#endif
-    }
+    BlkSchlsEqEuroNoDivBatch(range.begin(), range.end());
   }
 };
 
@@ -259,11 +705,10 @@ struct mainWork {
 #ifdef ENABLE_TBB
 int bs_thread(void *tid_ptr) {
     int j;
-    tbb::affinity_partitioner a;
 
     mainWork doall;
     for (j=0; j<NUM_RUNS; j++) {
-      tbb::parallel_for(tbb::blocked_range<int>(0, numOptions), doall, a);
+      tbb::parallel_for(tbb::blocked_range<int>(0, numOptions), doall, partitioner);
     }
 
     return 0;
@@ -275,43 +720,41 @@ DWORD WINAPI bs_thread(LPVOID tid_ptr){
 #else
 int bs_thread(void *tid_ptr) {
 #endif
-    int i, j;
-    fptype price;
-    fptype priceDelta;
+    int j;
+#ifndef ENABLE_OPENMP
     int tid = *(int *)tid_ptr;
     int start = tid * (numOptions / nThreads);
     int end = start + (numOptions / nThreads);
+#endif
 
     for (j=0; j<NUM_RUNS; j++) {
 #ifdef ENABLE_OPENMP
-#pragma omp parallel for private(i, price, priceDelta)
-        for (i=0; i<numOptions; i++) {
+        int i;
+#pragma omp parallel for private(i) schedule(static)
+        for (i=0; i<numOptions; i+=SIMD_WIDTH) {
+            BlkSchlsEqEuroNoDivBatch(i, i + SIMD_WIDTH < numOptions ? i + SIMD_WIDTH : numOptions);
+        }
 #else  //ENABLE_OPENMP
-        for (i=start; i<end; i++) {
+        BlkSchlsEqEuroNoDivBatch(start, end);
 #endif //ENABLE_OPENMP
-            /* Calling main function to calculate option value based on 
-             * Black & Scholes's equation.
-             */
-            price = BlkSchlsEqEuroNoDiv( sptprice[i], strike[i],
-                                         rate[i], volatility[i], otime[i], 
-                                         otype[i], 0);
-            prices[i] = price;
-
-#ifdef ERR_CHK
-            priceDelta = data[i].DGrefval - price;
-            if( fabs(priceDelta) >= 1e-4 ){
-                printf("Error on %d. Computed=%.5f, Ref=%.5f, Delta=%.5f\n",
-                       i, price, data[i].DGrefval, priceDelta);
-                numError ++;
-            }
-#endif
-        }
     }
 
     return 0;
 }
 #endif //ENABLE_TBB
 
+#if defined(ENABLE_THREADS) && !defined(WIN32)
+//Initializes the options of a thread, the last thread also takes the remainder
+void *init_thread(void *tid_ptr) {
+    int tid = *(int *)tid_ptr;
+    int start = tid * (numOptions / nThreads);
+    int end = (tid == nThreads - 1) ? numOptions : start + (numOptions / nThreads);
+
+    InitOptions(start, end);
+    return NULL;
+}
+#endif //ENABLE_THREADS && !WIN32
+
 int main (int argc, char **argv)
 {
     FILE *file;
@@ -320,6 +763,9 @@ int main (int argc, char **argv)
     fptype * buffer;
     int * buffer2;
     int rv;
+    char magic[OPTFILE_MAGIC_LEN];
+    void *map = NULL;
+    size_t mapSize = 0;
 
 #ifdef PARSEC_VERSION
 #define __PARSEC_STRING(x) #x
@@ -343,17 +789,47 @@ int main (int argc, char **argv)
     char *inputFile = argv[2];
     char *outputFile = argv[3];
 
-    //Read input data from file
+    //Read input data from file, either in the binary format or as text
     file = fopen(inputFile, "r");
     if(file == NULL) {
       printf("ERROR: Unable to open file `%s'.\n", inputFile);
       exit(1);
     }
-    rv = fscanf(file, "%i", &numOptions);
-    if(rv != 1) {
-      printf("ERROR: Unable to read from file `%s'.\n", inputFile);
+    if(fread(magic, 1, OPTFILE_MAGIC_LEN, file) == OPTFILE_MAGIC_LEN &&
+       memcmp(magic, OPTFILE_MAGIC, OPTFILE_MAGIC_LEN) == 0) {
       fclose(file);
+#ifdef WIN32
+      printf("ERROR: Binary input files are not supported on this platform.\n");
       exit(1);
+#else
+      mapSize = MapOptions(inputFile, &map);
+#endif
+      data = NULL;
+    } else {
+      rewind(file);
+      rv = fscanf(file, "%i", &numOptions);
+      if(rv != 1) {
+        printf("ERROR: Unable to read from file `%s'.\n", inputFile);
+        fclose(file);
+        exit(1);
+      }
+
+      // alloc spaces for the option data
+      data = (OptionData*)malloc(numOptions*sizeof(OptionData));
+      for ( loopnum = 0; loopnum < numOptions; ++ loopnum )
+      {
+          rv = fscanf(file, "%f %f %f %f %f %f %c %f %f", &data[loopnum].s, &data[loopnum].strike, &data[loopnum].r, &data[loopnum].divq, &data[loopnum].v, &data[loopnum].t, &data[loopnum].OptionType, &data[loopnum].divs, &data[loopnum].DGrefval);
+          if(rv != 9) {
+            printf("ERROR: Unable to read from file `%s'.\n", inputFile);
+            fclose(file);
+            exit(1);
+          }
+      }
+      rv = fclose(file);
+      if(rv != 0) {
+        printf("ERROR: Unable to close file `%s'.\n", inputFile);
+        exit(1);
+      }
     }
     if(nThreads > numOptions) {
       printf("WARNING: Not enough work, reducing number of threads to match number of options.\n");
@@ -367,24 +843,6 @@ int main (int argc, char **argv)
     }
 #endif
 
-    // alloc spaces for the option data
-    data = (OptionData*)malloc(numOptions*sizeof(OptionData));
-    prices = (fptype*)malloc(numOptions*sizeof(fptype));
-    for ( loopnum = 0; loopnum < numOptions; ++ loopnum )
-    {
-        rv = fscanf(file, "%f %f %f %f %f %f %c %f %f", &data[loopnum].s, &data[loopnum].strike, &data[loopnum].r, &data[loopnum].divq, &data[loopnum].v, &data[loopnum].t, &data[loopnum].OptionType, &data[loopnum].divs, &data[loopnum].DGrefval);
-        if(rv != 9) {
-          printf("ERROR: Unable to read from file `%s'.\n", inputFile);
-          fclose(file);
-          exit(1);
-        }
-    }
-    rv = fclose(file);
-    if(rv != 0) {
-      printf("ERROR: Unable to close file `%s'.\n", inputFile);
-      exit(1);
-    }
-
 #ifdef ENABLE_THREADS
     MAIN_INITENV(,8000000,nThreads);
 #endif
@@ -394,24 +852,77 @@ int main (int argc, char **argv)
 #define PAD 256
 #define LINESIZE 64
 
-    buffer = (fptype *) malloc(5 * numOptions * sizeof(fptype) + PAD);
+    prices = (fptype*)malloc(numOptions*sizeof(fptype));
+#if !defined(ENABLE_THREADS) && !defined(ENABLE_OPENMP) && !defined(ENABLE_TBB)
+    //The serial version computes directly on the columns of a binary input file
+    if (map != NULL) {
+        buffer = NULL;
+        buffer2 = NULL;
+        sptprice = (fptype *) column[OPTFILE_SPTPRICE];
+        strike = (fptype *) column[OPTFILE_STRIKE];
+        rate = (fptype *) column[OPTFILE_RATE];
+        volatility = (fptype *) column[OPTFILE_VOLATILITY];
+        otime = (fptype *) column[OPTFILE_OTIME];
+        otype = (int *) column[OPTFILE_OTYPE];
+#ifdef ERR_CHK
+        refval = (fptype *) column[OPTFILE_DGREFVAL];
+#endif
+    } else
+#endif
+    {
+    buffer = (fptype *) malloc(NUM_COLUMNS * numOptions * sizeof(fptype) + PAD);
     sptprice = (fptype *) (((unsigned long long)buffer + PAD) & ~(LINESIZE - 1));
     strike = sptprice + numOptions;
     rate = strike + numOptions;
     volatility = rate + numOptions;
     otime = volatility + numOptions;
+#ifdef ERR_CHK
+    refval = otime + numOptions;
+#endif
 
     buffer2 = (int *) malloc(numOptions * sizeof(fptype) + PAD);
     otype = (int *) (((unsigned long long)buffer2 + PAD) & ~(LINESIZE - 1));
+    }
+
+    //Copy the options with the same partitioning as the computation
+#ifdef ENABLE_THREADS
+#ifdef WIN32
+    InitOptions(0, numOptions);
+#else
+    {
+        pthread_t *initThreads = (pthread_t *) malloc (nThreads * sizeof(pthread_t));
+        int *initTids = (int *) malloc (nThreads * sizeof(int));
+
+        for(i=0; i<nThreads; i++) {
+            initTids[i] = i;
+            pthread_create(&initThreads[i], NULL, init_thread, &initTids[i]);
+        }
+        for(i=0; i<nThreads; i++) {
+            pthread_join(initThreads[i], NULL);
+        }
+        free(initThreads);
+        free(initTids);
+    }
+#endif //WIN32
+#else //ENABLE_THREADS
+#ifdef ENABLE_OPENMP
+    omp_set_num_threads(nThreads);
+#pragma omp parallel for private(i) schedule(static)
+    for (i=0; i<numOptions; i+=SIMD_WIDTH) {
+        InitOptions(i, i + SIMD_WIDTH < numOptions ? i + SIMD_WIDTH : numOptions);
+    }
+#else //ENABLE_OPENMP
+#ifdef ENABLE_TBB
+    tbb::task_scheduler_init init(nThreads);
 
-    for (i=0; i<numOptions; i++) {
-        otype[i]      = (data[i].OptionType == 'P') ? 1 : 0;
-        sptprice[i]   = data[i].s;
-        strike[i]     = data[i].strike;
-        rate[i]       = data[i].r;
-        volatility[i] = data[i].v;    
-        otime[i]      = data[i].t;
+    tbb::parallel_for(tbb::blocked_range<int>(0, numOptions), initWork(), partitioner);
+#else //ENABLE_TBB
+    if (map == NULL) {
+        InitOptions(0, numOptions);
     }
+#endif //ENABLE_TBB
+#endif //ENABLE_OPENMP
+#endif //ENABLE_THREADS
 
     printf("Size of data: %d\n", numOptions * (sizeof(OptionData) + sizeof(int)));
 
@@ -448,13 +959,10 @@ int main (int argc, char **argv)
 #ifdef ENABLE_OPENMP
     {
         int tid=0;
-        omp_set_num_threads(nThreads);
         bs_thread(&tid);
     }
 #else //ENABLE_OPENMP
 #ifdef ENABLE_TBB
-    tbb::task_scheduler_init init(nThreads);
-
     int tid=0;
     bs_thread(&tid);
 #else //ENABLE_TBB
@@ -500,6 +1008,13 @@ int main (int argc, char **argv)
 #endif
     free(data);
     free(prices);
+    free(buffer);
+    free(buffer2);
+#ifndef WIN32
+    if (map != NULL) {
+        munmap(map, mapSize);
+    }
+#endif
 
 #ifdef ENABLE_PARSEC_HOOKS
     __parsec_bench_end();
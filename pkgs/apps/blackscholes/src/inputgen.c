@@ -4,6 +4,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "optionfile.h"
 
 
 
@@ -32,14 +35,121 @@ OptionData data_init[] = {
 
 
 
+//Write options in the binary columnar format, columns holds OPTFILE_COLUMNS arrays
+static void write_binary(const char *fileName, int numOptions, float **columns) {
+  OptionFileHeader header;
+  FILE *file;
+  size_t pad;
+  int c;
+  static const char zeros[OPTFILE_ALIGN];
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, OPTFILE_MAGIC, OPTFILE_MAGIC_LEN);
+  header.numOptions = numOptions;
+
+  file = fopen(fileName, "wb");
+  if(file == NULL) {
+    printf("ERROR: Unable to open file `%s'.\n", fileName);
+    exit(1);
+  }
+  pad = OPTFILE_COLUMN_SIZE(numOptions) - (size_t)numOptions * 4;
+  if(fwrite(&header, sizeof(header), 1, file) != 1) {
+    printf("ERROR: Unable to write to file `%s'.\n", fileName);
+    fclose(file);
+    exit(1);
+  }
+  for(c=0; c<OPTFILE_COLUMNS; c++) {
+    if(fwrite(columns[c], 4, numOptions, file) != (size_t)numOptions || fwrite(zeros, 1, pad, file) != pad) {
+      printf("ERROR: Unable to write to file `%s'.\n", fileName);
+      fclose(file);
+      exit(1);
+    }
+  }
+  if(fclose(file) != 0) {
+    printf("ERROR: Unable to close file `%s'.\n", fileName);
+    exit(1);
+  }
+}
+
+static float **alloc_columns(int numOptions) {
+  float **columns = (float **)malloc(OPTFILE_COLUMNS * sizeof(float *));
+  int c;
+
+  for(c=0; c<OPTFILE_COLUMNS; c++) {
+    columns[c] = (float *)malloc(numOptions * sizeof(float));
+    if(columns[c] == NULL) {
+      printf("ERROR: Not enough memory for %d options.\n", numOptions);
+      exit(1);
+    }
+  }
+  return columns;
+}
+
+//Store an option in the columns, the option type is stored as int
+static void set_option(float **columns, int i, float s, float strike, float r, float v, float t, char type, float DGrefval) {
+  columns[OPTFILE_SPTPRICE][i] = s;
+  columns[OPTFILE_STRIKE][i] = strike;
+  columns[OPTFILE_RATE][i] = r;
+  columns[OPTFILE_VOLATILITY][i] = v;
+  columns[OPTFILE_OTIME][i] = t;
+  ((int *)columns[OPTFILE_OTYPE])[i] = (type == 'P') ? 1 : 0;
+  columns[OPTFILE_DGREFVAL][i] = DGrefval;
+}
+
+//Round a value the same way as writing it to a text file and reading it back
+static float text_value(const char *format, double value) {
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), format, value);
+  return strtof(buf, NULL);
+}
+
+//Convert a text input file into the binary format
+static int convert(const char *textFile, const char *binFile) {
+  FILE *file;
+  int numOptions;
+  int i;
+  float **columns;
+
+  file = fopen(textFile, "r");
+  if(file == NULL) {
+    printf("ERROR: Unable to open file `%s'.\n", textFile);
+    exit(1);
+  }
+  if(fscanf(file, "%i", &numOptions) != 1 || numOptions < 1) {
+    printf("ERROR: Unable to read from file `%s'.\n", textFile);
+    fclose(file);
+    exit(1);
+  }
+  columns = alloc_columns(numOptions);
+  for(i=0; i<numOptions; i++) {
+    float s, strike, r, divq, v, t, divs, DGrefval;
+    char type;
+    if(fscanf(file, "%f %f %f %f %f %f %c %f %f", &s, &strike, &r, &divq, &v, &t, &type, &divs, &DGrefval) != 9) {
+      printf("ERROR: Unable to read from file `%s'.\n", textFile);
+      fclose(file);
+      exit(1);
+    }
+    set_option(columns, i, s, strike, r, v, t, type, DGrefval);
+  }
+  fclose(file);
+
+  write_binary(binFile, numOptions, columns);
+  return 0;
+}
+
 int main (int argc, char **argv) {
   int numOptions;
   char *fileName;
   int rv;
   int i;
 
-  if (argc != 3) {
-    printf("Usage:\n\t%s <numOptions> <fileName>\n", argv[0]);
+  if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+    return convert(argv[2], argv[3]);
+  }
+  if (argc != 3 && !(argc == 4 && strcmp(argv[3], "-b") == 0)) {
+    printf("Usage:\n\t%s <numOptions> <fileName> [-b]\n\t%s -c <textFile> <binaryFile>\n", argv[0], argv[0]);
+    printf("\t-b writes the binary format, -c converts a text input file into it\n");
     exit(1);
   }
   numOptions = atoi(argv[1]);
@@ -49,6 +159,17 @@ int main (int argc, char **argv) {
     exit(1);
   }
 
+  if (argc == 4) {
+    float **columns = alloc_columns(numOptions);
+    for(i=0; i<numOptions; i++) {
+      OptionData *o = &data_init[i % MAX_OPTIONS];
+      set_option(columns, i, text_value("%.2f", o->s), text_value("%.2f", o->strike), text_value("%.4f", o->r),
+                 text_value("%.2f", o->v), text_value("%.2f", o->t), o->OptionType[0], text_value("%.18f", o->DGrefval));
+    }
+    write_binary(fileName, numOptions, columns);
+    return 0;
+  }
+
   FILE *file;
   file = fopen(fileName, "w");
   if(file == NULL) {
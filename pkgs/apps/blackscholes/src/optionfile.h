@@ -0,0 +1,42 @@
+//Binary columnar input format of the blackscholes benchmark
+//
+//The file starts with a header of OPTFILE_HEADER_SIZE bytes, followed by one
+//column per input field. Every column holds numOptions 4-byte values in the
+//byte order of the machine that wrote the file and starts on a multiple of
+//OPTFILE_ALIGN bytes, so blackscholes can use the columns of a memory-mapped
+//file directly as its arrays. inputgen writes these files.
+
+#ifndef _OPTIONFILE_H_
+#define _OPTIONFILE_H_
+
+#define OPTFILE_MAGIC "BSOPTS01"
+#define OPTFILE_MAGIC_LEN 8
+#define OPTFILE_HEADER_SIZE 64
+#define OPTFILE_ALIGN 64
+
+//Columns in file order, all of them are floats except for the option type
+#define OPTFILE_SPTPRICE   0
+#define OPTFILE_STRIKE     1
+#define OPTFILE_RATE       2
+#define OPTFILE_VOLATILITY 3
+#define OPTFILE_OTIME      4
+#define OPTFILE_OTYPE      5 //int, 0 for calls and 1 for puts
+#define OPTFILE_DGREFVAL   6
+#define OPTFILE_COLUMNS    7
+
+typedef struct OptionFileHeader_ {
+  char magic[OPTFILE_MAGIC_LEN];
+  int numOptions;
+  char reserved[OPTFILE_HEADER_SIZE - OPTFILE_MAGIC_LEN - sizeof(int)];
+} OptionFileHeader;
+
+//Size of a column including the padding to the next one
+#define OPTFILE_COLUMN_SIZE(n) ((((size_t)(n) * 4) + OPTFILE_ALIGN - 1) & ~(size_t)(OPTFILE_ALIGN - 1))
+
+//Offset of a column from the start of the file
+#define OPTFILE_COLUMN_OFFSET(n, c) (OPTFILE_HEADER_SIZE + (size_t)(c) * OPTFILE_COLUMN_SIZE(n))
+
+//Size of a file with n options
+#define OPTFILE_SIZE(n) OPTFILE_COLUMN_OFFSET(n, OPTFILE_COLUMNS)
+
+#endif //_OPTIONFILE_H_
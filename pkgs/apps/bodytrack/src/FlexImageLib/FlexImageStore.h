@@ -143,7 +143,7 @@ T *FlexImageStore<T,C>::FlexMalloc(int widthPixels, int heightPixels, int &StepB
 {
 	StepBytes = widthPixels * C * sizeof(T);			//calculate bytes per image line
 	StepBytes = int((StepBytes - 1) / 4) * 4 + 4;		//enforce multiples of 4
-	return (T *)malloc(size_t(StepBytes * heightPixels));
+	return (T *)malloc(size_t(StepBytes * heightPixels + 4));	//pad so 4 byte loads of any pixel stay inside the buffer
 }
 
 #endif
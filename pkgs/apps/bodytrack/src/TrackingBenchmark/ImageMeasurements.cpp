@@ -21,6 +21,11 @@
 
 #include "ImageMeasurements.h"
 #include <math.h>
+#include <string.h>
+
+#if defined(SIMD_SAMPLING)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -111,13 +116,191 @@ void ImageMeasurements::InsideError(const ProjectedCylinder &ProjCyl, const Bina
 	}
 }
 
+#if defined(SIMD_SAMPLING)
+//------------------------ Vectorized sampling -----------------------------
+//The samples of a line are processed SAMPLE_LANES at a time, the rows of the inside of a
+//cylinder are processed in parallel.  Pixels are loaded with AVX2 gathers, processors without
+//AVX2 use the scalar code.  Sample points and errors are computed with the same floating point
+//operations as the scalar code, so the errors do not change.
+
+typedef float vfloat __attribute__((vector_size(SAMPLE_LANES * sizeof(float))));
+typedef int vint __attribute__((vector_size(SAMPLE_LANES * sizeof(int))));
+
+static const vint sampleLane = {0, 1, 2, 3, 4, 5, 6, 7};
+
+//Positions of the samples along a line as fractions of its length.  Row n holds the n + 1
+//positions i / n, accumulated like in the scalar loops, padded to a multiple of SAMPLE_LANES.
+#define FRACTION_TABLE_ROWS 128
+class FractionTable {
+private:
+	std::vector<float> mData;
+	int mOffset[FRACTION_TABLE_ROWS];
+
+public:
+	static void Fill(float *f, int n)
+	{	float d = 1.0f / n, delta = 0;
+		for(int i = 0; i <= n; i++)
+		{	f[i] = delta;
+			delta += d;
+		}
+	}
+
+	static int RowSize(int n) {return (n + SAMPLE_LANES) / SAMPLE_LANES * SAMPLE_LANES; };
+
+	FractionTable()
+	{	int size = 0;
+		for(int n = 1; n < FRACTION_TABLE_ROWS; n++)
+		{	mOffset[n] = size;
+			size += RowSize(n);
+		}
+		mData.assign(size, 0.0f);
+		for(int n = 1; n < FRACTION_TABLE_ROWS; n++)
+			Fill(&mData[mOffset[n]], n);
+	}
+
+	//Get fractions of n, longer rows are computed in the given workspace
+	const float *Row(int n, std::vector<float> &ws) const
+	{	if(n < FRACTION_TABLE_ROWS)
+			return &mData[mOffset[n]];
+		ws.assign(RowSize(n), 0.0f);
+		Fill(&ws[0], n);
+		return &ws[0];
+	}
+};
+
+//initialized before any threads are started
+static const FractionTable fractionTable;
+
+//Round sample points to the nearest integral points and compute their pixel indices (x + y * step).
+//Lanes outside the image or beyond the first n lanes are 0 in mask and have index 0.
+static inline __attribute__((always_inline, target("avx2"))) void SampleIndices(const vfloat &xf, const vfloat &yf, int width, int height, int step, int n, vint &mask, vint &idx)
+{
+	vint x = __builtin_convertvector(xf + 0.5f, vint), y = __builtin_convertvector(yf + 0.5f, vint);
+	mask = (x >= 0) & (x < width) & (y >= 0) & (y < height) & (sampleLane < n);
+	idx = (x + y * step) & mask;
+}
+
+//Load 8 bit pixels of the lanes set in mask, the gather reads 4 bytes per pixel (FlexImageStore pads images)
+//Lanes not set in mask are 0 and never touch memory
+static inline __attribute__((always_inline, target("avx2"))) vint GatherBytes(const unsigned char *data, const vint &idx, const vint &mask)
+{
+	return (vint)_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)data, (__m256i)idx, (__m256i)mask, 1) & 255;
+}
+
+//Load pixels of a binary image for the lanes set in mask
+static inline __attribute__((always_inline, target("avx2"))) vint GatherBits(const unsigned char *data, const vint &idx, const vint &mask)
+{
+	vint v = (vint)_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)data, (__m256i)(idx >> 3), (__m256i)mask, 1);
+	return (v >> (idx & 7)) & 1;
+}
+
+//accumulate error at the n edge sample points p + f[i] * s
+static inline __attribute__((always_inline, target("avx2"))) void SampleEdgeLine(const Point &p, const Point &s, const float *f, int n, const FlexImage8u &EdgeMap, vint &error, vint &samplePoints)
+{
+	const unsigned char *data = &EdgeMap(0,0);
+	for(int i = 0; i < n; i += SAMPLE_LANES)
+	{	vfloat vf;
+		vint mask, idx;
+		memcpy(&vf, f + i, sizeof(vf));
+		SampleIndices(p.x + vf * s.x, p.y + vf * s.y, EdgeMap.Width(), EdgeMap.Height(), EdgeMap.StepBytes(), n - i, mask, idx);
+		vint e = (255 - GatherBytes(data, idx, mask)) & mask;
+		error += e * e;
+		samplePoints -= mask;												//mask is -1 for sampled points
+	}
+}
+
+//compute edge map error of all body parts on one camera, see EdgeError()
+__attribute__((target("avx2")))
+static void EdgeErrorAVX2(ProjectedBody &ProjBody, const FlexImage8u &EdgeMap, float step, std::vector<float> *ws, float &error, int &samplePoints)
+{
+	vint samples = {0};
+	for(int j = 0; j < ProjBody.Size(); j++)
+	{	const ProjectedCylinder &ProjCyl = ProjBody(j);
+		const Point &p1 = ProjCyl.mPts[0], &p2 = ProjCyl.mPts[2];
+		Point s1, s2;
+		s1.Set(ProjCyl.mPts[1].x - p1.x, ProjCyl.mPts[1].y - p1.y);
+		s2.Set(ProjCyl.mPts[3].x - p2.x, ProjCyl.mPts[3].y - p2.y);
+		int n1 = max((int)(mag(s1) / step + 0.5), 4);
+		int n2 = max((int)(mag(s2) / step + 0.5), 4);
+
+		vint ErrorSSD = {0};
+		SampleEdgeLine(p1, s1, fractionTable.Row(n1, ws[0]), n1 + 1, EdgeMap, ErrorSSD, samples);
+		SampleEdgeLine(p2, s2, fractionTable.Row(n2, ws[1]), n2 + 1, EdgeMap, ErrorSSD, samples);
+		int e = 0;
+		for(int l = 0; l < SAMPLE_LANES; l++)
+			e += ErrorSSD[l];
+		error += (float)e / (255.0f * 255.0f);
+	}
+	for(int l = 0; l < SAMPLE_LANES; l++)
+		samplePoints += samples[l];
+}
+
+//compute silhouette error of all body parts on one camera, see InsideError()
+__attribute__((target("avx2")))
+static void InsideErrorAVX2(ProjectedBody &ProjBody, const BinaryImage &FGmap, float hstep, float vstep, std::vector<float> *ws, int &error, int &samplePoints)
+{
+	const unsigned char *data = FGmap.ImageStore()->Data();
+	vint errors = {0}, samples = {0};
+	for(int j = 0; j < ProjBody.Size(); j++)
+	{	const ProjectedCylinder &ProjCyl = ProjBody(j);
+		const Point &p1 = ProjCyl.mPts[0], &p2 = ProjCyl.mPts[3];
+		Point s1, s2;
+		s1.Set(ProjCyl.mPts[1].x - p1.x, ProjCyl.mPts[1].y - p1.y);
+		s2.Set(ProjCyl.mPts[2].x - p2.x, ProjCyl.mPts[2].y - p2.y);
+		Point m(p1.x + s1.x / 2.0f - (p2.x + s2.x / 2.0f), p1.y + s1.y / 2.0f - (p2.y + s2.y / 2.0f));
+		int n1 = max((int)(mag(s1) / vstep + 0.5), 4);
+		int n2 = max((int)(mag(m) / hstep + 0.5f), 4);
+		const float *f1 = fractionTable.Row(n1, ws[0]);
+		const float *f2 = fractionTable.Row(n2, ws[1]);
+
+		for(int i = 0; i <= n1; i += SAMPLE_LANES)							//one row of interior samples per lane
+		{	vfloat delta1;
+			memcpy(&delta1, f1 + i, sizeof(delta1));
+			vfloat e1x = p1.x + delta1 * s1.x, e1y = p1.y + delta1 * s1.y;
+			vfloat mx = (p2.x + delta1 * s2.x) - e1x, my = (p2.y + delta1 * s2.y) - e1y;
+			for(int k = 0; k < n2; k++)
+			{	vint mask, idx;
+				SampleIndices(e1x + f2[k] * mx, e1y + f2[k] * my, FGmap.Width(), FGmap.Height(), FGmap.Width(), n1 + 1 - i, mask, idx);
+				errors += (1 - GatherBits(data, idx, mask)) & mask;
+				samples -= mask;
+			}
+		}
+	}
+	for(int l = 0; l < SAMPLE_LANES; l++)
+	{	error += errors[l];
+		samplePoints += samples[l];
+	}
+}
+
+static bool HaveAVX2()
+{
+	static int has_avx2 = -1;
+	if(has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2 != 0;
+}
+
+//The vector samplers need pixel data, images which failed to load are left to the scalar samplers
+template<class Image>
+static bool CanGather(const Image &img)
+{
+	return img.ImageStore() != NULL && img.Width() > 0 && img.Height() > 0;
+}
+#endif //SIMD_SAMPLING
+
 //compute edge map error term for all cameras given the set of 2D body geometry projections
 float ImageMeasurements::ImageErrorEdge(std::vector<FlexImage8u> &ImageMaps, MultiCameraProjectedBody &ProjBodies) 
 {
 	int samples = 0;
 	float error = 0;
 	for(int i = 0; i < (int)ImageMaps.size(); i++)							//for each camera, compute the edge map error term
-	{	int nParts = ProjBodies(i).Size();
+	{
+#if defined(SIMD_SAMPLING)
+		if(HaveAVX2() && CanGather(ImageMaps[i]))
+		{	EdgeErrorAVX2(ProjBodies(i), ImageMaps[i], mStep, mFractions, error, samples);
+			continue;
+		}
+#endif
+		int nParts = ProjBodies(i).Size();
 		for(int j = 0; j < nParts; j++)										//accumulate edge error for each body part, counting samples
 			EdgeError(ProjBodies(i)(j), ImageMaps[i], error, samples);
 	}
@@ -131,7 +314,14 @@ float ImageMeasurements::ImageErrorInside(std::vector<BinaryImage> &ImageMaps, M
 	int samples = 0;
 	int error = 0;
 	for(int i = 0; i < (int)ImageMaps.size(); i++)							//for each camera, compute the edge map error term
-	{	int nParts = ProjBodies(i).Size();
+	{
+#if defined(SIMD_SAMPLING)
+		if(HaveAVX2() && CanGather(ImageMaps[i]))
+		{	InsideErrorAVX2(ProjBodies(i), ImageMaps[i], mHstep, mVstep, mFractions, error, samples);
+			continue;
+		}
+#endif
+		int nParts = ProjBodies(i).Size();
 		for(int j = 0; j < nParts; j++)										//accumulate edge error for each body part, counting samples
 			InsideError(ProjBodies(i)(j), ImageMaps[i], error, samples);
 	}
@@ -38,11 +38,20 @@
 #define H_STEP_DEFAULT 10.00f
 #define V_STEP_DEFAULT 10.00f
 
+//Sample points are evaluated SAMPLE_LANES at a time with GCC vector extensions and AVX2 gathers if
+//the processor supports them.  This needs __builtin_convertvector (GCC 9 or clang), older compilers
+//and SCALAR_SAMPLING evaluate one point at a time.
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 9) && (defined(__x86_64__) || defined(__i386__)) && !defined(SCALAR_SAMPLING)
+#define SIMD_SAMPLING
+#define SAMPLE_LANES 8
+#endif
+
 
 class ImageMeasurements
 {
 private:
 	std::vector<Point> mSamples;											//pixel samples (for each body part, edge and inside)
+	std::vector<float> mFractions[2];										//positions of samples along long lines (SIMD_SAMPLING only)
 
 	float mStep;															//Sampling resolution of the edges in pixels (default: STEP_DEFAULT)
 	float mHstep,mVstep;													//Horizontal and vertical sampling resolutions of inside the limbs (defaults: H_STEP_DEFAULT,V_STEP_DEFAULT)
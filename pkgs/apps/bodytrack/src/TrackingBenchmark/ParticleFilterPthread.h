@@ -28,8 +28,10 @@
 #include "ParticleFilter.h"
 #include "WorkPoolPthread.h"
 #include "threads/WorkerGroup.h"
-#include "threads/TicketDispenser.h"
+#include "threads/WorkStealer.h"
 #include "threads/Barrier.h"
+#include "StageTimer.h"
+#include <iomanip>
 
 #undef min
 
@@ -59,6 +61,9 @@ public:
 	//entry function for worker threads
 	void Exec(threads::thread_cmd_t, threads::thread_rank_t);
 
+	//print the time spent computing particle weights and generating new particles and scheduler statistics
+	void ReportTimings(std::ostream &out) const;
+
 protected:
 	inline bool CalcWeight(std::vector<Vectorf> &particles, int i, int rank);   //calculate weight of one particle
 	virtual void CalcWeights(std::vector<Vectorf> &particles);                  //calculate particle weights based on model likelihood
@@ -72,9 +77,9 @@ protected:
 private:
 	WorkPoolPthread &workers;
 	threads::Barrier *workInit;
-	threads::TicketDispenser<int> particleTickets;
+	threads::WorkStealer weightScheduler, particleScheduler;
 	
-	//granularity of work unit for dynamic load balancing
+	//minimum granularity of work unit for dynamic load balancing
 	const int WORKUNIT_SIZE_PARTICLEWEIGHTS;
 	const int WORKUNIT_SIZE_NEWPARTICLES;
 
@@ -82,11 +87,13 @@ private:
 	std::vector<Vectorf> *particles;
 	std::vector<unsigned char> *valid;
 	int annealing_parameter;
+
+	StageTimer weightTimer, particleTimer;
 };
 
 //constructor
 template<class T>
-ParticleFilterPthread<T>::ParticleFilterPthread(WorkPoolPthread &_workers) : workers(_workers), WORKUNIT_SIZE_PARTICLEWEIGHTS(4), WORKUNIT_SIZE_NEWPARTICLES(32)
+ParticleFilterPthread<T>::ParticleFilterPthread(WorkPoolPthread &_workers) : workers(_workers), weightScheduler(_workers.Size()), particleScheduler(_workers.Size()), WORKUNIT_SIZE_PARTICLEWEIGHTS(4), WORKUNIT_SIZE_NEWPARTICLES(32)
 {
 	workInit = new threads::Barrier(workers.Size());
 }
@@ -102,40 +109,35 @@ ParticleFilterPthread<T>::~ParticleFilterPthread()
 template<class T>
 void ParticleFilterPthread<T>::Exec(threads::thread_cmd_t cmd, threads::thread_rank_t rank)
 {
-	int ticket,i;
+	int begin,end,i;
 	
 	if (cmd == workers.THREADS_CMD_PARTICLEWEIGHTS) {
-		//reset dispenser, set new increment to work unit size
+		//distribute particles among threads, set minimum work unit size
 		if(rank == 0) {
-			particleTickets.resetDispenser(WORKUNIT_SIZE_PARTICLEWEIGHTS);
+			weightScheduler.Reset((int)(particles->size()), WORKUNIT_SIZE_PARTICLEWEIGHTS);
 		}
 		workInit->Wait();
 	
-		ticket = particleTickets.getTicket();
-		while(ticket < (int)(particles->size())) {
-			//process all elements in work unit
-			for(i = ticket; i < (int)(particles->size()) && i < ticket + WORKUNIT_SIZE_PARTICLEWEIGHTS; i++) {
+		//process work units until no thread has particles left
+		while(weightScheduler.GetChunk(rank, begin, end)) {
+			for(i = begin; i < end; i++) {
 				(*valid)[i] = CalcWeight(*particles, i, rank);
 			}
-			ticket = particleTickets.getTicket();
 		}
 	} else if(cmd == workers.THREADS_CMD_NEWPARTICLES) {
-		//reset dispenser, set new increment to work unit size
+		//distribute particles among threads, set minimum work unit size
 		if(rank == 0) {
-			particleTickets.resetDispenser(WORKUNIT_SIZE_NEWPARTICLES);
+			particleScheduler.Reset(mNParticles, WORKUNIT_SIZE_NEWPARTICLES);
 		}
 		workInit->Wait();
 	
-		ticket = particleTickets.getTicket();
 		//distribute new particles randomly according to model stdDevs
-		while(ticket < mNParticles) {
-			//process all elements in work unit
-			for(i = ticket; i < mNParticles && i < ticket + WORKUNIT_SIZE_NEWPARTICLES; i++) {
+		while(particleScheduler.GetChunk(rank, begin, end)) {
+			for(i = begin; i < end; i++) {
 				//add new particle for each entry in each bin distributed randomly about duplicated particle
 				mNewParticles[i] = mParticles[mIndex[i]];
 				AddGaussianNoise(mNewParticles[i], mModel->StdDevs()[annealing_parameter], mRnd[i]);
 			}
-			ticket = particleTickets.getTicket();
 		}
 	} else {
 		//unknown command
@@ -168,7 +170,9 @@ void ParticleFilterPthread<T>::CalcWeights(std::vector<Vectorf> &particles)
 	ParticleFilterPthread<T>::valid = &valid;
 	
 	//signal to workers that work is available
+	weightTimer.Start();
 	workers.SendCmd(workers.THREADS_CMD_PARTICLEWEIGHTS);
+	weightTimer.Stop();
 
 	i = 0;
 	while(i < particles.size())
@@ -209,7 +213,26 @@ void ParticleFilterPthread<T>::GenerateNewParticles(int k)
 			
 	ParticleFilterPthread<T>::annealing_parameter = k;
 	//signal to workers that work is available
+	particleTimer.Start();
 	workers.SendCmd(workers.THREADS_CMD_NEWPARTICLES);
+	particleTimer.Stop();
+}
+
+//print statistics of a work stealing scheduler
+inline void ReportScheduler(std::ostream &out, const char *name, const threads::WorkStealerStats &s)
+{
+	out << "  " << std::left << std::setw(24) << name << std::right << s.chunks << " chunks, " << s.steals << " steals ("
+		<< s.stolenItems << " particles), " << s.failedSteals << " failed steals, " << s.contended << " contended locks" << std::endl;
+}
+
+//print the time spent in the parallel stages of the particle filter
+template<class T>
+void ParticleFilterPthread<T>::ReportTimings(std::ostream &out) const
+{
+	weightTimer.Report(out, "Particle weights");
+	particleTimer.Report(out, "New particles");
+	ReportScheduler(out, "Weight scheduling", weightScheduler.GetStats());
+	ReportScheduler(out, "Particle scheduling", particleScheduler.GetStats());
 }
 
 #endif
@@ -0,0 +1,76 @@
+//-------------------------------------------------------------
+//      ____                        _      _
+//     / ___|____ _   _ ____   ____| |__  | |
+//    | |   / ___| | | |  _  \/ ___|  _  \| |
+//    | |___| |  | |_| | | | | |___| | | ||_|
+//     \____|_|  \_____|_| |_|\____|_| |_|(_) Media benchmarks
+//                  
+//	  2006, Intel Corporation, licensed under Apache 2.0 
+//
+//  file : StageTimer.h
+//  description : Accumulates the wall clock time spent in a
+//				  stage of the tracking pipeline.  A timer
+//				  must only be used by one thread at a time.
+//				  
+//  modified : 
+//--------------------------------------------------------------
+
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include <iostream>
+#include <iomanip>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+class StageTimer {
+private:
+	double mStart;							//start time of current measurement
+	double mTotal;							//accumulated time in seconds
+	unsigned int mCount;					//number of measurements
+
+public:
+	StageTimer() : mStart(0), mTotal(0), mCount(0) {};
+
+	//current wall clock time in seconds
+	static double Now()
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER t, f;
+		QueryPerformanceCounter(&t);
+		QueryPerformanceFrequency(&f);
+		return (double)t.QuadPart / (double)f.QuadPart;
+#else
+		struct timeval t;
+		gettimeofday(&t, NULL);
+		return t.tv_sec + t.tv_usec * 1e-6;
+#endif
+	};
+
+	void Start() {mStart = Now(); };
+	void Stop()  {mTotal += Now() - mStart; mCount++; };
+
+	double Total() const {return mTotal; };
+	unsigned int Count() const {return mCount; };
+
+	//print one line with the total and average time of the stage
+	void Report(std::ostream &out, const char *name) const
+	{	std::ios::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(9) << mTotal << " s  (" << mCount << " x " << std::setprecision(2)
+			<< (mCount > 0 ? mTotal / mCount * 1000 : 0.0) << " ms)" << std::endl;
+		out.flags(flags);
+		out.precision(precision);
+	};
+};
+
+#endif //STAGETIMER_H
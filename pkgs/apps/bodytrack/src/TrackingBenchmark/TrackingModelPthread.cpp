@@ -31,7 +31,7 @@
 //#define SINGLE_THREADED
 
 //constructor
-TrackingModelPthread::TrackingModelPthread(WorkPoolPthread &_workers) : IOthreadStarted(false), workers(_workers), workInit(_workers.Size()), WORKUNIT_SIZE_FILTERROW(8), WORKUNIT_SIZE_FILTERCOLUMN(8), WORKUNIT_SIZE_GRADIENT(8) {};
+TrackingModelPthread::TrackingModelPthread(WorkPoolPthread &_workers) : IOthreadStarted(false), workers(_workers), workInit(_workers.Size()), pipelined(false), edgeStage(*this), edgeThread(NULL), nextReady(false), nextFailed(false), nextFull(nextLock), nextEmpty(nextLock), WORKUNIT_SIZE_FILTERROW(8), WORKUNIT_SIZE_FILTERCOLUMN(8), WORKUNIT_SIZE_GRADIENT(8) {};
 
 //Generate an edge map from the original camera image
 void TrackingModelPthread::CreateEdgeMap(FlexImage8u &src, FlexImage8u &dst)
@@ -223,16 +223,91 @@ bool TrackingModelPthread::GetObservation(float timeval)
 	if(timeval == 0)
 		return true;
 
+	if(pipelined)
+	{	if(edgeThread == NULL)								//start edge map thread if needed
+			edgeThread = new threads::Thread(edgeStage);
+		waitTimer.Start();
+		nextLock.Lock();
+		while(!nextReady && !nextFailed)					//wait for the edge maps of the next frame
+			nextFull.Wait();
+		bool ok = nextReady;
+		if(ok)												//swap buffers, the edge map thread continues with the following frame
+		{	mEdgeMaps.swap(nextEdgeMaps);
+			mFGMaps.swap(nextFGMaps);
+			nextReady = false;
+			nextEmpty.NotifyOne();
+		}
+		nextLock.Unlock();
+		waitTimer.Stop();
+		return ok;
+	}
+
 	std::vector<FlexImage8u> images;
-	if(!imageLoader.GetNextImageSet(images, mFGMaps))		//get next set of images and foreground maps (blocks on empty queue)
+	loadTimer.Start();
+	bool loaded = imageLoader.GetNextImageSet(images, mFGMaps);		//get next set of images and foreground maps (blocks on empty queue)
+	loadTimer.Stop();
+	if(!loaded)
 		return false;
+	edgeTimer.Start();
 	for(unsigned int i = 0; i < images.size(); i++)			//create edge maps from images
 		CreateEdgeMap(images[i], mEdgeMaps[i]);	
+	edgeTimer.Stop();
 	return true;
 }
 
+//edge map stage - creates the edge maps of all frames ahead of the particle filter
+//The worker threads are busy with the particle weights, so the edge maps are created by this thread alone
+void TrackingModelPthread::EdgeMapLoop()
+{
+	std::vector<FlexImage8u> images;
+	ImageSet edgeMaps(mNCameras);
+	BinaryImageSet FGMaps;
+
+	for(unsigned int frame = 0; frame < nFrames; frame++)
+	{	loadTimer.Start();
+		bool loaded = imageLoader.GetNextImageSet(images, FGMaps);
+		loadTimer.Stop();
+		if(!loaded)
+			break;
+		edgeMaps.resize(images.size());						//buffer returned by the particle filter might be empty
+		edgeTimer.Start();
+		for(unsigned int i = 0; i < images.size(); i++)
+			TrackingModel::CreateEdgeMap(images[i], edgeMaps[i]);
+		edgeTimer.Stop();
+
+		nextLock.Lock();
+		while(nextReady)									//wait until the particle filter took the previous frame
+			nextEmpty.Wait();
+		nextEdgeMaps.swap(edgeMaps);
+		nextFGMaps.swap(FGMaps);
+		nextReady = true;
+		nextFull.NotifyOne();
+		nextLock.Unlock();
+	}
+	nextLock.Lock();
+	nextFailed = true;
+	nextFull.NotifyOne();
+	nextLock.Unlock();
+}
+
+void TrackingModelPthread::close()
+{
+	IOthread->Join();
+	if(edgeThread != NULL)
+		edgeThread->Join();
+}
+
+void TrackingModelPthread::ReportTimings(std::ostream &out) const
+{
+	loadTimer.Report(out, "Image loading (wait)");
+	edgeTimer.Report(out, "Edge maps");
+	if(pipelined)
+		waitTimer.Report(out, "Edge maps (wait)");
+}
+
 TrackingModelPthread::~TrackingModelPthread()
 {
 	delete IOthread;
+	delete edgeThread;
 }
 
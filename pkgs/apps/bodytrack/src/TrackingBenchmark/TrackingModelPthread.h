@@ -27,8 +27,11 @@
 #include "threads/WorkerGroup.h"
 #include "threads/TicketDispenser.h"
 #include "threads/Barrier.h"
+#include "threads/Mutex.h"
+#include "threads/Condition.h"
 #include "WorkPoolPthread.h"
 #include "AsyncIO.h"
+#include "StageTimer.h"
 
 
 
@@ -49,11 +52,17 @@ public:
 	//set number of frames to be loaded
 	void SetNumFrames(unsigned int n) {nFrames = n; };
 
+	//create the edge maps of the next frame in a separate thread while the particle filter processes the current frame
+	void SetPipelined(bool p) {pipelined = p; };
+
 	//Load and process new observation data from image files for a given time(frame).  Generates edge maps from the raw image files.
 	virtual bool GetObservation(float timeval);
 
-	//terminate IO thread
-	void close() { IOthread->Join(); };
+	//terminate IO and edge map threads
+	void close();
+
+	//print the time spent in the observation stages
+	void ReportTimings(std::ostream &out) const;
 
 private:
 	//the pool with the worker threads
@@ -65,6 +74,33 @@ private:
 	bool IOthreadStarted;
 	unsigned int nFrames;
 
+	//edge map stage of the pipelined mode, runs EdgeMapLoop()
+	class EdgeMapStage : public threads::Runnable {
+	public:
+		EdgeMapStage(TrackingModelPthread &_model) : model(_model) {};
+		void Run() {model.EdgeMapLoop(); };
+	private:
+		TrackingModelPthread &model;
+	};
+
+	//The edge map thread creates the edge maps of frame t+1 in the second buffer
+	//while the particle filter uses those of frame t
+	bool pipelined;
+	EdgeMapStage edgeStage;
+	threads::Thread *edgeThread;
+	ImageSet nextEdgeMaps;						//second buffer of edge maps and foreground maps
+	BinaryImageSet nextFGMaps;
+	bool nextReady;								//second buffer holds the next observation
+	bool nextFailed;							//no more observations can be created
+	threads::Mutex nextLock;
+	threads::Condition nextFull, nextEmpty;
+
+	//time spent waiting for images, creating edge maps and waiting for the edge map thread
+	StageTimer loadTimer, edgeTimer, waitTimer;
+
+	//thread entry function of the edge map stage
+	void EdgeMapLoop();
+
 	//granularity of work unit for dynamic load balancing
 	const int WORKUNIT_SIZE_FILTERROW;
 	const int WORKUNIT_SIZE_FILTERCOLUMN;
@@ -83,11 +83,12 @@ inline void WritePose(ostream &f, vector<float> &pose)
 	f << endl;
 }
 
-bool ProcessCmdLine(int argc, char **argv, string &path, int &cameras, int &frames, int &particles, int &layers, int &threads, int &threadModel, bool &OutputBMP)
+bool ProcessCmdLine(int argc, char **argv, string &path, int &cameras, int &frames, int &particles, int &layers, int &threads, int &threadModel, bool &OutputBMP, bool &pipelined)
 {
 	string    usage("Usage : Track (Dataset Path) (# of cameras) (# of frames to process)\n");
 	usage += string("              (# of particles) (# of annealing layers) \n");
-	usage += string("              [thread model] [# of threads] [write .bmp output (nonzero = yes)]\n\n");
+	usage += string("              [thread model] [# of threads] [write .bmp output (nonzero = yes)]\n");
+	usage += string("              [pipelined edge maps (nonzero = yes, Posix threads only)]\n\n");
 	usage += string("        Thread model : 0 = Auto-select from available models\n");
         usage += string("                       1 = Intel TBB                 ");
 #ifdef USE_TBB
@@ -110,7 +111,7 @@ bool ProcessCmdLine(int argc, char **argv, string &path, int &cameras, int &fram
         usage += string("                       4 = Serial\n");
 
 	string errmsg("Error : invalid argument - ");
-	if(argc < 6 || argc > 9)															//check for valid number of arguments
+	if(argc < 6 || argc > 10)															//check for valid number of arguments
 	{	cout << "Error : Invalid number of arguments" << endl << usage << endl;
 		return false;
 	}
@@ -155,6 +156,14 @@ bool ProcessCmdLine(int argc, char **argv, string &path, int &cameras, int &fram
 		}
 		OutputBMP = (n != 0);
 	}
+	pipelined = false;																	//edge maps are created before each frame by default
+	if(argc > 9)
+	{	if(!num(string(argv[9]), n))
+		{	cout << errmsg << "pipelined edge maps flag" << endl << usage << endl;
+			return false;
+		}
+		pipelined = (n != 0);
+	}
 	return true;
 }
 
@@ -210,7 +219,7 @@ int mainOMP(string path, int cameras, int frames, int particles, int layers, int
 
 #if defined(USE_THREADS)
 //Body tracking threaded with explicit Posix threads
-int mainPthreads(string path, int cameras, int frames, int particles, int layers, int threads, bool OutputBMP)
+int mainPthreads(string path, int cameras, int frames, int particles, int layers, int threads, bool OutputBMP, bool pipelined)
 {
 	cout << "Threading with Posix Threads" << endl;
 	if(threads < 1) {
@@ -233,6 +242,9 @@ int mainPthreads(string path, int cameras, int frames, int particles, int layers
 	}
 	model.SetNumThreads(threads);
 	model.SetNumFrames(frames);
+	model.SetPipelined(pipelined);
+	if(pipelined)
+		cout << "Creating edge maps in a pipeline stage" << endl;
 	model.GetObservation(-1);															//load data for first frame
 	ParticleFilterPthread<TrackingModel> pf(workers);									//particle filter instantiated with body tracking model type
 	pf.SetModel(model);																	//set the particle filter model
@@ -246,17 +258,20 @@ int mainPthreads(string path, int cameras, int frames, int particles, int layers
 	ofstream outputFileAvg((path + "poses.txt").c_str());
 
 	vector<float> estimate;																//expected pose from particle distribution
+	StageTimer frameTimer;
 
 #if defined(ENABLE_PARSEC_HOOKS)
         __parsec_roi_begin();
 #endif
 	for(int i = 0; i < frames; i++)														//process each set of frames
 	{	cout << "Processing frame " << i << endl;
+		frameTimer.Start();
 		if(!pf.Update((float)i))														//Run particle filter step
 		{	cout << "Error loading observation data" << endl;
 			workers.JoinAll();
 			return 0;
 		}		
+		frameTimer.Stop();
 		pf.Estimate(estimate);															//get average pose of the particle distribution
 		WritePose(outputFileAvg, estimate);
 		if(OutputBMP)
@@ -268,6 +283,11 @@ int mainPthreads(string path, int cameras, int frames, int particles, int layers
         __parsec_roi_end();
 #endif
 
+	cout << endl << "Stage timings :" << endl;										//the edge map stage overlaps with the particle filter in pipelined mode
+	model.ReportTimings(cout);
+	pf.ReportTimings(cout);
+	frameTimer.Report(cout, "Frames");
+
 	return 1;
 }
 #endif
@@ -368,7 +388,7 @@ int mainSingleThread(string path, int cameras, int frames, int particles, int la
 int main(int argc, char **argv)
 {
 	string path;
-	bool OutputBMP;
+	bool OutputBMP, pipelined;
 	int cameras, frames, particles, layers, threads, threadModel;								//process command line parameters to get path, cameras, and frames
 
 #ifdef PARSEC_VERSION
@@ -382,7 +402,7 @@ int main(int argc, char **argv)
         __parsec_bench_begin(__parsec_bodytrack);
 #endif
 
-	if(!ProcessCmdLine(argc, argv, path, cameras, frames, particles, layers, threads, threadModel, OutputBMP))	
+	if(!ProcessCmdLine(argc, argv, path, cameras, frames, particles, layers, threads, threadModel, OutputBMP, pipelined))	
 		return 0;
 
         if(threadModel == 0) {
@@ -416,7 +436,7 @@ int main(int argc, char **argv)
 
                 case 2 :
                         #if defined(USE_THREADS)
-                                mainPthreads(path, cameras, frames, particles, layers, threads, OutputBMP);             //Posix threads tracking
+                                mainPthreads(path, cameras, frames, particles, layers, threads, OutputBMP, pipelined);             //Posix threads tracking
                                 break;
                         #else
                                 cout << "Not compiled with Posix threads support. " << endl;
@@ -0,0 +1,122 @@
+//  Use, modification and distribution are subject to the
+//  Boost Software License, Version 1.0.
+//
+//  file : WorkStealer.cpp
+//  description : A scheduler which distributes a range of work items among
+//                threads and balances the load by work stealing
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include <cstring>
+
+#include "WorkStealer.h"
+
+
+namespace threads {
+
+//A thread takes 1/CHUNK_SHARE of the items left in its own queue at once
+static const int CHUNK_SHARE = 4;
+
+WorkStealer::WorkStealer(int _n) {
+  n = _n;
+  minChunk = 1;
+  queues = new Queue[n];
+  for(int i=0; i<n; i++) {
+    queues[i].begin = 0;
+    queues[i].end = 0;
+    memset(&queues[i].stats, 0, sizeof(WorkStealerStats));
+  }
+}
+
+WorkStealer::~WorkStealer() {
+  delete [] queues;
+}
+
+void WorkStealer::Reset(int size, int _minChunk) throw(MutexException) {
+  minChunk = _minChunk < 1 ? 1 : _minChunk;
+  for(int i=0; i<n; i++) {
+    queues[i].lock.Lock();
+    queues[i].begin = (int)((long long)size * i / n);
+    queues[i].end = (int)((long long)size * (i + 1) / n);
+    queues[i].lock.Unlock();
+  }
+}
+
+void WorkStealer::Acquire(Queue &q, Queue &self) throw(MutexException) {
+  if(!q.lock.TryLock()) {
+    self.stats.contended++;
+    q.lock.Lock();
+  }
+}
+
+void WorkStealer::TakeChunk(Queue &q, int &begin, int &end) {
+  int left = q.end - q.begin;
+  int chunk = left / CHUNK_SHARE;
+
+  if(chunk < minChunk) chunk = minChunk;
+  if(chunk > left) chunk = left;
+  begin = q.begin;
+  end = q.begin + chunk;
+  q.begin = end;
+  q.stats.chunks++;
+  q.stats.items += chunk;
+}
+
+bool WorkStealer::GetChunk(int rank, int &begin, int &end) throw(MutexException) {
+  Queue &self = queues[rank];
+
+  Acquire(self, self);
+  if(self.begin < self.end) {
+    TakeChunk(self, begin, end);
+    self.lock.Unlock();
+    return true;
+  }
+  self.lock.Unlock();
+
+  //own queue is empty, steal half of the items left in the next non-empty queue
+  for(int i=1; i<n; i++) {
+    Queue &victim = queues[(rank + i) % n];
+    int stolenBegin, stolenEnd;
+
+    Acquire(victim, self);
+    stolenEnd = victim.end;
+    stolenBegin = victim.end - (victim.end - victim.begin + 1) / 2;
+    victim.end = stolenBegin;
+    victim.lock.Unlock();
+
+    if(stolenBegin == stolenEnd) {
+      self.stats.failedSteals++;
+      continue;
+    }
+    self.stats.steals++;
+    self.stats.stolenItems += stolenEnd - stolenBegin;
+
+    Acquire(self, self);
+    self.begin = stolenBegin;
+    self.end = stolenEnd;
+    TakeChunk(self, begin, end);
+    self.lock.Unlock();
+    return true;
+  }
+
+  return false;
+}
+
+WorkStealerStats WorkStealer::GetStats() const {
+  WorkStealerStats total;
+
+  memset(&total, 0, sizeof(WorkStealerStats));
+  for(int i=0; i<n; i++) {
+    total.chunks += queues[i].stats.chunks;
+    total.items += queues[i].stats.items;
+    total.steals += queues[i].stats.steals;
+    total.stolenItems += queues[i].stats.stolenItems;
+    total.failedSteals += queues[i].stats.failedSteals;
+    total.contended += queues[i].stats.contended;
+  }
+  return total;
+}
+
+} //namespace threads
@@ -0,0 +1,73 @@
+//  Use, modification and distribution are subject to the
+//  Boost Software License, Version 1.0.
+//
+//  file : WorkStealer.h
+//  description : A scheduler which distributes a range of work items among
+//                threads and balances the load by work stealing
+
+#ifndef WORKSTEALER_H
+#define WORKSTEALER_H
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#pragma warning( disable : 4290)		//disable Microsoft compiler exception warning
+
+#include "Mutex.h"
+
+
+namespace threads {
+
+//Statistics of a work stealer, accumulated over all runs
+typedef struct {
+  long chunks;        //number of chunks handed out
+  long items;         //number of items handed out
+  long steals;        //number of successful steals
+  long stolenItems;   //number of items moved by steals
+  long failedSteals;  //number of steal attempts which found an empty queue
+  long contended;     //number of lock acquisitions which had to wait
+} WorkStealerStats;
+
+//Every thread owns a queue with a contiguous range of items. A thread takes
+//chunks from the front of its own range, the chunk size shrinks with the
+//number of remaining items down to a minimum chunk size. Threads which run
+//out of work steal half of the remaining items from the back of another
+//thread's range. Every item is handed out exactly once.
+class WorkStealer {
+  public:
+    //work stealer for n threads with ranks 0 to n-1
+    WorkStealer(int n);
+    ~WorkStealer();
+
+    //distribute the items 0 to size-1 evenly among all threads, chunks will contain
+    //at least minChunk items. Must not be called while threads are getting chunks
+    void Reset(int size, int minChunk) throw(MutexException);
+    //get the next chunk [begin, end) for the thread with the given rank
+    //returns false if no items are left
+    bool GetChunk(int rank, int &begin, int &end) throw(MutexException);
+    //get the sum of the statistics of all threads
+    WorkStealerStats GetStats() const;
+
+  private:
+    struct Queue {
+      Mutex lock;
+      int begin;
+      int end;
+      WorkStealerStats stats;   //only updated by the thread which owns the queue
+      char padding[64];         //keep queues of different threads in different cache lines
+    };
+
+    int n;
+    int minChunk;
+    Queue *queues;
+
+    //lock a queue, counting contention in the statistics of self
+    void Acquire(Queue &q, Queue &self) throw(MutexException);
+    //take a chunk from the front of a locked queue
+    void TakeChunk(Queue &q, int &begin, int &end);
+};
+
+} //namespace threads
+
+#endif //WORKSTEALER_H
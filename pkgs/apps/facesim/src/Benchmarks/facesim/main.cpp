@@ -44,6 +44,7 @@ int main (int argc, char* argv[])
 	parse_args.Add_Integer_Argument ("-lastframe", 300);
 	parse_args.Add_Integer_Argument ("-threads", 1);
 	parse_args.Add_Option_Argument ("-timing");
+	parse_args.Add_Option_Argument ("-cg_stats");
 	parse_args.Parse (argc, argv);
 
 	STORYTELLING_EXAMPLE<float, float> example;
@@ -76,6 +77,11 @@ int main (int argc, char* argv[])
 		example.verbose = false;
 	}
 
+	if (parse_args.Is_Value_Set ("-cg_stats"))
+	{
+		example.solids_parameters.deformable_body_parameters.print_cg_iterations = true;
+	}
+
 	if (PHYSBAM_THREADED_RUN == false && parse_args.Get_Integer_Value ("-threads") > 1)
 	{
 		printf ("Error: Number of threads cannot be greater than 1 for serial runs\n");
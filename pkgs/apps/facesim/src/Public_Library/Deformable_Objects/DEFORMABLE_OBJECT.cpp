@@ -10,6 +10,7 @@
 #include "../Arrays/ARRAY_RANGE.h"
 #include "../Utilities/LOG.h"
 #include "../Utilities/DEBUG_UTILITIES.h"
+#include "../Utilities/TIMER.h"
 #include "../Thread_Utilities/THREAD_POOL.h"
 using namespace PhysBAM;
 extern bool PHYSBAM_THREADED_RUN;
@@ -98,6 +99,7 @@ template<class T, class TV> struct CONJUGATE_GRADIENTS_HELPER
 	T alpha, beta;
 	ARRAY<TV>* dX_full;
 	ARRAY<double> *S_dot_Q_partial, *rho_new_partial, *supnorm_partial;
+	ARRAY<double> *R_dot_Q_partial, *Q_dot_Q_partial;
 };
 template<class T, class TV> void DEFORMABLE_OBJECT<T, TV>::
 Backward_Euler_Step_Velocity_CG_Helper_I (long thread_id, void* helper_raw)
@@ -196,6 +198,128 @@ One_Newton_Step_Toward_Steady_State_CG_Helper_III (long thread_id, void* helper_
 // False sharing version
 //    for(int i=1;i<=dX.m;i++){dX(i)+=alpha*S(i);R(i)+=alpha*negative_Q(i);double s2=R(i).Magnitude_Squared();rho_new+=s2;supnorm=max(supnorm,s2);}
 }
+#ifdef FUSED_CG_OPERATIONS
+//#####################################################################
+// Fused conjugate gradients
+//#####################################################################
+// Two passes per iteration instead of three. The first applies the force differential to S and gathers all the dot
+// products alpha and beta depend on while negative_Q of the partition is still in cache. The new residual norm follows from
+// |R+alpha*negative_Q|^2 = rho+2*alpha*R.negative_Q+alpha^2*negative_Q.negative_Q, so the second pass can update dX, R and S
+// at once. It also computes the exact residual norm, which is used for alpha in the next iteration.
+template<class T, class TV> void DEFORMABLE_OBJECT<T, TV>::
+One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_I (long thread_id, void* helper_raw)
+{
+	CONJUGATE_GRADIENTS_HELPER<T, TV>const& helper = * (CONJUGATE_GRADIENTS_HELPER<T, TV>*) helper_raw;
+	DEFORMABLE_OBJECT<T, TV>& deformable_object = *helper.deformable_object;
+	int partition_id = helper.partition_id;
+	VECTOR_2D<int> particle_range = (*deformable_object.particles.particle_ranges) (partition_id);
+	ARRAY<TV>& negative_Q_full = deformable_object.F_full;
+	ARRAY_RANGE<ARRAY<TV> > S (deformable_object.S_full, particle_range);
+	ARRAY_RANGE<ARRAY<TV> > R (deformable_object.R_full, particle_range);
+	ARRAY_RANGE<ARRAY<TV> > negative_Q (negative_Q_full, particle_range);
+	double S_dot_Q = 0, R_dot_Q = 0, Q_dot_Q = 0;
+
+	deformable_object.Force_Differential (deformable_object.S_full, negative_Q_full, partition_id);
+	deformable_object.external_forces_and_velocities->Zero_Out_Enslaved_Position_Nodes (negative_Q_full, helper.time, deformable_object.id_number, partition_id);
+
+	for (int i = 1; i <= S.m; i++)
+	{
+		S_dot_Q -= TV::Dot_Product (S (i), negative_Q (i));
+		R_dot_Q += TV::Dot_Product (R (i), negative_Q (i));
+		Q_dot_Q += negative_Q (i).Magnitude_Squared();
+	}
+
+	(*helper.S_dot_Q_partial) (partition_id) = S_dot_Q;
+	(*helper.R_dot_Q_partial) (partition_id) = R_dot_Q;
+	(*helper.Q_dot_Q_partial) (partition_id) = Q_dot_Q;
+}
+template<class T, class TV> void DEFORMABLE_OBJECT<T, TV>::
+One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_II (long thread_id, void* helper_raw)
+{
+	CONJUGATE_GRADIENTS_HELPER<T, TV>const& helper = * (CONJUGATE_GRADIENTS_HELPER<T, TV>*) helper_raw;
+	DEFORMABLE_OBJECT<T, TV>& deformable_object = *helper.deformable_object;
+	int partition_id = helper.partition_id;
+	VECTOR_2D<int> particle_range = (*deformable_object.particles.particle_ranges) (partition_id);
+	T alpha = helper.alpha, beta = helper.beta;
+	ARRAY_RANGE<ARRAY<TV> > dX (*helper.dX_full, particle_range);
+	ARRAY_RANGE<ARRAY<TV> > S (deformable_object.S_full, particle_range);
+	ARRAY_RANGE<ARRAY<TV> > R (deformable_object.R_full, particle_range);
+	ARRAY_RANGE<ARRAY<TV> > negative_Q (deformable_object.F_full, particle_range);
+	double local_rho_new = 0, local_supnorm = 0;
+
+	for (int i = 1; i <= dX.m; i++)
+	{
+		dX (i) += alpha * S (i);
+		R (i) += alpha * negative_Q (i);
+		S (i) = beta * S (i) + R (i);
+		double s2 = R (i).Magnitude_Squared();
+		local_rho_new += s2;
+		local_supnorm = max (local_supnorm, s2);
+	}
+
+	(*helper.rho_new_partial) (partition_id) = local_rho_new;
+	(*helper.supnorm_partial) (partition_id) = local_supnorm;
+}
+// returns the number of iterations used, max_iterations+1 if not converged
+template<class T, class TV> int DEFORMABLE_OBJECT<T, TV>::
+One_Newton_Step_Toward_Steady_State_Fused_CG (const T convergence_tolerance, const int max_iterations, const T time, ARRAY<TV>& dX_full, double rho, double& supnorm)
+{
+	typedef CONJUGATE_GRADIENTS_HELPER<T, TV> T_CG_HELPER;
+	THREAD_POOL& pool = *THREAD_POOL::Singleton();
+	int partitions = particles.particle_ranges->m;
+	ARRAY<double> S_dot_Q_partial (partitions), R_dot_Q_partial (partitions), Q_dot_Q_partial (partitions);
+	ARRAY<double> rho_new_partial (partitions), supnorm_partial (partitions);
+	ARRAY<T_CG_HELPER> helpers (partitions);
+	int iterations;
+
+	for (int p = 1; p <= partitions; p++)
+	{
+		helpers (p).deformable_object = this;
+		helpers (p).partition_id = p;
+		helpers (p).time = time;
+		helpers (p).beta = 0;
+		helpers (p).dX_full = &dX_full;
+		helpers (p).S_dot_Q_partial = &S_dot_Q_partial;
+		helpers (p).R_dot_Q_partial = &R_dot_Q_partial;
+		helpers (p).Q_dot_Q_partial = &Q_dot_Q_partial;
+		helpers (p).rho_new_partial = &rho_new_partial;
+		helpers (p).supnorm_partial = &supnorm_partial;
+		pool.Add_Task (One_Newton_Step_Toward_Steady_State_CG_Helper_I, &helpers (p)); // S=R
+	}
+
+	pool.Wait_For_Completion();
+
+	for (iterations = 1; iterations <= max_iterations; iterations++)
+	{
+		double start_time = print_cg_iterations ? TIMER::Singleton()->Get_Time() : 0;
+
+		for (int p = 1; p <= partitions; p++) pool.Add_Task (One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_I, &helpers (p));
+
+		pool.Wait_For_Completion();
+		double S_dot_Q = ARRAY<double>::sum (S_dot_Q_partial);
+		T alpha = (T) (rho / S_dot_Q);
+		double rho_new = rho + 2 * alpha * ARRAY<double>::sum (R_dot_Q_partial) + (double) alpha * alpha * ARRAY<double>::sum (Q_dot_Q_partial);
+		T beta = (T) (max (rho_new, (double) 0) / rho);
+
+		for (int p = 1; p <= partitions; p++)
+		{
+			helpers (p).alpha = alpha;
+			helpers (p).beta = beta;
+			pool.Add_Task (One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_II, &helpers (p));
+		}
+
+		pool.Wait_For_Completion();
+		rho = ARRAY<double>::sum (rho_new_partial);
+		supnorm = sqrt (ARRAY<double>::max (supnorm_partial));
+
+		if (print_cg_iterations) LOG::cout << "CG iteration " << iterations << " residual = " << supnorm << " time = " << TIMER::Singleton()->Get_Time() - start_time << " ms" << std::endl;
+
+		if (supnorm <= convergence_tolerance) break;
+	}
+
+	return iterations;
+}
+#endif
 template<class T, class TV> bool DEFORMABLE_OBJECT<T, TV>::
 One_Newton_Step_Toward_Steady_State (const T convergence_tolerance, const int max_iterations, const T time, ARRAY<TV>& dX_full, const bool balance_external_forces_only,
 				     int* iterations_used, const bool update_positions_and_state)
@@ -266,9 +390,15 @@ One_Newton_Step_Toward_Steady_State (const T convergence_tolerance, const int ma
 	int iterations;
 	T beta = 0;
 
+#ifdef FUSED_CG_OPERATIONS
+
+	if (PHYSBAM_THREADED_RUN) iterations = One_Newton_Step_Toward_Steady_State_Fused_CG (convergence_tolerance, max_iterations, time, dX_full, rho, supnorm);
+	else
+#endif
 	for (iterations = 1; iterations <= max_iterations; iterations++)
 	{
 //        LOG::Time("CGI - Update solution I");
+		double start_time = print_cg_iterations ? TIMER::Singleton()->Get_Time() : 0;
 		double S_dot_Q = 0;
 
 		if (PHYSBAM_THREADED_RUN)
@@ -387,6 +517,8 @@ One_Newton_Step_Toward_Steady_State (const T convergence_tolerance, const int ma
 
 //        LOG::Stop_Time();
 		//if(print_residuals) LOG::cout << supnorm << std::endl;
+		if (print_cg_iterations) LOG::cout << "CG iteration " << iterations << " residual = " << supnorm << " time = " << TIMER::Singleton()->Get_Time() - start_time << " ms" << std::endl;
+
 		if (supnorm <= convergence_tolerance) break;
 
 		beta = (T) (rho_new / rho);
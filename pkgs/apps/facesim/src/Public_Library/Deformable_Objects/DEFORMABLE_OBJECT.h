@@ -11,6 +11,7 @@
 #include "../Particles/SOLIDS_PARTICLE.h"
 #include "../Forces_And_Torques/EXTERNAL_FORCES_AND_VELOCITIES.h"
 #define AGGREGATE_CG_OPERATIONS
+#define FUSED_CG_OPERATIONS // requires AGGREGATE_CG_OPERATIONS
 namespace PhysBAM
 {
 
@@ -29,6 +30,7 @@ public:
 	int id_number;
 	bool print_diagnostics;
 	bool print_residuals;
+	bool print_cg_iterations;
 	bool simulate;
 private:
 	EXTERNAL_FORCES_AND_VELOCITIES<T, TV> external_forces_and_velocities_default;
@@ -40,6 +42,7 @@ public:
 	{
 		Print_Diagnostics (false);
 		Print_Residuals (false);
+		Print_CG_Iterations (false);
 		Set_CFL_Number();
 		Set_Implicit_Damping();
 	}
@@ -57,6 +60,11 @@ public:
 		print_residuals = print_residuals_input;
 	}
 
+	void Print_CG_Iterations (const bool print_cg_iterations_input = true)
+	{
+		print_cg_iterations = print_cg_iterations_input;
+	}
+
 	void Set_External_Forces_And_Velocities (EXTERNAL_FORCES_AND_VELOCITIES<T, TV>& external_forces_and_velocities_input, const int id_number_input = 1)
 	{
 		external_forces_and_velocities = &external_forces_and_velocities_input;
@@ -105,6 +113,11 @@ public:
 	static void One_Newton_Step_Toward_Steady_State_CG_Helper_I (long thread_id, void* helper_raw);
 	static void One_Newton_Step_Toward_Steady_State_CG_Helper_II (long thread_id, void* helper_raw);
 	static void One_Newton_Step_Toward_Steady_State_CG_Helper_III (long thread_id, void* helper_raw);
+#ifdef FUSED_CG_OPERATIONS
+	static void One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_I (long thread_id, void* helper_raw);
+	static void One_Newton_Step_Toward_Steady_State_Fused_CG_Helper_II (long thread_id, void* helper_raw);
+	int One_Newton_Step_Toward_Steady_State_Fused_CG (const T convergence_tolerance, const int max_iterations, const T time, ARRAY<TV>& dX_full, double rho, double& supnorm);
+#endif
 #endif
 	bool One_Newton_Step_Toward_Steady_State (const T convergence_tolerance, const int max_iterations, const T time, ARRAY<TV>& dX, const bool balance_external_forces_only = false,
 			int* iterations_used = 0, const bool update_positions_and_state = true);
@@ -259,6 +259,11 @@ public:
 		for (int i = 1; i <= deformable_objects.m; i++) deformable_objects (i)->Print_Residuals (print_residuals);
 	}
 
+	void Print_CG_Iterations (const bool print_cg_iterations)
+	{
+		for (int i = 1; i <= deformable_objects.m; i++) deformable_objects (i)->Print_CG_Iterations (print_cg_iterations);
+	}
+
 	template<class RW>
 	void Read_Static_Variables (const std::string& prefix, const int frame = -1)
 	{
@@ -12,6 +12,12 @@
 #include "../Arrays/ARRAY_PARALLEL_OPERATIONS.h"
 #include "../Thread_Utilities/THREAD_ARRAY_LOCK.h"
 #endif
+#if defined(__AVX__) && !defined(NO_BATCHED_SVD) // with fewer than 8 lanes the batched decomposition is slower than the scalar one
+#define USE_BATCHED_SVD
+#endif
+#ifdef USE_BATCHED_SVD
+#include "../Matrices_And_Vectors/MATRIX_3X3_BATCH.h"
+#endif
 using namespace PhysBAM;
 extern bool PHYSBAM_THREADED_RUN;
 //#define OUTPUT_THREADING_AUXILIARY_STRUCTURES
@@ -257,6 +263,42 @@ Update_Position_Based_State()
 #endif
 }
 
+#ifdef USE_BATCHED_SVD
+//#####################################################################
+// Function Batch_Singular_Value_Decomposition
+//#####################################################################
+// decomposes F of the n<=MATRIX_3X3_BATCH_WIDTH tetrahedra following first (or of their parents) into U, Fe_hat and V(0),...,V(n-1)
+// only float matrices are decomposed in SIMD lanes, with doubles the batched decomposition is slower than the scalar one
+template<class T> static void Batch_Singular_Value_Decomposition (const STRAIN_MEASURE_3D<T>& strain_measure, const LIST_ARRAY<int>* parents, const int first, const int n,
+		LIST_ARRAY<MATRIX_3X3<T> >& U, LIST_ARRAY<DIAGONAL_MATRIX_3X3<T> >& Fe_hat, MATRIX_3X3<T> V[])
+{
+	for (int i = 0; i < n; i++)
+	{
+		int t = first + i;
+		strain_measure.F (parents ? (*parents) (t) : t).Fast_Singular_Value_Decomposition (U (t), Fe_hat (t), V[i]);
+	}
+}
+static void Batch_Singular_Value_Decomposition (const STRAIN_MEASURE_3D<float>& strain_measure, const LIST_ARRAY<int>* parents, const int first, const int n,
+		LIST_ARRAY<MATRIX_3X3<float> >& U, LIST_ARRAY<DIAGONAL_MATRIX_3X3<float> >& Fe_hat, MATRIX_3X3<float> V[])
+{
+	MATRIX_3X3<float> F[MATRIX_3X3_BATCH_WIDTH];
+	const MATRIX_3X3<float>* F_pointer[MATRIX_3X3_BATCH_WIDTH];
+	MATRIX_3X3<float>* U_pointer[MATRIX_3X3_BATCH_WIDTH], *V_pointer[MATRIX_3X3_BATCH_WIDTH];
+	DIAGONAL_MATRIX_3X3<float>* Fe_hat_pointer[MATRIX_3X3_BATCH_WIDTH];
+
+	for (int i = 0; i < n; i++)
+	{
+		int t = first + i;
+		F[i] = strain_measure.F (parents ? (*parents) (t) : t);
+		F_pointer[i] = &F[i];
+		U_pointer[i] = &U (t);
+		Fe_hat_pointer[i] = &Fe_hat (t);
+		V_pointer[i] = &V[i];
+	}
+
+	MATRIX_3X3_BATCH<float, MATRIX_3X3_BATCH_WIDTH>::Fast_Singular_Value_Decomposition (F_pointer, U_pointer, Fe_hat_pointer, V_pointer, n);
+}
+#endif
 template<class T> void DIAGONALIZED_FINITE_VOLUME_3D<T>::
 Update_Position_Based_State_Helper (long thread_id, void* helper_raw)
 {
@@ -290,10 +332,22 @@ Update_Position_Based_State_Helper (long thread_id, void* helper_raw)
 
 	for (int e = internal_edge_range.x; e <= external_edge_range.y; e++) extended_edge_stiffness (e) = MATRIX_3X3<T>();
 
+#ifdef USE_BATCHED_SVD
+	MATRIX_3X3<T> V_batch[MATRIX_3X3_BATCH_WIDTH];
+#endif
+
 	for (int t = extended_tetrahedron_range.x; t <= extended_tetrahedron_range.y; t++)
 	{
 		int t_parent = extended_tetrahedron_parents (t);
+#ifdef USE_BATCHED_SVD
+		int lane = (t - extended_tetrahedron_range.x) % MATRIX_3X3_BATCH_WIDTH;
+
+		if (lane == 0) Batch_Singular_Value_Decomposition (strain_measure, &extended_tetrahedron_parents, t, min (MATRIX_3X3_BATCH_WIDTH, extended_tetrahedron_range.y - t + 1), extended_U, extended_Fe_hat, V_batch);
+
+		V_local = V_batch[lane];
+#else
 		strain_measure.F (t_parent).Fast_Singular_Value_Decomposition (extended_U (t), extended_Fe_hat (t), V_local);
+#endif
 		constitutive_model.Isotropic_Stress_Derivative (extended_Fe_hat (t), extended_dP_dFe (t), t_parent);
 
 		if (constitutive_model.anisotropic) constitutive_model.Update_State_Dependent_Auxiliary_Variables (extended_Fe_hat (t), V_local, t_parent);
@@ -582,11 +636,22 @@ Update_Position_Based_State_Serial()
 	}
 
 	MATRIX_3X3<T> V_local;
+#ifdef USE_BATCHED_SVD
+	MATRIX_3X3<T> V_batch[MATRIX_3X3_BATCH_WIDTH];
+#endif
 	LOG::Time ("UPBS (FEM) - Element loop");
 
 	for (int t = 1; t <= elements; t++)
 	{
+#ifdef USE_BATCHED_SVD
+		int lane = (t - 1) % MATRIX_3X3_BATCH_WIDTH;
+
+		if (lane == 0) Batch_Singular_Value_Decomposition (strain_measure, (LIST_ARRAY<int>*) 0, t, min (MATRIX_3X3_BATCH_WIDTH, elements - t + 1), U, Fe_hat, V_batch);
+
+		V_local = V_batch[lane];
+#else
 		strain_measure.F (t).Fast_Singular_Value_Decomposition (U (t), Fe_hat (t), V_local);
+#endif
 
 		if (dP_dFe) constitutive_model.Isotropic_Stress_Derivative (Fe_hat (t), (*dP_dFe) (t), t);
 
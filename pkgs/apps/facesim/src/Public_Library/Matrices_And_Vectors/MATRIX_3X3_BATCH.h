@@ -0,0 +1,228 @@
+//#####################################################################
+// This file is part of PhysBAM whose distribution is governed by the license contained in the accompanying file PHYSBAM_COPYRIGHT.txt.
+//#####################################################################
+// Class MATRIX_3X3_BATCH
+//#####################################################################
+// Singular value decompositions of several 3x3 matrices at once, one matrix per SIMD lane. Same conventions as
+// MATRIX_3X3::Fast_Singular_Value_Decomposition: U and V rotations, singular values sorted, smallest one possibly negative.
+// A fixed number of cyclic Jacobi sweeps diagonalizes A^T*A, the columns of A*V are sorted by magnitude and a Givens QR
+// factorization of A*V gives U and the singular values. There are no branches per lane, the only data dependent branch
+// sends nearly singular matrices to the scalar decomposition, which handles their degenerate cases.
+//#####################################################################
+#ifndef __MATRIX_3X3_BATCH__
+#define __MATRIX_3X3_BATCH__
+
+#include <limits>
+#include "MATRIX_3X3.h"
+#include "DIAGONAL_MATRIX_3X3.h"
+
+#ifndef MATRIX_3X3_BATCH_WIDTH // float lanes in one hardware vector, types of other sizes use the same number of bytes
+#if defined(__AVX512F__)
+#define MATRIX_3X3_BATCH_WIDTH 16
+#elif defined(__AVX__)
+#define MATRIX_3X3_BATCH_WIDTH 8
+#else
+#define MATRIX_3X3_BATCH_WIDTH 4
+#endif
+#endif
+
+namespace PhysBAM
+{
+
+template<class T> struct MATRIX_3X3_BATCH_INTEGER;
+template<> struct MATRIX_3X3_BATCH_INTEGER<float>
+{
+	typedef int TYPE;
+	static const TYPE rsqrt_magic = 0x5f3759df;
+	static const int jacobi_sweeps = 4, newton_steps = 3;
+};
+template<> struct MATRIX_3X3_BATCH_INTEGER<double>
+{
+	typedef long long TYPE;
+	static const TYPE rsqrt_magic = 0x5fe6eb50c7b537a9LL;
+	static const int jacobi_sweeps = 6, newton_steps = 5;
+};
+
+template<class T, int width = MATRIX_3X3_BATCH_WIDTH * sizeof (float) / sizeof (T)>
+class MATRIX_3X3_BATCH
+{
+public:
+	typedef T LANES __attribute__ ( (vector_size (width * sizeof (T))));
+	typedef typename MATRIX_3X3_BATCH_INTEGER<T>::TYPE INTEGER_LANES __attribute__ ( (vector_size (width * sizeof (T))));
+
+	// decomposes A(i) for i=0,...,n-1 with n<=width
+	static void Fast_Singular_Value_Decomposition (const MATRIX_3X3<T>* const A[], MATRIX_3X3<T>* const U[], DIAGONAL_MATRIX_3X3<T>* const singular_values[], MATRIX_3X3<T>* const V[],
+			const int n, const T tolerance = (T) 1e-7)
+	{
+		assert (n >= 1 && n <= width);
+		LANES a[9], u[9], v[9], s11, s21, s31, s22, s32, s33;
+		int i, k;
+
+		for (i = 0; i < width; i++)
+		{
+			const MATRIX_3X3<T>& A_i = *A[i < n ? i : 0];
+
+			for (k = 0; k < 9; k++) a[k][i] = A_i.x[k];
+		}
+
+		Set_Identity (v);
+		Set_Identity (u);
+		// S=A^T*A, column major: a[0..2] is the first column
+		s11 = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+		s21 = a[3] * a[0] + a[4] * a[1] + a[5] * a[2];
+		s31 = a[6] * a[0] + a[7] * a[1] + a[8] * a[2];
+		s22 = a[3] * a[3] + a[4] * a[4] + a[5] * a[5];
+		s32 = a[6] * a[3] + a[7] * a[4] + a[8] * a[5];
+		s33 = a[6] * a[6] + a[7] * a[7] + a[8] * a[8];
+
+		for (int sweep = 1; sweep <= MATRIX_3X3_BATCH_INTEGER<T>::jacobi_sweeps; sweep++)
+		{
+			Jacobi_Rotation (s11, s21, s22, s31, s32, v[0], v[1], v[2], v[3], v[4], v[5]);
+			Jacobi_Rotation (s11, s31, s33, s21, s32, v[0], v[1], v[2], v[6], v[7], v[8]);
+			Jacobi_Rotation (s22, s32, s33, s21, s31, v[3], v[4], v[5], v[6], v[7], v[8]);
+		}
+
+		// B=A*V, stored in a
+		LANES b[9];
+
+		for (k = 0; k < 3; k++) for (i = 0; i < 3; i++) b[3 * k + i] = a[i] * v[3 * k] + a[3 + i] * v[3 * k + 1] + a[6 + i] * v[3 * k + 2];
+
+		LANES rho1 = b[0] * b[0] + b[1] * b[1] + b[2] * b[2], rho2 = b[3] * b[3] + b[4] * b[4] + b[5] * b[5], rho3 = b[6] * b[6] + b[7] * b[7] + b[8] * b[8];
+		Conditional_Swap (rho1, rho2, b, v, 0, 1);
+		Conditional_Swap (rho1, rho3, b, v, 0, 2);
+		Conditional_Swap (rho2, rho3, b, v, 1, 2);
+
+		// QR factorization B=U*R by Givens rotations, R is diagonal up to roundoff since the columns of B are orthogonal
+		Givens_Rotation (b, u, 0, 1);
+		Givens_Rotation (b, u, 0, 2);
+		Givens_Rotation (b, u, 1, 2);
+
+		for (i = 0; i < n; i++)
+		{
+			if (rho3[i] <= tolerance * rho1[i]) // nearly singular, same threshold on the eigenvalues of A^T*A as the scalar decomposition
+			{
+				A[i]->Fast_Singular_Value_Decomposition (*U[i], *singular_values[i], *V[i]);
+				continue;
+			}
+
+			for (k = 0; k < 9; k++)
+			{
+				U[i]->x[k] = u[k][i];
+				V[i]->x[k] = v[k][i];
+			}
+
+			*singular_values[i] = DIAGONAL_MATRIX_3X3<T> (b[0][i], b[4][i], b[8][i]);
+		}
+	}
+
+private:
+	static void Set_Identity (LANES m[9])
+	{
+		for (int k = 0; k < 9; k++) m[k] = Splat (k % 4 == 0 ? (T) 1 : (T) 0);
+	}
+
+	static inline LANES Splat (const T x)
+	{
+		return LANES() + x; // broadcast
+	}
+
+	static inline LANES Select (const INTEGER_LANES& mask, const LANES& x, const LANES& y)
+	{
+		return (LANES) ( ( (INTEGER_LANES) x & mask) | ( (INTEGER_LANES) y & ~mask));
+	}
+
+	static inline LANES Abs (const LANES& x)
+	{
+		return (LANES) ( (INTEGER_LANES) x & ~ (INTEGER_LANES) - Splat (0)); // -0 has only the sign bit set
+	}
+
+	// 1/sqrt(x) for normalized x>0, initial guess from the exponent bits refined by Newton steps
+	static inline LANES Reciprocal_Sqrt (const LANES& x, const int newton_steps = MATRIX_3X3_BATCH_INTEGER<T>::newton_steps)
+	{
+		INTEGER_LANES magic = (INTEGER_LANES) Splat (0) + MATRIX_3X3_BATCH_INTEGER<T>::rsqrt_magic;
+		LANES y = (LANES) (magic - ( (INTEGER_LANES) x >> 1)), half_x = Splat ( (T).5) * x;
+
+		for (int k = 0; k < newton_steps; k++) y = y * (Splat ( (T) 1.5) - half_x * y * y);
+
+		return y;
+	}
+
+	// rotation in the pq plane reducing apq, with the other two entries arp, arq of the rotated rows and the rotated columns of V.
+	// With h=aqq-app, g=2*apq and d=|h|+sqrt(h^2+g^2) the exact Jacobi rotation is c=d/sqrt(d^2+g^2), s=sign(h)*g/sqrt(d^2+g^2).
+	// Only the normalization of c and s needs to be accurate, an approximate d just slows down convergence a little.
+	static inline void Jacobi_Rotation (LANES& app, LANES& apq, LANES& aqq, LANES& arp, LANES& arq, LANES& v1p, LANES& v2p, LANES& v3p, LANES& v1q, LANES& v2q, LANES& v3q)
+	{
+		LANES h = aqq - app, g = apq + apq;
+		LANES q = h * h + g * g;
+		q = Select (q > Splat (std::numeric_limits<T>::min()), q, Splat (1));
+		LANES d = Abs (h) + q * Reciprocal_Sqrt (q, 1);
+		LANES m = Reciprocal_Sqrt (d * d + g * g);
+		LANES c = d * m, s = g * m;
+		s = Select (h < Splat (0), -s, s);
+		LANES cc = c * c, ss = s * s, cs = c * s, cs2 = cs * g;
+		LANES x = app, y = aqq;
+		app = cc * x + ss * y - cs2;
+		aqq = ss * x + cc * y + cs2;
+		apq = (cc - ss) * apq - cs * h; // zero up to the error of d
+		x = arp;
+		y = arq;
+		arp = c * x - s * y;
+		arq = s * x + c * y;
+		x = v1p;
+		y = v1q;
+		v1p = c * x - s * y;
+		v1q = s * x + c * y;
+		x = v2p;
+		y = v2q;
+		v2p = c * x - s * y;
+		v2q = s * x + c * y;
+		x = v3p;
+		y = v3q;
+		v3p = c * x - s * y;
+		v3q = s * x + c * y;
+	}
+
+	// orders columns p<q of B by decreasing magnitude, negating one of them keeps V a rotation
+	static inline void Conditional_Swap (LANES& rho_p, LANES& rho_q, LANES b[9], LANES v[9], const int p, const int q)
+	{
+		INTEGER_LANES swap = rho_p < rho_q;
+		LANES x = rho_p;
+		rho_p = Select (swap, rho_q, rho_p);
+		rho_q = Select (swap, x, rho_q);
+
+		for (int i = 0; i < 3; i++)
+		{
+			x = b[3 * p + i];
+			b[3 * p + i] = Select (swap, b[3 * q + i], x);
+			b[3 * q + i] = Select (swap, -x, b[3 * q + i]);
+			x = v[3 * p + i];
+			v[3 * p + i] = Select (swap, v[3 * q + i], x);
+			v[3 * q + i] = Select (swap, -x, v[3 * q + i]);
+		}
+	}
+
+	// zeroes entry (q,p) of B with a rotation of rows p and q, accumulated into the columns of U
+	static inline void Givens_Rotation (LANES b[9], LANES u[9], const int p, const int q)
+	{
+		LANES bpp = b[3 * p + p], bqp = b[3 * p + q];
+		LANES r2 = bpp * bpp + bqp * bqp;
+		INTEGER_LANES rotate = r2 > Splat (std::numeric_limits<T>::min());
+		LANES one_over_r = Reciprocal_Sqrt (Select (rotate, r2, Splat (1)));
+		LANES c = Select (rotate, bpp * one_over_r, Splat (1)), s = Select (rotate, bqp * one_over_r, Splat (0));
+		LANES x, y;
+
+		for (int k = 0; k < 3; k++)
+		{
+			x = b[3 * k + p];
+			y = b[3 * k + q];
+			b[3 * k + p] = c * x + s * y;
+			b[3 * k + q] = c * y - s * x;
+			x = u[3 * p + k];
+			y = u[3 * q + k];
+			u[3 * p + k] = c * x + s * y;
+			u[3 * q + k] = c * y - s * x;
+		}
+	}
+};
+}
+#endif
@@ -16,9 +16,10 @@ class DEFORMABLE_BODY_PARAMETERS
 public:
 	bool write;
 	bool print_diagnostics, print_residuals;
+	bool print_cg_iterations; // residual and time of every conjugate gradient iteration
 
 	DEFORMABLE_BODY_PARAMETERS()
-		: write (true), print_diagnostics (true), print_residuals (false)
+		: write (true), print_diagnostics (true), print_residuals (false), print_cg_iterations (false)
 	{}
 
 	virtual ~DEFORMABLE_BODY_PARAMETERS()
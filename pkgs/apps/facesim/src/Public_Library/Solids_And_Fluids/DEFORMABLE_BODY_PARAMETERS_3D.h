@@ -18,6 +18,7 @@ class DEFORMABLE_BODY_PARAMETERS_3D: public DEFORMABLE_BODY_PARAMETERS<T>
 public:
 	using DEFORMABLE_BODY_PARAMETERS<T>::print_diagnostics;
 	using DEFORMABLE_BODY_PARAMETERS<T>::print_residuals;
+	using DEFORMABLE_BODY_PARAMETERS<T>::print_cg_iterations;
 
 	DEFORMABLE_OBJECT_LIST_3D<T> list;
 
@@ -34,6 +35,7 @@ public:
 	{
 		list.Print_Diagnostics (print_diagnostics);
 		list.Print_Residuals (print_residuals);
+		list.Print_CG_Iterations (print_cg_iterations);
 		list.Set_CFL_Number (cfl);
 	}
 //#####################################################################
@@ -9,6 +9,9 @@
 
 #ifdef ENABLE_PTHREADS
 #include "alamere.h"
+#include <sched.h>
+#include <dirent.h>
+#include <ctype.h>
 pthread_t _M4_threadsTable[MAX_THREADS];
 int _M4_threadsTableAllocated[MAX_THREADS];
 pthread_mutexattr_t _M4_normalMutexAttr;
@@ -21,6 +24,7 @@ static volatile long          numThreads, numTaskQs, threadsPerTaskQ, maxTasks;
 static volatile int           nextQ = 0;  // Just a hint. Not protected by locks.
 static volatile int           parallelRegion = 0;
 static volatile int           noMoreTasks = 0;
+static int                    timeTasks = 0;  // Measure busy time, set by TASKQ_STATS
 
 #if defined( TASKQ_DIST_GRID)
 #include "taskQDistGrid.h"
@@ -28,6 +32,8 @@ static volatile int           noMoreTasks = 0;
 #include "taskQDistList.h"
 #elif defined( TASKQ_DIST_FIXED)
 #include "taskQDistFixed.h"
+#elif defined( TASKQ_DIST_DEQUE)
+#include "taskQDistDeque.h"
 #else
 #error "Missing Definition"
 #endif
@@ -42,17 +48,47 @@ typedef struct {
     char                   padding2[CACHE_LINE_SIZE];
 } TaskQ;
 
+// A parallel region starts when the main thread increments region and ends
+// when no tasks are pending and all the other threads have left it. Idle
+// threads spin for a while, then yield and finally sleep on taskAvail.
 typedef struct {
 #ifdef ENABLE_PTHREADS
     pthread_mutex_t lock;
     pthread_cond_t taskAvail;
-    pthread_cond_t tasksDone;
 #endif //ENABLE_PTHREADS
-    volatile long         threadCount;
+    volatile long         region;       // Number of parallel regions started so far
+    char                  padding1[CACHE_LINE_SIZE];
+    volatile long         pending;      // Tasks enqueued but not executed yet
+    char                  padding2[CACHE_LINE_SIZE];
+    volatile long         active;       // Other threads still in the current region
+    volatile long         sleeping;     // Threads waiting on taskAvail
+    volatile long         started;      // Threads which have been started
 } Sync;
 
+#define SPIN_PAUSES    4096             // Spins before an idle thread starts yielding
+#define SPIN_YIELDS    256              // Yields before an idle thread goes to sleep
+
+// Per thread counters, printed by taskQPrnStats
+typedef struct {
+    long                  tasks;        // Tasks executed
+    long                  busyNsecs;    // Time spent executing tasks, only measured with TASKQ_STATS
+    long                  steals;       // Successful steals
+    long                  stolen;       // Tasks moved by steals
+    long                  failedSteals; // Passes over all other queues without finding a task
+    long                  sleeps;       // Times the thread went to sleep between regions
+    int                   node;         // NUMA node the thread started on
+    char                  padding[CACHE_LINE_SIZE];
+} ThreadStats;
+
 TaskQ *taskQs;
 Sync  sync;
+ThreadStats threadStats[MAX_THREADS];
+
+// Grid tiles are split among the queues in this order, which keeps the
+// queues of a NUMA node together so neighboring tiles stay on one node.
+// Every queue first steals from the queues of its own node.
+static int queueOrder[MAX_THREADS];
+static int *victims;                    // numTaskQs-1 victims for every queue
 
 #define MAX_STEAL 8
 static inline int calculateNumSteal( int available) {
@@ -66,124 +102,243 @@ static inline int calculateNumSteal( int available) {
 #include "taskQDistList.c"
 #elif defined( TASKQ_DIST_FIXED)
 #include "taskQDistFixed.c"
+#elif defined( TASKQ_DIST_DEQUE)
+#include "taskQDistDeque.c"
 #else
 #error "Missing Definition"
 #endif
 
-static void waitForTasks( void) {
+static inline void cpuRelax( void) {
+#if defined( __i386__) || defined( __x86_64__)
+    __asm__ volatile ( "pause" ::: "memory");
+#endif
+}
+
+static inline long nsecsNow( void) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Spin, yield and then sleep until the main thread starts a new region
+static void waitForTasks( long myThreadId, long seen) {
+    int i;
+
     TRACE;
+    for ( i = 0; i < SPIN_PAUSES; i++) {
+        if ( __atomic_load_n( &sync.region, __ATOMIC_ACQUIRE) != seen)    return;
+        cpuRelax();
+    }
 #ifdef ENABLE_PTHREADS
+    for ( i = 0; i < SPIN_YIELDS; i++) {
+        if ( __atomic_load_n( &sync.region, __ATOMIC_ACQUIRE) != seen)    return;
+        sched_yield();
+    }
     pthread_mutex_lock(&(sync.lock));;
-    sync.threadCount++;
-    if ( sync.threadCount == numThreads)
-        pthread_cond_broadcast(&sync.tasksDone);;
-    pthread_cond_wait(&sync.taskAvail,&sync.lock);  pthread_mutex_unlock(&sync.lock);;
-#else
-    sync.threadCount++;
+    __atomic_add_fetch( &sync.sleeping, 1, __ATOMIC_SEQ_CST);
+    while ( __atomic_load_n( &sync.region, __ATOMIC_SEQ_CST) == seen) {
+        threadStats[myThreadId].sleeps++;
+        pthread_cond_wait(&sync.taskAvail,&sync.lock);
+    }
+    __atomic_sub_fetch( &sync.sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&(sync.lock));;
 #endif //ENABLE_PTHREADS
     TRACE;
 }
 
+// Start a new region, only the main thread calls this
 static void signalTasks( void) {
     TRACE;
-    if ( sync.threadCount == 0)    return;    // Unsafe
+    __atomic_store_n( &sync.active, numThreads-1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch( &sync.region, 1, __ATOMIC_SEQ_CST);
 #ifdef ENABLE_PTHREADS
-    pthread_mutex_lock(&(sync.lock));;
-    sync.threadCount = 0;
-    pthread_cond_broadcast(&sync.taskAvail);;
-    pthread_cond_broadcast(&sync.tasksDone);;
-    pthread_mutex_unlock(&(sync.lock));;    
-#else
-    sync.threadCount = 0;
+    if ( __atomic_load_n( &sync.sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&(sync.lock));;
+        pthread_cond_broadcast(&sync.taskAvail);;
+        pthread_mutex_unlock(&(sync.lock));;
+    }
 #endif //ENABLE_PTHREADS
     TRACE;
 }
 
-static int waitForEnd( void) {
-    int done;
+// Wait until all the other threads have left the region, so the main thread
+// owns all queues again
+static void waitForEnd( void) {
+    int i = 0;
+
     TRACE;
+    while ( __atomic_load_n( &sync.active, __ATOMIC_ACQUIRE) != 0) {
+        if ( ++i < SPIN_PAUSES)    cpuRelax();
 #ifdef ENABLE_PTHREADS
-    pthread_mutex_lock(&(sync.lock));;
-    sync.threadCount++;
-    if ( sync.threadCount != numThreads)
-        pthread_cond_wait(&sync.tasksDone,&sync.lock);;
-    done = (sync.threadCount == numThreads);
-    pthread_mutex_unlock(&(sync.lock));;
-#else
-    sync.threadCount++;
-    done = (sync.threadCount == numThreads);
+        else    sched_yield();
 #endif //ENABLE_PTHREADS
+    }
     TRACE;
-
-    return done;
 }
 
 static int doOwnTasks( long myThreadId, long myQ) {
     void *task[NUM_FIELDS];
+    ThreadStats *stats = &threadStats[myThreadId];
     int executed = 0;
+    long start = 0;
 
     TRACE;
     while ( getATaskFromHead( &taskQs[myQ], task)) {
+        if ( timeTasks)    start = nsecsNow();
         ( ( TaskQTask3)task[0])( myThreadId, task[1], task[2], task[3]);
-        executed = 1;
+        if ( timeTasks)    stats->busyNsecs += nsecsNow() - start;
+        executed++;
     }
+    stats->tasks += executed;
     TRACE;
     return executed;
 }
 
 static int stealTasks( long myThreadId, long myQ) {
     int i, stolen = 0;
+    int *myVictims = &victims[myQ * ( numTaskQs-1)];
 
     TRACE;
-    i = myQ + 1;
-    while ( 1 ) {
-        if ( i == numTaskQs)    i = 0;
-        if ( i == myQ)    break;
-
-        stolen = stealTasksSpecialized( &taskQs[myQ], &taskQs[i]);
+    for ( i = 0; i < numTaskQs-1; i++) {
+        stolen = stealTasksSpecialized( &taskQs[myQ], &taskQs[myVictims[i]]);
         if( stolen) {
+            threadStats[myThreadId].steals++;
+            threadStats[myThreadId].stolen += stolen;
             IF_STATS(  {
 #ifdef ENABLE_PTHREADS
                 pthread_mutex_lock(&(taskQs[myQ].lock));;
-                taskQs[myQ].statStolen[i] += stolen;
+                taskQs[myQ].statStolen[myVictims[i]] += stolen;
                 pthread_mutex_unlock(&(taskQs[myQ].lock));;
 #else
-                taskQs[myQ].statStolen[i] += stolen;
+                taskQs[myQ].statStolen[myVictims[i]] += stolen;
 #endif //ENABLE_PTHREADS
             });
             break;
-        } else {
-            i++;
         }
     }
+    if ( !stolen && numTaskQs > 1)    threadStats[myThreadId].failedSteals++;
     TRACE;
     return stolen;
 }
 
+// Execute and steal tasks until no task is pending anymore
+static void runTasks( long myThreadId, long myQ) {
+    int executed, backoff = 1, i;
+
+    while ( 1) {
+        executed = doOwnTasks( myThreadId, myQ);
+        if ( executed)    __atomic_sub_fetch( &sync.pending, executed, __ATOMIC_RELEASE);
+        if ( stealTasks( myThreadId, myQ)) {
+            backoff = 1;
+            continue;
+        }
+        if ( __atomic_load_n( &sync.pending, __ATOMIC_ACQUIRE) == 0)    break;
+        // Others are still executing tasks which may enqueue new ones
+        for ( i = 0; i < backoff; i++)    cpuRelax();
+        if ( backoff < SPIN_PAUSES)    backoff *= 2;
+#ifdef ENABLE_PTHREADS
+        else    sched_yield();
+#endif //ENABLE_PTHREADS
+    }
+}
+
+#ifdef ENABLE_PTHREADS
+// The NUMA node of a CPU, 0 if it's unknown
+static int cpuNode( int cpu) {
+    char path[64];
+    DIR *dir;
+    struct dirent *entry;
+    int node = 0;
+
+    if ( cpu < 0)    return 0;
+    snprintf( path, sizeof( path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir( path);
+    if ( dir == NULL)    return 0;
+    while ( ( entry = readdir( dir)) != NULL) {
+        if ( strncmp( entry->d_name, "node", 4) == 0 && isdigit( entry->d_name[4])) {
+            node = atoi( entry->d_name+4);
+            break;
+        }
+    }
+    closedir( dir);
+    return node;
+}
+
+// With TASKQ_BIND set in the environment, thread i is bound to the i-th CPU
+// the process may run on
+static void bindThread( long myThreadId) {
+    cpu_set_t allowed, cpus;
+    int cpu, n;
+
+    if ( getenv( "TASKQ_BIND") == NULL)    return;
+    if ( sched_getaffinity( 0, sizeof( allowed), &allowed) != 0 || CPU_COUNT( &allowed) == 0)    return;
+    n = myThreadId % CPU_COUNT( &allowed);
+    for ( cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if ( CPU_ISSET( cpu, &allowed) && n-- == 0)    break;
+    CPU_ZERO( &cpus);
+    CPU_SET( cpu, &cpus);
+    pthread_setaffinity_np( pthread_self(), sizeof( cpus), &cpus);
+}
+#endif //ENABLE_PTHREADS
+
+static void threadStarted( long myThreadId) {
+#ifdef ENABLE_PTHREADS
+    bindThread( myThreadId);
+    threadStats[myThreadId].node = cpuNode( sched_getcpu());
+#else
+    threadStats[myThreadId].node = 0;
+#endif //ENABLE_PTHREADS
+    __atomic_add_fetch( &sync.started, 1, __ATOMIC_RELEASE);
+}
+
+// Order the queues by NUMA node and list the victims of every queue, those
+// on the same node first, each group in ring order starting after the queue
+static void initQueueOrder( void) {
+    int i, j, k, n = 0;
+    int node[MAX_THREADS];
+
+    for ( i = 0; i < numTaskQs; i++)    node[i] = threadStats[i * threadsPerTaskQ].node;
+    for ( i = 0; i < numTaskQs; i++) {
+        for ( j = 0; j < i; j++)    if ( node[j] == node[i])    break;
+        if ( j < i)    continue; // Node already done
+        for ( j = i; j < numTaskQs; j++)    if ( node[j] == node[i])    queueOrder[n++] = j;
+    }
+    DEBUG_ASSERT( n == numTaskQs);
+
+    victims = ( int *)malloc( sizeof( int) * numTaskQs * ( numTaskQs > 1 ? numTaskQs-1 : 1));
+    for ( i = 0; i < numTaskQs; i++) {
+        n = 0;
+        for ( k = 1; k < numTaskQs; k++) {
+            j = ( i+k) % numTaskQs;
+            if ( node[j] == node[i])    victims[i * ( numTaskQs-1) + n++] = j;
+        }
+        for ( k = 1; k < numTaskQs; k++) {
+            j = ( i+k) % numTaskQs;
+            if ( node[j] != node[i])    victims[i * ( numTaskQs-1) + n++] = j;
+        }
+    }
+}
+
 static void *taskQIdleLoop( void *arg) {
     long index = ( long)arg;
     long myQ = index / threadsPerTaskQ;
-    int i = 0;
-    int stolen;
+    long seen = 0;
 
+    threadStarted( index);
     while ( 1 ) {
-        waitForTasks();
+        waitForTasks( index, seen);
+        seen = __atomic_load_n( &sync.region, __ATOMIC_ACQUIRE);
         if ( noMoreTasks)    return 0;
-        doOwnTasks( index, myQ);
-        while ( 1) {
-            stolen = stealTasks( index, myQ);
-            if ( stolen)
-                doOwnTasks( index, myQ);
-            else
-                break;
-        }
-        i++;
+        runTasks( index, myQ);
+        __atomic_sub_fetch( &sync.active, 1, __ATOMIC_RELEASE);
     }
 }
 
 void taskQInit( int numOfThreads, int maxNumOfTasks) {
     int i;
 
+    timeTasks = ( getenv( "TASKQ_STATS") != NULL);
+
 #ifdef ENABLE_PTHREADS    
     ALAMERE_INIT(numOfThreads);
     ALAMERE_AFTER_CHECKPOINT();
@@ -201,7 +356,11 @@ void taskQInit( int numOfThreads, int maxNumOfTasks) {
     maxTasks = maxNumOfTasks;
     numThreads = numOfThreads;
     threadsPerTaskQ = taskQGetParam( TaskQThreadsPerQueue);
+#ifdef TASKQ_ONE_THREAD_PER_QUEUE
+    threadsPerTaskQ = 1;
+#endif
     DEBUG_ASSERT( ( numThreads >= 1) && ( threadsPerTaskQ >= 1));
+    TQ_ASSERT( numThreads <= MAX_THREADS);
 
     numTaskQs = (numOfThreads+threadsPerTaskQ-1)/threadsPerTaskQ;
 
@@ -210,8 +369,7 @@ void taskQInit( int numOfThreads, int maxNumOfTasks) {
             VERSION,  numThreads, numTaskQs);
     printf( "\t##### \t\t\t\t\t\t[ built on %s at %s ]  #####\n\n", __DATE__, __TIME__);
     printf( "\t\t TaskQ mutex address                 :  %ld\n", ( long)&sync.lock);
-    printf( "\t\t TaskQ condition variable 1 address  :  %ld\n", ( long)&sync.taskAvail);
-    printf( "\t\t TaskQ condition variable 2 address  :  %ld\n", ( long)&sync.tasksDone);
+    printf( "\t\t TaskQ condition variable address    :  %ld\n", ( long)&sync.taskAvail);
     printf( "\n\n");
     */
     DEBUG_ANNOUNCE;
@@ -230,10 +388,14 @@ void taskQInit( int numOfThreads, int maxNumOfTasks) {
 #ifdef ENABLE_PTHREADS
     pthread_mutex_init(&(sync.lock), NULL);;
     pthread_cond_init(&sync.taskAvail,NULL);;
-    pthread_cond_init(&sync.tasksDone,NULL);;
 #endif //ENABLE_PTHREADS
-    sync.threadCount = 0;
+    sync.region = 0;
+    sync.pending = 0;
+    sync.active = 0;
+    sync.sleeping = 0;
+    sync.started = 0;
 
+    threadStarted( 0);
 #ifdef ENABLE_PTHREADS
     for ( i = 1; i < numThreads; i++)
     {
@@ -244,10 +406,11 @@ void taskQInit( int numOfThreads, int maxNumOfTasks) {
         pthread_create(&_M4_threadsTable[_M4_i],NULL,(void *(*)(void *))taskQIdleLoop,(void *)( long)i);
         _M4_threadsTableAllocated[_M4_i] = 1;
     }
+    while ( __atomic_load_n( &sync.started, __ATOMIC_ACQUIRE) != numThreads)    sched_yield();
 #endif //ENABLE_PTHREADS
 ;
 
-    waitForEnd();
+    initQueueOrder();
 }
 
 static inline int pickQueue( int threadId) { // Needs work
@@ -259,20 +422,27 @@ static inline int pickQueue( int threadId) { // Needs work
     return q;
 }
 
+static void assignTasksOrdered( TaskQTask3 taskFn, int numDimensions, int queueNo, 
+                                long min[MAX_DIMENSION], long max[MAX_DIMENSION], long step[MAX_DIMENSION]) {
+    assignTasks( taskFn, numDimensions, queueOrder[queueNo], min, max, step);
+}
+
 void taskQEnqueueGrid( TaskQTask taskFunction, TaskQThreadId threadId, long numOfDimensions, 
                        long dimensionSize[MAX_DIMENSION], long tileSize[MAX_DIMENSION]) { 
     taskQEnqueueGridSpecialized( ( TaskQTask3)taskFunction, threadId, numOfDimensions, tileSize);
-    enqueueGridHelper( assignTasks, ( TaskQTask3)taskFunction, numOfDimensions, numTaskQs, dimensionSize, tileSize); 
-    if ( parallelRegion)    signalTasks();
+    __atomic_add_fetch( &sync.pending, countTasks( numOfDimensions, dimensionSize, tileSize), __ATOMIC_RELAXED);
+    enqueueGridHelper( assignTasksOrdered, ( TaskQTask3)taskFunction, numOfDimensions, numTaskQs, dimensionSize, tileSize); 
 }
 
 
+// Tasks enqueued within a parallel region are picked up by the threads still
+// in it, the enqueuing task keeps the region from ending before
 static inline void taskQEnqueueTaskHelper( int threadId, void *task[NUM_FIELDS]) {
     TRACE;
     int queueNo = pickQueue( threadId);
     // if ( !parallelRegion)  printf( "%30ld %20ld\n", ( long)task[1], ( long)queueNo);
+    __atomic_add_fetch( &sync.pending, 1, __ATOMIC_RELAXED);
     taskQEnqueueTaskSpecialized( &taskQs[queueNo], task);
-    if ( parallelRegion)    signalTasks();
 }
 
 void taskQEnqueueTask1( TaskQTask1 taskFunction, TaskQThreadId threadId, void *arg1) {
@@ -297,20 +467,17 @@ void taskQEnqueueTask3( TaskQTask3 taskFunction, TaskQThreadId threadId, void *a
 }
 
 void taskQWait( void) {
-    static int i = 0;
-    int done;
     parallelRegion = 1;
     signalTasks();
     TRACE;
-    do {
-        doOwnTasks( 0, 0);
-        stealTasks( 0, 0);
-        doOwnTasks( 0, 0);
-        done = waitForEnd();
-    } while (!done);
+    runTasks( 0, 0);
+    waitForEnd();
     parallelRegion = 0;
     TRACE;
-    i++;
+}
+
+int taskQPendingTasksHint( void) {
+    return ( int)__atomic_load_n( &sync.pending, __ATOMIC_RELAXED);
 }
 
 void taskQResetStats() {
@@ -324,6 +491,32 @@ void taskQResetStats() {
             }
         }
     });
+    {
+        int i;
+        for ( i = 0; i < numThreads; i++) {
+            int node = threadStats[i].node;
+            memset( &threadStats[i], 0, sizeof( ThreadStats));
+            threadStats[i].node = node;
+        }
+    }
+}
+
+static void prnThreadStats( void) {
+    long i, tasks = 0, steals = 0, stolen = 0;
+    double busy = 0;
+
+    printf( "\n\n\t#####  Thread statistics of TaskQ version Distributed %s #####\n\n", VERSION);
+    printf( "\t\t%-6s %-4s %10s %12s %8s %10s %12s %8s\n\n", "Thread", "Node", "Tasks", "Busy (s)", "Steals", "Stolen", "Failed", "Sleeps");
+    for ( i = 0; i < numThreads; i++) {
+        ThreadStats *t = &threadStats[i];
+        printf( "\t\t%6ld %4d %10ld %12.4f %8ld %10ld %12ld %8ld\n", i, t->node, t->tasks, t->busyNsecs * 1e-9,
+                t->steals, t->stolen, t->failedSteals, t->sleeps);
+        tasks += t->tasks;
+        steals += t->steals;
+        stolen += t->stolen;
+        busy += t->busyNsecs * 1e-9;
+    }
+    printf( "\t\t%6s %4s %10ld %12.4f %8ld %10ld\n\n", "Total", "", tasks, busy, steals, stolen);
 }
 
 void taskQPrnStats() {
@@ -353,9 +546,12 @@ void taskQPrnStats() {
         }
         printf( "\n\n");
     });
+    prnThreadStats();
 }
 
+// With TASKQ_STATS set in the environment the thread statistics are printed at the end
 void taskQEnd( void) {
+    if ( timeTasks)    prnThreadStats();
     noMoreTasks = 1;
     signalTasks();
 
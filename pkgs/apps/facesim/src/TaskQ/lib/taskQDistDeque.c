@@ -0,0 +1,94 @@
+static void initTaskQDetails( TaskQ *t) {
+    t->q.top = t->q.bottom = 0;
+    t->q.size = maxTasks;
+    t->q.array = ( Entry *)malloc( t->q.size * sizeof( Entry));
+}
+
+// Only the owner of the queue may push, or any thread outside of a parallel region
+static inline void pushBottom( TaskQ *t, void *task[NUM_FIELDS]) {
+    long bottom = __atomic_load_n( &t->q.bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n( &t->q.top, __ATOMIC_ACQUIRE);
+
+    TQ_ASSERT( bottom - top < t->q.size);
+    copyArgs( t->q.array[bottom % t->q.size].args, task);
+    __atomic_store_n( &t->q.bottom, bottom+1, __ATOMIC_RELEASE);
+}
+
+// Only the owner of the queue may take tasks from the bottom
+static inline int getATaskFromHead( TaskQ *t, void *task[NUM_FIELDS]) {
+    long bottom = __atomic_load_n( &t->q.bottom, __ATOMIC_RELAXED) - 1;
+    long top;
+    int found = 1;
+
+    __atomic_store_n( &t->q.bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    top = __atomic_load_n( &t->q.top, __ATOMIC_RELAXED);
+    if ( top > bottom) {
+        // Empty
+        __atomic_store_n( &t->q.bottom, bottom+1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    copyArgs( task, t->q.array[bottom % t->q.size].args);
+    if ( top == bottom) {
+        // The last task. Race against the thieves for it
+        found = __atomic_compare_exchange_n( &t->q.top, &top, top+1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n( &t->q.bottom, bottom+1, __ATOMIC_RELAXED);
+    }
+    IF_STATS( if ( found) t->statLocal++);
+    return found;
+}
+
+// Any thread may steal a task from the top
+static inline int stealATask( TaskQ *t, void *task[NUM_FIELDS]) {
+    long top = __atomic_load_n( &t->q.top, __ATOMIC_ACQUIRE);
+    long bottom;
+
+    __atomic_thread_fence( __ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n( &t->q.bottom, __ATOMIC_ACQUIRE);
+    if ( top >= bottom)    return 0;
+    copyArgs( task, t->q.array[top % t->q.size].args);
+    return __atomic_compare_exchange_n( &t->q.top, &top, top+1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static inline int stealTasksSpecialized( TaskQ *myT, TaskQ *srcT) {
+    void *task[NUM_FIELDS];
+    long available = srcT->q.bottom - srcT->q.top; // Quick Check. Unprotected.
+    int toSteal, stolen;
+
+    if ( available <= 0)    return 0;
+    toSteal = calculateNumSteal( ( int)available);
+    for ( stolen = 0; stolen < toSteal; stolen++) {
+        if ( !stealATask( srcT, task))    break;
+        pushBottom( myT, task);
+    }
+    return stolen;
+}
+
+static inline void taskQEnqueueTaskSpecialized( TaskQ *t, void *task[NUM_FIELDS]) {
+    pushBottom( t, task);
+    IF_STATS( t->statEnqueued++);
+}
+
+static inline void assignTasks( TaskQTask3 taskFn, int numDimensions, int queueNo, 
+                                long min[MAX_DIMENSION], long max[MAX_DIMENSION], long step[MAX_DIMENSION]) {
+    TaskQ *t = &taskQs[queueNo];
+    long i, j, k;
+
+    for ( i = min[0]; i < max[0]; i++)
+        for ( j = min[1]; j < max[1]; j++)
+            for ( k = min[2]; k < max[2]; k++) {
+                IF_STATS( t->statEnqueued++);
+                void *task[NUM_FIELDS];
+                task[0] = ( void *)taskFn;
+                task[1] = ( void *)( i * step[0]);
+                task[2] = ( void *)( j * step[1]);
+                task[3] = ( void *)( k * step[2]);
+                pushBottom( t, task);
+            }
+}
+
+static inline void taskQEnqueueGridSpecialized( TaskQTask3 taskFunction, TaskQThreadId threadId, 
+                                                int numOfDimensions, long tileSize[MAX_DIMENSION]) {
+    TQ_ASSERT( MAX_DIMENSION == 3); // assignTasks assumes this
+    TQ_ASSERT( ( threadId == 0) && ( parallelRegion == 0)); // Since we are enqueuing tasks in other threads
+}
@@ -0,0 +1,20 @@
+#ifndef __TASKQ_DISTDEQUE_H__
+#define __TASKQ_DISTDEQUE_H__
+
+#define VERSION "Chase-Lev Deques"
+
+// Every queue is a Chase-Lev work stealing deque. Its owner pushes and takes
+// tasks at the bottom without locks, thieves take tasks from the top with a
+// compare-and-swap. So a queue can't be shared by several threads.
+#define TASKQ_ONE_THREAD_PER_QUEUE
+
+typedef struct
+{
+	volatile long          top;
+	char                   padding[CACHE_LINE_SIZE];
+	volatile long          bottom;
+	long                   size;
+	Entry                  *array;
+} TaskQDetails;
+
+#endif
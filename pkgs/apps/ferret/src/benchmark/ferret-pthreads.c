@@ -60,6 +60,26 @@ int top_K = 10;
 
 char *extra_params = "-L 8 - T 20";
 
+/* the index stage queries BATCH_SIZE images at once with the cache-aware
+ * batch query of LSH, which scans every hash bucket once for all queries
+ * of the batch. RECALL_CHECK > 0 repeats every RECALL_CHECK-th image with
+ * a single query and reports the fraction of its candidates found by the
+ * batch query. */
+int BATCH_SIZE = 1;
+int RECALL_CHECK = 0;
+char batch_params[BUFSIZ];
+
+struct vec_stats
+{
+	pthread_mutex_t mutex;
+	int images, batches;
+	float time;		/* seconds spent in index queries */
+	int checked;		/* candidates of images queried again */
+	int found;		/* how many of them the batch query found */
+};
+
+struct vec_stats vec_stats;
+
 cass_env_t *env;
 cass_table_t *table;
 cass_table_t *query_table;
@@ -112,6 +132,140 @@ struct rank_data
 
 struct queue q_rank_out;
 
+/* the stages of the pipeline, stage_queue[s] is the input queue of stage s */
+enum { STAGE_LOAD, STAGE_SEG, STAGE_EXTRACT, STAGE_VEC, STAGE_RANK, STAGE_OUT, NSTAGE };
+
+const char *stage_name[NSTAGE] = {"load", "seg", "extract", "vec", "rank", "out"};
+struct queue *stage_queue[NSTAGE] = {NULL, &q_load_seg, &q_seg_extract, &q_extract_vec, &q_vec_rank, &q_rank_out};
+int stage_threads[NSTAGE];
+
+/* time spent in a stage, summed over all threads */
+struct stage_stats
+{
+	int items;
+	double busy;		/* seconds spent on items */
+	double wait;		/* seconds spent waiting for input */
+	double blocked;		/* seconds spent waiting for room in the output queue */
+	double queued;		/* sum of the input queue lengths seen before dequeue */
+	int samples;
+};
+
+struct stage_stats stage_stats[NSTAGE];
+struct stage_stats load_stats;	/* only updated by the load thread */
+pthread_mutex_t stats_mutex;
+
+/* with POOL > 0 the stages seg, extract, vec and rank don't have threads
+ * of their own but share a pool of POOL workers. Whenever a worker is
+ * done with an item, the balancer hands it the stage with the most work
+ * queued, i.e. the number of waiting items times the mean service time
+ * of the stage, among the stages whose output queue has room left. The
+ * vec stage waits until a full batch is queued, it only takes fewer items
+ * once its input is closed or when nothing else is left to do and no
+ * worker is busy with seg or extract. Load and out keep their own
+ * threads. */
+int POOL = 0;
+
+struct balancer
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int ready[NSTAGE];	/* items in the input queue not taken by a worker */
+	int fill[NSTAGE];	/* items in the input queue plus room reserved for results */
+	int running[NSTAGE];	/* workers busy with the stage */
+	int closed[NSTAGE];	/* no more items will arrive in the input queue */
+	double service[NSTAGE];	/* seconds spent on the stage */
+	int served[NSTAGE];	/* items done by the stage */
+	int migrations;		/* times a worker switched to another stage */
+	double idle;		/* seconds workers spent waiting for work */
+};
+
+struct balancer balancer;
+
+
+/* ------- The Balancer ------- */
+/* close every stage whose predecessor is done, the caller holds the mutex */
+void balancer_update (void)
+{
+	int s;
+
+	for (s = STAGE_SEG; s <= STAGE_RANK; s++)
+	{
+		if (!balancer.closed[s] || balancer.closed[s + 1]) continue;
+		if (balancer.ready[s] > 0 || balancer.running[s] > 0) continue;
+		balancer.closed[s + 1] = 1;
+		if (s == STAGE_RANK) queue_signal_terminate(&q_rank_out);
+	}
+	pthread_cond_broadcast(&balancer.cond);
+}
+
+/* n items have been put into the input queue of a stage from outside the pool */
+void balancer_put (int stage, int n)
+{
+	pthread_mutex_lock(&balancer.mutex);
+	balancer.ready[stage] += n;
+	pthread_cond_broadcast(&balancer.cond);
+	pthread_mutex_unlock(&balancer.mutex);
+}
+
+/* no more items will be put into the input queue of a stage */
+void balancer_close (int stage)
+{
+	pthread_mutex_lock(&balancer.mutex);
+	balancer.closed[stage] = 1;
+	balancer_update();
+	pthread_mutex_unlock(&balancer.mutex);
+}
+
+/* choose the stage for a worker and the number of items it takes,
+ * returns -1 if no stage can make progress. The caller holds the mutex */
+int balancer_pick (int *n)
+{
+	int s, k, room, full;
+	int best = -1, partial = 0;
+	double mean, score, best_score = 0;
+
+	/* on ties the later stage wins to drain the pipeline */
+	for (s = STAGE_RANK; s >= STAGE_SEG; s--)
+	{
+		if (balancer.ready[s] == 0) continue;
+		k = s == STAGE_VEC ? BATCH_SIZE : 1;
+		if (k > balancer.ready[s]) k = balancer.ready[s];
+		if (s < STAGE_RANK)
+		{
+			/* a queue of size DEPTH holds DEPTH - 1 items */
+			room = DEPTH - 1 - balancer.fill[s + 1];
+			if (room <= 0) continue;
+			if (k > room) k = room;
+		}
+		/* the vec stage waits for a full batch until its input is closed,
+		 * its input queue holds at most DEPTH - 1 items */
+		full = BATCH_SIZE < DEPTH - 1 ? BATCH_SIZE : DEPTH - 1;
+		if (s == STAGE_VEC && balancer.ready[s] < full && !balancer.closed[s])
+		{
+			partial = k;
+			continue;
+		}
+		/* stages which have not been timed yet go first */
+		mean = balancer.served[s] > 0 ? balancer.service[s] / balancer.served[s] : 1e9;
+		score = balancer.ready[s] * mean;
+		if (best < 0 || score > best_score)
+		{
+			best = s;
+			best_score = score;
+			*n = k;
+		}
+	}
+	/* a partial batch only goes when the pool has nothing else to do and
+	 * no worker is producing items for the vec stage */
+	if (best < 0 && partial > 0 && balancer.ready[STAGE_SEG] + balancer.running[STAGE_SEG] +
+		balancer.ready[STAGE_EXTRACT] + balancer.running[STAGE_EXTRACT] == 0)
+	{
+		best = STAGE_VEC;
+		*n = partial;
+	}
+	return best;
+}
+
 
 /* ------- The Helper Functions ------- */
 int cnt_enqueue;
@@ -149,7 +303,9 @@ int file_helper (const char *file)
 {
 	int r;
 	struct load_data *data;
+	stimer_t tmr;
 
+	stimer_tick(&tmr);
 	data = (struct load_data *)malloc(sizeof(struct load_data));
 	assert(data != NULL);
 
@@ -162,9 +318,14 @@ int file_helper (const char *file)
 		r = image_read_rgb(file, &data->width, &data->height, &data->RGB);
 		r = image_read_hsv(file, &data->width, &data->height, &data->HSV);
 		*/
+	load_stats.busy += stimer_tuck(&tmr, NULL);
+	load_stats.items++;
 
 	cnt_enqueue++;
+	stimer_tick(&tmr);
 	enqueue(&q_load_seg, data);
+	load_stats.blocked += stimer_tuck(&tmr, NULL);
+	if (POOL > 0) balancer_put(STAGE_SEG, 1);
 
 	return 0;
 }
@@ -205,6 +366,261 @@ int scan_dir (const char *dir, char *head)
 
 
 /* ------ The Stages ------ */
+
+struct seg_data *do_seg (struct load_data *load)
+{
+	struct seg_data *seg;
+
+	seg = (struct seg_data *)calloc(1, sizeof(struct seg_data));
+
+	seg->name = load->name;
+
+	seg->width = load->width;
+	seg->height = load->height;
+	seg->HSV = load->HSV;
+	image_segment(&seg->mask, &seg->nrgn, load->RGB, load->width, load->height);
+
+	free(load->RGB);
+	free(load);
+
+	return seg;
+}
+
+struct extract_data *do_extract (struct seg_data *seg)
+{
+	struct extract_data *extract;
+
+	extract = (struct extract_data *)calloc(1, sizeof(struct extract_data));
+
+	extract->name = seg->name;
+
+	image_extract_helper(seg->HSV, seg->mask, seg->width, seg->height, seg->nrgn, &extract->ds);
+
+	free(seg->mask);
+	free(seg->HSV);
+	free(seg);
+
+	return extract;
+}
+
+/* query an image again on its own and count how many of the candidates
+ * are also in the result of the batch query */
+void check_recall (cass_query_t *query, cass_result_t *result, int *checked, int *found)
+{
+	cass_query_t single = *query;
+	cass_result_t ref;
+	int i, j, k;
+
+	single.extra_params = extra_params;
+	cass_result_alloc_list(&ref, query->dataset->vecset[0].num_regions, query->topk);
+	cass_table_query(table, &single, &ref);
+
+	for (i = 0; i < ref.u.lists.len; i++)
+	{
+		cass_list_t *r = &ref.u.lists.data[i];
+		cass_list_t *b = &result->u.lists.data[i];
+		for (j = 0; j < r->len; j++)
+		{
+			if (r->data[j].dist == HUGE) continue;
+			(*checked)++;
+			for (k = 0; k < b->len; k++)
+			{
+				if (b->data[k].id == r->data[j].id)
+				{
+					(*found)++;
+					break;
+				}
+			}
+		}
+	}
+
+	cass_result_free(&ref);
+}
+
+/* the queries of a batch of the index stage, every thread has its own */
+struct vec_batch
+{
+	struct vec_query_data **vec;
+	cass_query_t *query;
+	cass_query_t **pquery;
+	cass_result_t **presult;
+	int count;		/* images queried by this thread */
+};
+
+void vec_batch_init (struct vec_batch *b)
+{
+	b->vec = (struct vec_query_data **)malloc(BATCH_SIZE * sizeof(struct vec_query_data *));
+	b->query = (cass_query_t *)malloc(BATCH_SIZE * sizeof(cass_query_t));
+	b->pquery = (cass_query_t **)malloc(BATCH_SIZE * sizeof(cass_query_t *));
+	b->presult = (cass_result_t **)malloc(BATCH_SIZE * sizeof(cass_result_t *));
+	assert(b->vec != NULL && b->query != NULL && b->pquery != NULL && b->presult != NULL);
+	b->count = 0;
+}
+
+void vec_batch_free (struct vec_batch *b)
+{
+	free(b->vec);
+	free(b->query);
+	free(b->pquery);
+	free(b->presult);
+}
+
+/* put an image into slot n of the batch */
+void vec_batch_set (struct vec_batch *b, int n, struct extract_data *extract)
+{
+	struct vec_query_data *vec;
+	cass_query_t *query = &b->query[n];
+
+	vec = b->vec[n] = (struct vec_query_data *)calloc(1, sizeof(struct vec_query_data));
+	vec->name = extract->name;
+
+	memset(query, 0, sizeof *query);
+	query->flags = CASS_RESULT_LISTS | CASS_RESULT_USERMEM;
+
+	vec->ds = query->dataset = &extract->ds;
+	query->vecset_id = 0;
+
+	query->vec_dist_id = vec_dist_id;
+
+	query->vecset_dist_id = vecset_dist_id;
+
+	query->topk = 2*top_K;
+
+	query->extra_params = BATCH_SIZE > 1 ? batch_params : extra_params;
+
+	cass_result_alloc_list(&vec->result, vec->ds->vecset[0].num_regions, query->topk);
+
+	b->pquery[n] = query;
+	b->presult[n] = &vec->result;
+}
+
+/* query the first n images of the batch */
+void do_vec (struct vec_batch *b, int n)
+{
+	stimer_t tmr;
+	float time;
+	int i, checked, found;
+
+	stimer_tick(&tmr);
+	if (BATCH_SIZE > 1) cass_table_batch_query(table, n, b->pquery, b->presult);
+	else cass_table_query(table, &b->query[0], &b->vec[0]->result);
+	time = stimer_tuck(&tmr, NULL);
+
+	checked = found = 0;
+	for (i = 0; i < n; i++)
+	{
+		if (RECALL_CHECK > 0 && (b->count + i) % RECALL_CHECK == 0)
+			check_recall(&b->query[i], &b->vec[i]->result, &checked, &found);
+	}
+	b->count += n;
+
+	pthread_mutex_lock(&vec_stats.mutex);
+	vec_stats.images += n;
+	vec_stats.batches++;
+	vec_stats.time += time;
+	vec_stats.checked += checked;
+	vec_stats.found += found;
+	pthread_mutex_unlock(&vec_stats.mutex);
+}
+
+struct rank_data *do_rank (struct vec_query_data *vec)
+{
+	struct rank_data *rank;
+	cass_result_t *candidate;
+	cass_query_t query;
+
+	rank = (struct rank_data *)calloc(1, sizeof(struct rank_data));
+	rank->name = vec->name;
+
+	query.flags = CASS_RESULT_LIST | CASS_RESULT_USERMEM | CASS_RESULT_SORT;
+	query.dataset = vec->ds;
+	query.vecset_id = 0;
+
+	query.vec_dist_id = vec_dist_id;
+
+	query.vecset_dist_id = vecset_dist_id;
+
+	query.topk = top_K;
+
+	query.extra_params = NULL;
+
+	candidate = cass_result_merge_lists(&vec->result, (cass_dataset_t *)query_table->__private, 0);
+	query.candidate = candidate;
+
+
+	cass_result_alloc_list(&rank->result, 0, top_K);
+	cass_table_query(query_table, &query, &rank->result);
+
+	cass_result_free(&vec->result);
+	cass_result_free(candidate);
+	free(candidate);
+	cass_dataset_release(vec->ds);
+	free(vec->ds);
+	free(vec);
+
+	return rank;
+}
+
+void do_out (struct rank_data *rank)
+{
+	fprintf(fout, "%s", rank->name);
+
+	ARRAY_BEGIN_FOREACH(rank->result.u.list, cass_list_entry_t p)
+	{
+		char *obj = NULL;
+		if (p.dist == HUGE) continue;
+		cass_map_id_to_dataobj(query_table->map, p.id, &obj);
+		assert(obj != NULL);
+		fprintf(fout, "\t%s:%g", obj, p.dist);
+	} ARRAY_END_FOREACH;
+
+	fprintf(fout, "\n");
+
+	cass_result_free(&rank->result);
+	free(rank->name);
+	free(rank);
+
+	cnt_dequeue++;
+	
+	fprintf(stderr, "(%d,%d)\n", cnt_enqueue, cnt_dequeue);
+}
+
+void stage_stats_add (int stage, struct stage_stats *st)
+{
+	pthread_mutex_lock(&stats_mutex);
+	stage_stats[stage].items += st->items;
+	stage_stats[stage].busy += st->busy;
+	stage_stats[stage].wait += st->wait;
+	stage_stats[stage].blocked += st->blocked;
+	stage_stats[stage].queued += st->queued;
+	stage_stats[stage].samples += st->samples;
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+/* wait for the next item of a stage with its own threads */
+int stage_dequeue (int stage, struct stage_stats *st, void **item)
+{
+	stimer_t tmr;
+	int r;
+
+	st->queued += queue_count(stage_queue[stage]);
+	st->samples++;
+	stimer_tick(&tmr);
+	r = dequeue(stage_queue[stage], item);
+	st->wait += stimer_tuck(&tmr, NULL);
+	return r;
+}
+
+/* pass an item on to the next stage */
+void stage_enqueue (int stage, struct stage_stats *st, void *item)
+{
+	stimer_t tmr;
+
+	stimer_tick(&tmr);
+	enqueue(stage_queue[stage + 1], item);
+	st->blocked += stimer_tuck(&tmr, NULL);
+}
+
 void *t_load (void *dummy)
 {
 	const char *dir = (const char *)dummy;
@@ -220,194 +636,271 @@ void *t_load (void *dummy)
 		scan_dir(dir, path);
 	}
 
+	if (POOL > 0) balancer_close(STAGE_SEG);
 	queue_signal_terminate(&q_load_seg);
+	stage_stats_add(STAGE_LOAD, &load_stats);
 	return NULL;
 }
 
 void *t_seg (void *dummy)
 {
+	struct stage_stats st;
 	struct seg_data *seg;
 	struct load_data *load;
+	stimer_t tmr;
 
+	memset(&st, 0, sizeof st);
 	while(1)
 	{
-		if(dequeue(&q_load_seg, &load) < 0)
+		if(stage_dequeue(STAGE_SEG, &st, (void **)&load) < 0)
 		    break;
 		
 		assert(load != NULL);
-		seg = (struct seg_data *)calloc(1, sizeof(struct seg_data));
-
-		seg->name = load->name;
+		stimer_tick(&tmr);
+		seg = do_seg(load);
+		st.busy += stimer_tuck(&tmr, NULL);
+		st.items++;
 
-		seg->width = load->width;
-		seg->height = load->height;
-		seg->HSV = load->HSV;
-		image_segment(&seg->mask, &seg->nrgn, load->RGB, load->width, load->height);
-
-		free(load->RGB);
-		free(load);
-
-		enqueue(&q_seg_extract, seg);
+		stage_enqueue(STAGE_SEG, &st, seg);
 	}
 
 	queue_signal_terminate(&q_seg_extract);
+	stage_stats_add(STAGE_SEG, &st);
 	return NULL;
 
 }
 
 void *t_extract (void *dummy)
 {
+	struct stage_stats st;
 	struct seg_data *seg;
 	struct extract_data *extract;
+	stimer_t tmr;
 
+	memset(&st, 0, sizeof st);
 	while (1)
 	{
-		if(dequeue(&q_seg_extract, &seg) < 0)
+		if(stage_dequeue(STAGE_EXTRACT, &st, (void **)&seg) < 0)
 		    break;
 		
 		assert(seg != NULL);
-		extract = (struct extract_data *)calloc(1, sizeof(struct extract_data));
+		stimer_tick(&tmr);
+		extract = do_extract(seg);
+		st.busy += stimer_tuck(&tmr, NULL);
+		st.items++;
 
-		extract->name = seg->name;
-
-		image_extract_helper(seg->HSV, seg->mask, seg->width, seg->height, seg->nrgn, &extract->ds);
-
-		free(seg->mask);
-		free(seg->HSV);
-		free(seg);
-
-		enqueue(&q_extract_vec, extract);
+		stage_enqueue(STAGE_EXTRACT, &st, extract);
 	}
 
 	queue_signal_terminate(&q_extract_vec);
+	stage_stats_add(STAGE_EXTRACT, &st);
 	return NULL;
 }
 
 void *t_vec (void *dummy)
 {
+	struct stage_stats st;
 	struct extract_data *extract;
-	struct vec_query_data *vec;
-	cass_query_t query;
-	while(1)
-	{
-		if(dequeue(&q_extract_vec, &extract) < 0)
-		    break;
-		
-		assert(extract != NULL);
-		vec = (struct vec_query_data *)calloc(1, sizeof(struct vec_query_data));
-		vec->name = extract->name;
-
-		memset(&query, 0, sizeof query);
-		query.flags = CASS_RESULT_LISTS | CASS_RESULT_USERMEM;
-
-		vec->ds = query.dataset = &extract->ds;
-		query.vecset_id = 0;
-
-		query.vec_dist_id = vec_dist_id;
-
-		query.vecset_dist_id = vecset_dist_id;
-
-		query.topk = 2*top_K;
+	struct vec_batch b;
+	stimer_t tmr;
+	int i, n;
+	int done = 0;
 
-		query.extra_params = extra_params;
+	memset(&st, 0, sizeof st);
+	vec_batch_init(&b);
 
-	    	cass_result_alloc_list(&vec->result, vec->ds->vecset[0].num_regions, query.topk);
+	while(!done)
+	{
+		/* collect a batch, the last one may be smaller */
+		for (n = 0; n < BATCH_SIZE; n++)
+		{
+			if(stage_dequeue(STAGE_VEC, &st, (void **)&extract) < 0)
+			{
+				done = 1;
+				break;
+			}
+
+			assert(extract != NULL);
+			vec_batch_set(&b, n, extract);
+		}
+		if (n == 0) break;
 
-	//	cass_result_alloc_list(&result_m, 0, T1);
-	//	cass_table_query(table, &query, &vec->result);
-		cass_table_query(table, &query, &vec->result);
+		stimer_tick(&tmr);
+		do_vec(&b, n);
+		st.busy += stimer_tuck(&tmr, NULL);
+		st.items += n;
 
-		enqueue(&q_vec_rank, vec);
+		for (i = 0; i < n; i++) stage_enqueue(STAGE_VEC, &st, b.vec[i]);
 	}
 
+	vec_batch_free(&b);
+
 	queue_signal_terminate(&q_vec_rank);
+	stage_stats_add(STAGE_VEC, &st);
 	return NULL;
 }
 
 void *t_rank (void *dummy)
 {
+	struct stage_stats st;
 	struct vec_query_data *vec;
 	struct rank_data *rank;
-	cass_result_t *candidate;
-	cass_query_t query;
+	stimer_t tmr;
+
+	memset(&st, 0, sizeof st);
 	while (1)
 	{
-		if(dequeue(&q_vec_rank, &vec) < 0)
+		if(stage_dequeue(STAGE_RANK, &st, (void **)&vec) < 0)
 		    break;
 		
 		assert(vec != NULL);
+		stimer_tick(&tmr);
+		rank = do_rank(vec);
+		st.busy += stimer_tuck(&tmr, NULL);
+		st.items++;
 
-		rank = (struct rank_data *)calloc(1, sizeof(struct rank_data));
-		rank->name = vec->name;
-
-		query.flags = CASS_RESULT_LIST | CASS_RESULT_USERMEM | CASS_RESULT_SORT;
-		query.dataset = vec->ds;
-		query.vecset_id = 0;
-
-		query.vec_dist_id = vec_dist_id;
-
-		query.vecset_dist_id = vecset_dist_id;
-
-		query.topk = top_K;
-
-		query.extra_params = NULL;
-
-		candidate = cass_result_merge_lists(&vec->result, (cass_dataset_t *)query_table->__private, 0);
-		query.candidate = candidate;
-
-
-		cass_result_alloc_list(&rank->result, 0, top_K);
-		cass_table_query(query_table, &query, &rank->result);
-
-		cass_result_free(&vec->result);
-		cass_result_free(candidate);
-		free(candidate);
-		cass_dataset_release(vec->ds);
-		free(vec->ds);
-		free(vec);
-		enqueue(&q_rank_out, rank);
+		stage_enqueue(STAGE_RANK, &st, rank);
 	}
 
 	queue_signal_terminate(&q_rank_out);
+	stage_stats_add(STAGE_RANK, &st);
 	return NULL;
 }
 
 void *t_out (void *dummy)
 {
+	struct stage_stats st;
 	struct rank_data *rank;
+	stimer_t tmr;
+
+	memset(&st, 0, sizeof st);
 	while (1)
 	{
-		if(dequeue(&q_rank_out, &rank) < 0)
+		if(stage_dequeue(STAGE_OUT, &st, (void **)&rank) < 0)
 		    break;
 		
 		assert(rank != NULL);
+		stimer_tick(&tmr);
+		do_out(rank);
+		st.busy += stimer_tuck(&tmr, NULL);
+		st.items++;
+	}
 
-		fprintf(fout, "%s", rank->name);
+	assert(cnt_enqueue == cnt_dequeue);
+	stage_stats_add(STAGE_OUT, &st);
+	return NULL;
+}
 
-		ARRAY_BEGIN_FOREACH(rank->result.u.list, cass_list_entry_t p)
-		{
-			char *obj = NULL;
-			if (p.dist == HUGE) continue;
-			cass_map_id_to_dataobj(query_table->map, p.id, &obj);
-			assert(obj != NULL);
-			fprintf(fout, "\t%s:%g", obj, p.dist);
-		} ARRAY_END_FOREACH;
+/* a worker of the shared pool, runs whichever stage the balancer picks */
+void *t_worker (void *dummy)
+{
+	struct stage_stats st[NSTAGE];
+	struct vec_batch b;
+	void **item;
+	stimer_t tmr;
+	float time;
+	int s, i, n;
+	int last = -1;
 
-		fprintf(fout, "\n");
+	memset(st, 0, sizeof st);
+	vec_batch_init(&b);
+	item = (void **)malloc(BATCH_SIZE * sizeof(void *));
+	assert(item != NULL);
 
-		cass_result_free(&rank->result);
-		free(rank->name);
-		free(rank);
+	pthread_mutex_lock(&balancer.mutex);
+	while (!balancer.closed[STAGE_OUT])
+	{
+		s = balancer_pick(&n);
+		if (s < 0)
+		{
+			stimer_tick(&tmr);
+			pthread_cond_wait(&balancer.cond, &balancer.mutex);
+			balancer.idle += stimer_tuck(&tmr, NULL);
+			continue;
+		}
 
-		cnt_dequeue++;
-		
-		fprintf(stderr, "(%d,%d)\n", cnt_enqueue, cnt_dequeue);
+		st[s].queued += balancer.ready[s];
+		st[s].samples++;
+		balancer.ready[s] -= n;
+		if (s > STAGE_SEG) balancer.fill[s] -= n;
+		if (s < STAGE_RANK) balancer.fill[s + 1] += n;
+		balancer.running[s]++;
+		if (last >= 0 && s != last) balancer.migrations++;
+		last = s;
+		pthread_cond_broadcast(&balancer.cond);
+		pthread_mutex_unlock(&balancer.mutex);
+
+		/* the items are in the queue already, dequeue doesn't wait */
+		for (i = 0; i < n; i++) dequeue(stage_queue[s], &item[i]);
+
+		stimer_tick(&tmr);
+		switch (s)
+		{
+			case STAGE_SEG:
+				item[0] = do_seg(item[0]);
+				break;
+			case STAGE_EXTRACT:
+				item[0] = do_extract(item[0]);
+				break;
+			case STAGE_VEC:
+				for (i = 0; i < n; i++) vec_batch_set(&b, i, item[i]);
+				do_vec(&b, n);
+				for (i = 0; i < n; i++) item[i] = b.vec[i];
+				break;
+			case STAGE_RANK:
+				item[0] = do_rank(item[0]);
+				break;
+		}
+		time = stimer_tuck(&tmr, NULL);
+		st[s].busy += time;
+		st[s].items += n;
+
+		/* room was reserved, only the queue of the out thread may be full */
+		stimer_tick(&tmr);
+		for (i = 0; i < n; i++) enqueue(stage_queue[s + 1], item[i]);
+		st[s].blocked += stimer_tuck(&tmr, NULL);
+
+		pthread_mutex_lock(&balancer.mutex);
+		if (s < STAGE_RANK) balancer.ready[s + 1] += n;
+		balancer.running[s]--;
+		balancer.service[s] += time;
+		balancer.served[s] += n;
+		balancer_update();
 	}
+	pthread_mutex_unlock(&balancer.mutex);
 
-	assert(cnt_enqueue == cnt_dequeue);
+	for (s = STAGE_SEG; s <= STAGE_RANK; s++) stage_stats_add(s, &st[s]);
+
+	free(item);
+	vec_batch_free(&b);
 	return NULL;
 }
 
+/* print how the threads of every stage spent the wall clock time */
+void stage_report (float wall)
+{
+	struct stage_stats *st;
+	int s, threads;
+
+	for (s = 0; s < NSTAGE; s++)
+	{
+		st = &stage_stats[s];
+		threads = stage_threads[s];
+		printf("STAGE %-8s %4.1f threads, %5d items, %8.3f ms/item, %5.1f%% busy, %5.1f%% waiting, %5.1f%% blocked, %5.1f queued\n",
+			stage_name[s],
+			POOL > 0 && s >= STAGE_SEG && s <= STAGE_RANK ? st->busy / wall : (float)threads,
+			st->items,
+			st->items > 0 ? 1000 * st->busy / st->items : 0.0,
+			100 * st->busy / (threads * wall),
+			100 * st->wait / (threads * wall),
+			100 * st->blocked / (threads * wall),
+			st->samples > 0 ? st->queued / st->samples : 0.0);
+	}
+	if (POOL > 0)
+		printf("POOL: %d workers, %.1f%% idle, %d stage switches\n",
+			POOL, 100 * balancer.idle / (POOL * wall), balancer.migrations);
+}
+
 int main (int argc, char *argv[])
 {
 	stimer_t tmr;
@@ -418,14 +911,17 @@ int main (int argc, char *argv[])
 	tdesc_t *t_vec_desc;
 	tdesc_t *t_rank_desc;
 	tdesc_t *t_out_desc;
+	tdesc_t *t_worker_desc;
 
 	tpool_t *p_load;
-	tpool_t *p_seg;
-	tpool_t *p_extract;
-	tpool_t *p_vec;
-	tpool_t *p_rank;
+	tpool_t *p_seg = NULL;
+	tpool_t *p_extract = NULL;
+	tpool_t *p_vec = NULL;
+	tpool_t *p_rank = NULL;
 	tpool_t *p_out;
+	tpool_t *p_worker = NULL;
 
+	float wall;
 	int ret, i;
 
 #ifdef PARSEC_VERSION
@@ -443,7 +939,7 @@ int main (int argc, char *argv[])
 
 	if (argc < 8)
 	{
-		printf("%s <database> <table> <query dir> <top K> <depth> <n> <out>\n", argv[0]); 
+		printf("%s <database> <table> <query dir> <top K> <depth> <n> <out> [batch] [recall check] [pool]\n", argv[0]); 
 		return 0;
 	}
 
@@ -460,6 +956,12 @@ int main (int argc, char *argv[])
 
 	output_path = argv[7];
 
+	if (argc > 8) BATCH_SIZE = atoi(argv[8]);
+	if (argc > 9) RECALL_CHECK = atoi(argv[9]);
+	if (argc > 10) POOL = atoi(argv[10]);
+	assert(BATCH_SIZE > 0);
+	snprintf(batch_params, sizeof batch_params, "%s -ca", extra_params);
+
 	fout = fopen(output_path, "w");
 	assert(fout != NULL);
 
@@ -495,11 +997,12 @@ int main (int argc, char *argv[])
 	image_init(argv[0]);
 
 	stimer_tick(&tmr);
+	/* the pool closes the queues itself and signals q_rank_out once */
 	queue_init(&q_load_seg,    DEPTH, NTHREAD_LOAD);
-	queue_init(&q_seg_extract, DEPTH, NTHREAD_SEG);
-	queue_init(&q_extract_vec, DEPTH, NTHREAD_EXTRACT);
-	queue_init(&q_vec_rank,    DEPTH, NTHREAD_VEC);
-	queue_init(&q_rank_out,    DEPTH, NTHREAD_RANK);
+	queue_init(&q_seg_extract, DEPTH, POOL > 0 ? 1 : NTHREAD_SEG);
+	queue_init(&q_extract_vec, DEPTH, POOL > 0 ? 1 : NTHREAD_EXTRACT);
+	queue_init(&q_vec_rank,    DEPTH, POOL > 0 ? 1 : NTHREAD_VEC);
+	queue_init(&q_rank_out,    DEPTH, POOL > 0 ? 1 : NTHREAD_RANK);
 
 	t_load_desc = (tdesc_t *)calloc(NTHREAD_LOAD, sizeof(tdesc_t));
 	t_seg_desc = (tdesc_t *)calloc(NTHREAD_SEG, sizeof(tdesc_t));
@@ -507,6 +1010,7 @@ int main (int argc, char *argv[])
 	t_vec_desc = (tdesc_t *)calloc(NTHREAD_VEC, sizeof(tdesc_t));
 	t_rank_desc = (tdesc_t *)calloc(NTHREAD_RANK, sizeof(tdesc_t));
 	t_out_desc = (tdesc_t *)calloc(NTHREAD_OUT, sizeof(tdesc_t));
+	t_worker_desc = (tdesc_t *)calloc(POOL > 0 ? POOL : 1, sizeof(tdesc_t));
 
 	t_load_desc[0].attr = NULL;
 	t_load_desc[0].start_routine = t_load;
@@ -542,23 +1046,59 @@ int main (int argc, char *argv[])
 	t_out_desc[0].arg = NULL;
 	for (i = 1; i < NTHREAD_OUT; i++) t_out_desc[i] = t_out_desc[0];
 
+	t_worker_desc[0].attr = NULL;
+	t_worker_desc[0].start_routine = t_worker;
+	t_worker_desc[0].arg = NULL;
+	for (i = 1; i < POOL; i++) t_worker_desc[i] = t_worker_desc[0];
+
 	cnt_enqueue = cnt_dequeue = 0;
 
+	memset(&vec_stats, 0, sizeof vec_stats);
+	pthread_mutex_init(&vec_stats.mutex, NULL);
+
+	memset(stage_stats, 0, sizeof stage_stats);
+	memset(&load_stats, 0, sizeof load_stats);
+	pthread_mutex_init(&stats_mutex, NULL);
+	stage_threads[STAGE_LOAD] = NTHREAD_LOAD;
+	stage_threads[STAGE_SEG] = POOL > 0 ? POOL : NTHREAD_SEG;
+	stage_threads[STAGE_EXTRACT] = POOL > 0 ? POOL : NTHREAD_EXTRACT;
+	stage_threads[STAGE_VEC] = POOL > 0 ? POOL : NTHREAD_VEC;
+	stage_threads[STAGE_RANK] = POOL > 0 ? POOL : NTHREAD_RANK;
+	stage_threads[STAGE_OUT] = NTHREAD_OUT;
+
+	memset(&balancer, 0, sizeof balancer);
+	pthread_mutex_init(&balancer.mutex, NULL);
+	pthread_cond_init(&balancer.cond, NULL);
+
 #ifdef ENABLE_PARSEC_HOOKS
 	__parsec_roi_begin();
 #endif
 	p_load = tpool_create(t_load_desc, NTHREAD_LOAD);
-	p_seg = tpool_create(t_seg_desc, NTHREAD_SEG);
-	p_extract = tpool_create(t_extract_desc, NTHREAD_EXTRACT);
-	p_vec = tpool_create(t_vec_desc, NTHREAD_VEC);
-	p_rank = tpool_create(t_rank_desc, NTHREAD_RANK);
+	if (POOL > 0)
+	{
+		p_worker = tpool_create(t_worker_desc, POOL);
+	}
+	else
+	{
+		p_seg = tpool_create(t_seg_desc, NTHREAD_SEG);
+		p_extract = tpool_create(t_extract_desc, NTHREAD_EXTRACT);
+		p_vec = tpool_create(t_vec_desc, NTHREAD_VEC);
+		p_rank = tpool_create(t_rank_desc, NTHREAD_RANK);
+	}
 	p_out = tpool_create(t_out_desc, NTHREAD_OUT);
 
 	tpool_join(p_out, NULL);
-	tpool_join(p_rank, NULL);
-	tpool_join(p_vec, NULL);
-	tpool_join(p_extract, NULL);
-	tpool_join(p_seg, NULL);
+	if (POOL > 0)
+	{
+		tpool_join(p_worker, NULL);
+	}
+	else
+	{
+		tpool_join(p_rank, NULL);
+		tpool_join(p_vec, NULL);
+		tpool_join(p_extract, NULL);
+		tpool_join(p_seg, NULL);
+	}
 	tpool_join(p_load, NULL);
 
 #ifdef ENABLE_PARSEC_HOOKS
@@ -566,10 +1106,17 @@ int main (int argc, char *argv[])
 #endif
 
 	tpool_destroy(p_load);
-	tpool_destroy(p_seg);
-	tpool_destroy(p_extract);
-	tpool_destroy(p_vec);
-	tpool_destroy(p_rank);
+	if (POOL > 0)
+	{
+		tpool_destroy(p_worker);
+	}
+	else
+	{
+		tpool_destroy(p_seg);
+		tpool_destroy(p_extract);
+		tpool_destroy(p_vec);
+		tpool_destroy(p_rank);
+	}
 	tpool_destroy(p_out);
 
 	free(t_load_desc);
@@ -578,6 +1125,7 @@ int main (int argc, char *argv[])
 	free(t_vec_desc);
 	free(t_rank_desc);
 	free(t_out_desc);
+	free(t_worker_desc);
 
 	queue_destroy(&q_load_seg);
 	queue_destroy(&q_seg_extract);
@@ -585,7 +1133,20 @@ int main (int argc, char *argv[])
 	queue_destroy(&q_vec_rank);
 	queue_destroy(&q_rank_out);
 
-	stimer_tuck(&tmr, "QUERY TIME");
+	wall = stimer_tuck(&tmr, "QUERY TIME");
+
+	printf("INDEX: %d images in %d batches, %.3f seconds, %.1f images/second\n",
+		vec_stats.images, vec_stats.batches, vec_stats.time,
+		vec_stats.time > 0 ? vec_stats.images / vec_stats.time : 0.0);
+	if (vec_stats.checked > 0)
+		printf("INDEX RECALL: %.4f (%d of %d candidates)\n",
+			(float)vec_stats.found / vec_stats.checked, vec_stats.found, vec_stats.checked);
+	pthread_mutex_destroy(&vec_stats.mutex);
+
+	stage_report(wall);
+	pthread_mutex_destroy(&stats_mutex);
+	pthread_mutex_destroy(&balancer.mutex);
+	pthread_cond_destroy(&balancer.cond);
 
 	ret = cass_env_close(env, 0);
 	if (ret != 0) { printf("ERROR: %s\n", cass_strerror(ret)); return 0; }
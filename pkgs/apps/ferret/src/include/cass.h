@@ -264,6 +264,11 @@ static inline int cass_vec_dist_class_add (cass_vec_dist_class_t *p)
 typedef cass_dist_t (*cass_vecset_dist_func_t) (cass_dataset_t *, cass_vecset_id_t,
 		cass_dataset_t *, cass_vecset_id_t , cass_vec_dist_t *vec_dist, void *);
 
+/* the result only has to be exact if it does not exceed the bound,
+ * otherwise any value larger than the bound can be returned */
+typedef cass_dist_t (*cass_vecset_dist_bounded_func_t) (cass_dataset_t *, cass_vecset_id_t,
+		cass_dataset_t *, cass_vecset_id_t , cass_vec_dist_t *vec_dist, void *, cass_dist_t bound);
+
 typedef struct _cass_vecset_dist_class{
 	char *name;
 	cass_vecset_type_t vecset_type;
@@ -275,6 +280,8 @@ typedef struct _cass_vecset_dist_class{
 	int (*checkpoint) (void *, CASS_FILE *);
 	int (*restore) (void **, CASS_FILE *);
 	void (*free) (void *);
+	/* optional, used by top-k queries to skip hopeless candidates early */
+	cass_vecset_dist_bounded_func_t dist_bounded;
 	/* private data... */
 } cass_vecset_dist_class_t;
 
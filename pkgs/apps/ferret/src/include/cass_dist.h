@@ -115,5 +115,8 @@ static inline type dist_cos_##type (cass_size_t D, const type *P1, const type *P
 GEN_DIST(int32_t);
 GEN_DIST(float);
 
+/* Euclidean distances of P1 to n vectors stored transposed in P2, see cass_dist.c */
+void dist_L2_float_row (cass_size_t D, const float *P1, cass_size_t n, const float *P2, float *dist);
+
 #endif
 
@@ -18,5 +18,6 @@ void queue_init(struct queue* que, int size, int prod_threads);
 void queue_destroy(struct queue* que);
 int  dequeue(struct queue* que, void** to_buf);
 void enqueue(struct queue* que, void* from_buf);
+int  queue_count(struct queue* que);	// no of items in the queue
 
 #endif //QUEUE
@@ -17,6 +17,8 @@ You should have received a copy of the GNU General Public License
 along with this program; if not, write to the Free Software Foundation,
 Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 */
+#include <math.h>
+#include <string.h>
 #include <cass_type.h>
 /* type = int | float */
 extern int32_t chunk_cnt [];
@@ -132,3 +134,47 @@ type dist_cos_##type (cass_size_t D, const type *P1, const type *P2)\
 GEN_DIST(int32_t);
 GEN_DIST(float);
 
+/* Euclidean distances (see dist_L2_float in cass_dist.h) of the vector P1 to
+ * n vectors stored transposed in P2, component i of vector j is P2[i * n + j].
+ * Several vectors are processed at once, each one accumulates its components
+ * in the same order as dist_L2_float, so the distances are identical. */
+void dist_L2_float_row (cass_size_t D, const float *P1, cass_size_t n, const float *P2, float *dist)
+{
+	cass_size_t i, j, k;
+	float result;
+	float tmp;
+#ifdef __GNUC__
+	typedef float v4sf __attribute__((vector_size(16)));
+	v4sf vresult;
+	v4sf vtmp;
+
+	for (j = 0; j + 4 <= n; j += 4)
+	{
+		vresult = (v4sf){0, 0, 0, 0};
+		for (i = 0; i < D; i++)
+		{
+			memcpy(&vtmp, P2 + i * n + j, sizeof vtmp);
+			vtmp = P1[i] - vtmp;
+			vtmp *= vtmp;
+			vresult += vtmp;
+		}
+		for (k = 0; k < 4; k++)
+		{
+			dist[j + k] = sqrt(vresult[k]);
+		}
+	}
+#else
+	j = 0;
+#endif
+	for (; j < n; j++)
+	{
+		result = 0;
+		for (i = 0; i < D; i++)
+		{
+			tmp = P1[i] - P2[i * n + j];
+			tmp *= tmp;
+			result += tmp;
+		}
+		dist[j] = sqrt(result);
+	}
+}
@@ -296,7 +296,8 @@ cass_vecset_dist_class_t vecset_dist_single =
 
 SDIST_SIMPLE_METHODS(emd, vecset_dist_emd);
 
-cass_dist_t sdist_emd (cass_dataset_t *ds1, cass_vecset_id_t p1, cass_dataset_t *ds2, cass_vecset_id_t p2, cass_vec_dist_t *vec_dist, void *p)
+/* define EMD_PARITY_CHECK to compare emd_L2_float with the generic emd */
+cass_dist_t sdist_emd_bounded (cass_dataset_t *ds1, cass_vecset_id_t p1, cass_dataset_t *ds2, cass_vecset_id_t p2, cass_vec_dist_t *vec_dist, void *p, cass_dist_t bound)
 {
 	cass_vecset_t *vecset1;
 	cass_vecset_t *vecset2;
@@ -334,9 +335,27 @@ cass_dist_t sdist_emd (cass_dataset_t *ds1, cass_vecset_id_t p1, cass_dataset_t
 		vec = (void *)vec + ds2->vec_size;
 	}
 
+	if (vec_dist->__class == &vec_dist_L2_float)
+	{
+		cass_dist_t d = emd_L2_float(&sig1, &sig2, ds1->vec_dim, bound);
+#ifdef EMD_PARITY_CHECK
+		cass_dist_t ref = emd(&sig1, &sig2, vec_dist->__class->dist, ds1->vec_dim, vec_dist, NULL, NULL);
+		if (d != ref && !(d > bound && ref > bound))
+		{
+			warn("emd_L2_float: %g differs from emd: %g (bound %g)\n", d, ref, bound);
+		}
+#endif
+		return d;
+	}
+
 	return emd(&sig1, &sig2, vec_dist->__class->dist, ds1->vec_dim, vec_dist, NULL, NULL);
 }
 
+cass_dist_t sdist_emd (cass_dataset_t *ds1, cass_vecset_id_t p1, cass_dataset_t *ds2, cass_vecset_id_t p2, cass_vec_dist_t *vec_dist, void *p)
+{
+	return sdist_emd_bounded(ds1, p1, ds2, p2, vec_dist, p, EMD_INFINITY);
+}
+
 cass_vecset_dist_class_t vecset_dist_emd =
 {
 	.name = "emd",
@@ -348,6 +367,7 @@ cass_vecset_dist_class_t vecset_dist_emd =
 	.checkpoint = sdist_simple_checkpoint,
 	.restore = sdist_emd_restore,
 	.free = sdist_simple_free,
+	.dist_bounded = sdist_emd_bounded,
 };
 
 SDIST_SIMPLE_METHODS(myemd, vecset_dist_myemd);
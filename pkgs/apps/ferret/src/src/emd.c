@@ -47,9 +47,13 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 /* GLOBAL VARIABLE DECLARATION */
 
 /* DECLARATION OF FUNCTIONS */
+static emd_state_t *emdthreadstate(void);
+static int emdsize(emd_state_t*, signature_t *Signature1, signature_t *Signature2);
+static float emdsolve(emd_state_t*, signature_t *Signature1,
+	signature_t *Signature2, flow_t *Flow, int *FlowSize, float bound);
+static double emdbound(emd_state_t*, signature_t *Signature1, signature_t *Signature2);
 static float emdinit(emd_state_t*, signature_t *Signature1,
-	signature_t *Signature2,
-	float (*Dist)(cass_size_t, feature_t, feature_t, void *), cass_size_t, void *);
+	signature_t *Signature2);
 static void findBasicVariables(emd_state_t*, emd_node1_t *U, emd_node1_t *V);
 static int isOptimal(emd_state_t*, emd_node1_t *U, emd_node1_t *V);
 static int findLoop(emd_state_t*, emd_node2_t **Loop);
@@ -75,6 +79,7 @@ mkemdstate(void)
 void
 freeemdstate(emd_state_t *state)
 {
+	free(state->T);
 	free(state);
 	return;
 }
@@ -98,31 +103,112 @@ where
               Flow will be stored
               
 ******************************************************************************/
-static __thread double **C = NULL;
+static __thread emd_state_t *thread_state = NULL;
 
 float
 emd(signature_t *Signature1, signature_t *Signature2, float (*Dist)(cass_size_t, feature_t, feature_t, void *), cass_size_t dim, void *param, flow_t *Flow, int*FlowSize)
 {
-  struct emd_state_t emd_state, *state = &emd_state;
+  emd_state_t *state = emdthreadstate();
+  int i, j;
+
+  if (emdsize(state, Signature1, Signature2) < 0)
+    return EMD_INFINITY;
+
+  /* COMPUTE THE DISTANCE MATRIX */
+  for(i=0; i < state->n1; i++)
+    for(j=0; j < state->n2; j++)
+      state->C[i][j] = Dist(dim, Signature1->Features[i], Signature2->Features[j], param);
+
+  return emdsolve(state, Signature1, Signature2, Flow, FlowSize, EMD_INFINITY);
+}
+
+float
+emd_L2_float(signature_t *Signature1, signature_t *Signature2, cass_size_t dim, float bound)
+{
+  emd_state_t *state = emdthreadstate();
+  const float *F;
+  cass_size_t k;
+  int i, j;
+
+  if (emdsize(state, Signature1, Signature2) < 0)
+    return EMD_INFINITY;
+
+  /* TRANSPOSE THE FEATURES OF SIGNATURE 2, COMPONENT k OF FEATURE j IS T[k*n2+j] */
+  if (state->T_size < dim * state->n2)
+    {
+      state->T_size = dim * MAX_SIG_SIZE;
+      state->T = realloc(state->T, state->T_size * sizeof *state->T);
+      assert(state->T != NULL);
+    }
+  for(j=0; j < state->n2; j++)
+    {
+      F = Signature2->Features[j];
+      for(k=0; k < dim; k++)
+	state->T[k * state->n2 + j] = F[k];
+    }
+
+  /* COMPUTE THE DISTANCE MATRIX */
+  for(i=0; i < state->n1; i++)
+    dist_L2_float_row(dim, Signature1->Features[i], state->n2, state->T, state->C[i]);
+
+  return emdsolve(state, Signature1, Signature2, NULL, NULL, bound);
+}
+
+/* THE STATE IS ALLOCATED ONCE PER THREAD AND REUSED BY ALL CALLS */
+static emd_state_t *
+emdthreadstate(void)
+{
+  if (thread_state == NULL)
+    {
+      thread_state = mkemdstate();
+      assert(thread_state != NULL);
+    }
+  return thread_state;
+}
+
+/* SET THE SIGNATURE SIZES AND LAY OUT THE ROWS OF THE COST MATRIX, INCLUDING
+   THE POSSIBLE DUMMY ROW AND COLUMN */
+static int
+emdsize(emd_state_t *state, signature_t *Signature1, signature_t *Signature2)
+{
+  int i;
+
+  state->n1 = Signature1->n;
+  state->n2 = Signature2->n;
+
+  if (state->n1 > MAX_SIG_SIZE || state->n2 > MAX_SIG_SIZE)
+    {
+      warn("emd: Signature size is limited to %d, n1: %d, n2: %d\n", MAX_SIG_SIZE, state->n1, state->n2);
+      return -1;
+    }
+
+  for(i=0; i <= state->n1; i++)
+    state->C[i] = state->Cbuf + i * (state->n2 + 1);
+  return 0;
+}
+
+static float
+emdsolve(emd_state_t *state, signature_t *Signature1, signature_t *Signature2, flow_t *Flow, int *FlowSize, float bound)
+{
   int itr;
-  double totalCost;
+  double totalCost, lowerBound;
   float w;
   emd_node2_t *XP;
   flow_t *FlowP;
   emd_node1_t U[MAX_SIG_SIZE1], V[MAX_SIG_SIZE1];
 
-  if (C == NULL) C = type_matrix_alloc(double, MAX_SIG_SIZE1, MAX_SIG_SIZE1);
-
-  bzero(state, sizeof *state);
-
-  state->C = C;
+  /* NO NEED TO SOLVE IF THE EMD CAN'T BE WITHIN THE BOUND */
+  if (bound < EMD_INFINITY)
+    {
+      lowerBound = emdbound(state, Signature1, Signature2);
+      if (lowerBound * (1.0 - BOUND_SLACK) > bound)
+	return (float)lowerBound;
+    }
 
-  w = emdinit(state, Signature1, Signature2, Dist, dim, param);
+  state->tot_flow_costs = 0;
+  state->tot_flow = 0;
 
-  if (w == EMD_INFINITY) {
-      // init failed, due to nr_reg too high, ignore this seg.
-      return EMD_INFINITY;
-  }
+  w = emdinit(state, Signature1, Signature2);
 
 #if DEBUG_LEVEL > 1
   print("\nINITIAL SOLUTION:\n");
@@ -192,31 +278,69 @@ emd(signature_t *Signature1, signature_t *Signature2, float (*Dist)(cass_size_t,
   return (float)(totalCost / w);
 }
 
+/* LOWER BOUND OF THE EMD: ALL OF THE SMALLER ONE OF SUPPLY AND DEMAND HAS TO
+   BE MOVED, EACH FEATURE OF THAT SIGNATURE AT LEAST AT ITS CHEAPEST COST */
+static double
+emdbound(emd_state_t *state, signature_t *Signature1, signature_t *Signature2)
+{
+  int i, j;
+  double sSum, dSum, cost;
+  float minC;
+
+  if (state->n1 == 0 || state->n2 == 0)
+    return 0;
+
+  sSum = 0.0;
+  for(i=0; i < state->n1; i++)
+    sSum += Signature1->Weights[i];
+  dSum = 0.0;
+  for(j=0; j < state->n2; j++)
+    dSum += Signature2->Weights[j];
+
+  cost = 0.0;
+  if (sSum <= dSum)
+    {
+      if (sSum <= 0.0)
+	return 0;
+      for(i=0; i < state->n1; i++)
+	{
+	  minC = state->C[i][0];
+	  for(j=1; j < state->n2; j++)
+	    if (state->C[i][j] < minC)
+	      minC = state->C[i][j];
+	  cost += (double)Signature1->Weights[i] * minC;
+	}
+      return cost / sSum;
+    }
+  else
+    {
+      if (dSum <= 0.0)
+	return 0;
+      for(j=0; j < state->n2; j++)
+	{
+	  minC = state->C[0][j];
+	  for(i=1; i < state->n1; i++)
+	    if (state->C[i][j] < minC)
+	      minC = state->C[i][j];
+	  cost += (double)Signature2->Weights[j] * minC;
+	}
+      return cost / dSum;
+    }
+}
+
 static float
-emdinit(emd_state_t *state, signature_t *Signature1, signature_t *Signature2, float (*Dist)(cass_size_t, feature_t, feature_t, void *), cass_size_t dim, void *param)
+emdinit(emd_state_t *state, signature_t *Signature1, signature_t *Signature2)
 {
   int i, j;
   double sSum, dSum, diff;
   double S[MAX_SIG_SIZE1], D[MAX_SIG_SIZE1];
  
-  state->n1 = Signature1->n;
-  state->n2 = Signature2->n;
-
-  if (state->n1 > MAX_SIG_SIZE || state->n2 > MAX_SIG_SIZE)
-    {
-      warn("emd: Signature size is limited to %d, n1: %d, n2: %d\n", MAX_SIG_SIZE, state->n1, state->n2);
-      return EMD_INFINITY;
-    }
-  
-  /* COMPUTE THE DISTANCE MATRIX */
+  /* FIND THE LARGEST COST */
   state->maxC = 0;
   for(i=0; i < state->n1; i++)
     for(j=0; j < state->n2; j++) 
-      {
-	state->C[i][j] = Dist(dim, Signature1->Features[i], Signature2->Features[j], param);
-	if (state->C[i][j] > state->maxC)
-	  state->maxC = state->C[i][j];
-      }
+      if (state->C[i][j] > state->maxC)
+	state->maxC = state->C[i][j];
 	
   /* SUM UP THE SUPPLY AND DEMAND */
   sSum = 0.0;
@@ -620,7 +744,7 @@ russel(emd_state_t *state, double *S, double *D)
 {
   int i, j, found, minI, minJ;
   double deltaMin, oldVal, diff;
-  double Delta[MAX_SIG_SIZE1][MAX_SIG_SIZE1];
+  double *Delta = state->Delta;
   emd_node1_t Ur[MAX_SIG_SIZE1], Vr[MAX_SIG_SIZE1];
   emd_node1_t uHead, *CurU, *PrevU;
   emd_node1_t vHead, *CurV, *PrevV;
@@ -664,7 +788,7 @@ russel(emd_state_t *state, double *S, double *D)
   /* COMPUTE THE Delta MATRIX */
   for(i=0; i < state->n1 ; i++)
     for(j=0; j < state->n2 ; j++)
-      Delta[i][j] = state->C[i][j] - Ur[i].val - Vr[j].val;
+      Delta[i * state->n2 + j] = state->C[i][j] - Ur[i].val - Vr[j].val;
 
   /* FIND THE BASIC VARIABLES */
   do
@@ -696,9 +820,9 @@ russel(emd_state_t *state, double *S, double *D)
 	    {
 	      int j;
 	      j = CurV->i;
-	      if (deltaMin > Delta[i][j])
+	      if (deltaMin > Delta[i * state->n2 + j])
 		{
-		  deltaMin = Delta[i][j];
+		  deltaMin = Delta[i * state->n2 + j];
 		  minI = i;
 		  minJ = j;
 		  PrevUMinI = PrevU;
@@ -741,7 +865,7 @@ russel(emd_state_t *state, double *S, double *D)
 		  diff = oldVal - CurV->val;
 		  if (fabs(diff) < EPSILON * state->maxC)
 		    for (CurU=uHead.Next; CurU != NULL; CurU=CurU->Next)
-		      Delta[CurU->i][j] += diff;
+		      Delta[CurU->i * state->n2 + j] += diff;
 		}
 	    }
 	}
@@ -768,7 +892,7 @@ russel(emd_state_t *state, double *S, double *D)
 		  diff = oldVal - CurU->val;
 		  if (fabs(diff) < EPSILON * state->maxC)
 		    for (CurV=vHead.Next; CurV != NULL; CurV=CurV->Next)
-		      Delta[i][CurV->i] += diff;
+		      Delta[i * state->n2 + CurV->i] += diff;
 		}
 	    }
 	}
@@ -10,6 +10,7 @@
 #define MAX_ITERATIONS 500
 #define EMD_INFINITY   1e20
 #define EPSILON        1e-6
+#define BOUND_SLACK    1e-4  /* RELATIVE MARGIN OF THE LOWER BOUND IN emd_L2_float */
 
 /* feature_t SHOULD BE MODIFIED BY THE USER TO REFLECT THE FEATURE TYPE      */
 typedef void *feature_t;
@@ -50,7 +51,11 @@ struct emd_node2_t {
 struct emd_state_t {
 	int		n1;			/* SIGNATURES SIZES */
 	int		n2;
-	float		**C;//[MAX_SIG_SIZE1][MAX_SIG_SIZE1]; /* THE COST MATRIX */
+	float		*C[MAX_SIG_SIZE1];	/* ROWS OF THE COST MATRIX */
+	float		Cbuf[MAX_SIG_SIZE1*MAX_SIG_SIZE1]; /* THE COST MATRIX, ROW STRIDE n2+1 */
+	double		Delta[MAX_SIG_SIZE1*MAX_SIG_SIZE1]; /* RUSSEL'S Delta MATRIX, ROW STRIDE n2 */
+	float		*T;			/* TRANSPOSED FEATURES OF SIGNATURE 2 */
+	cass_size_t	T_size;
 	emd_node2_t	X[MAX_SIG_SIZE1*2];	/* THE BASIC VARIABLES VECTOR */
 
 	/* VARIABLES TO HANDLE _X EFFICIENTLY */
@@ -76,4 +81,13 @@ struct emd_state_t {
 emd_state_t	*mkemdstate(void);
 void		freeemdstate(emd_state_t*);
 float		emd(signature_t*, signature_t*, float (*)(cass_size_t, feature_t, feature_t, void *), cass_size_t dim, void *param, flow_t*, int*);
+
+/*
+ * EMD with dist_L2_float as ground distance, the features are float vectors
+ * of dimension dim.  The cost matrix is computed a row at a time with
+ * dist_L2_float_row.  If a lower bound of the EMD exceeds bound, the lower
+ * bound is returned without solving the transportation problem, i.e. the
+ * result is exact whenever it does not exceed bound.
+ */
+float		emd_L2_float(signature_t*, signature_t*, cass_size_t dim, float bound);
 #endif
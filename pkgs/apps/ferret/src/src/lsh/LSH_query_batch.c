@@ -139,6 +139,7 @@ void LSH_query_batch (const LSH_query_t *query, int N, const float **point, cass
 		}
 		LSH_hash2_noperturb(lsh, tmp, tmp2, L);
 
+		memset(topk[i], 0xff, sizeof (*topk[i]) * K);
 		TOPK_INIT(topk[i], dist, K, HUGE);
 		for (j = 0; j < L; j++)
 		{
@@ -320,9 +321,14 @@ void LSH_query_batch_ca (const LSH_query_t *query, int N, const float **point, c
 	for (i = 0; i < N; i++)
 	{
 		int j;
+		/* stale ids in the buffers would be taken for duplicates */
+		memset(topk[i], 0xff, sizeof (*topk[i]) * K);
 		TOPK_INIT(topk[i], dist, K, HUGE);
 		for (j = 0; j < T; j++)
+		{
+			memset(ptopk[i][j], 0xff, sizeof (*ptopk[i][j]) * K);
 			TOPK_INIT(ptopk[i][j], dist, K, HUGE);
+		}
 	}
 
 	//stimer_tuck(&tmr, "Stage-2");
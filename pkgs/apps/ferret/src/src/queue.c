@@ -52,6 +52,15 @@ int dequeue(struct queue * que, void **to_buf) {
     return 0;
 }
 
+int queue_count(struct queue * que) {
+    int count;
+
+    pthread_mutex_lock(&que->mutex);
+    count = (que->head - que->tail + que->size) % que->size;
+    pthread_mutex_unlock(&que->mutex);
+    return count;
+}
+
 void enqueue(struct queue * que, void *from_buf) {
     pthread_mutex_lock(&que->mutex);
     while (que->head == (que->tail-1+que->size)%que->size)
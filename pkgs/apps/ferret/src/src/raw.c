@@ -110,6 +110,16 @@ static int raw_batch_insert(cass_table_t *table, cass_dataset_t * parent, cass_v
 }
 
 #define MAX_PROB	100
+
+/* distance of a top-k candidate, the result only has to be exact
+ * if the candidate is not further than the current k-th neighbor */
+static inline cass_dist_t raw_topk_dist(cass_dataset_t *ds, cass_vecset_id_t id, cass_query_t *query, cass_vec_dist_t *vec_dist, cass_vecset_dist_t *vecset_dist, cass_dist_t bound)
+{
+	if (vecset_dist->__class->dist_bounded != NULL)
+		return vecset_dist->__class->dist_bounded(ds, id, query->dataset, query->vecset_id, vec_dist, vecset_dist, bound);
+	return vecset_dist->__class->dist(ds, id, query->dataset, query->vecset_id, vec_dist, vecset_dist);
+}
+
 static int raw_query(cass_table_t *table, cass_query_t *query, cass_result_t *result)
 {
 	struct raw_private *priv = (struct raw_private *)table->__private;
@@ -170,7 +180,7 @@ static int raw_query(cass_table_t *table, cass_query_t *query, cass_result_t *re
 					cass_list_entry_t entry;
 					if (cand.id == CASS_ID_MAX) continue;
 					entry.id = cand.id;
-					entry.dist = vecset_dist->__class->dist(ds, entry.id, query->dataset, query->vecset_id, vec_dist, vecset_dist);
+					entry.dist = raw_topk_dist(ds, entry.id, query, vec_dist, vecset_dist, result->u.list.data[0].dist);
 					TOPK_INSERT_MIN(result->u.list.data, dist, query->topk, entry);
 
 				} ARRAY_END_FOREACH;
@@ -185,7 +195,7 @@ static int raw_query(cass_table_t *table, cass_query_t *query, cass_result_t *re
 
 					cass_list_entry_t entry;
 					entry.id = id;
-					entry.dist = vecset_dist->__class->dist(ds, entry.id, query->dataset, query->vecset_id, vec_dist, vecset_dist);
+					entry.dist = raw_topk_dist(ds, entry.id, query, vec_dist, vecset_dist, result->u.list.data[0].dist);
 					TOPK_INSERT_MIN(result->u.list.data, dist, query->topk, entry);
 				}
 			}
@@ -197,7 +207,7 @@ static int raw_query(cass_table_t *table, cass_query_t *query, cass_result_t *re
 			{
 				if (rand() % MAX_PROB > r_threshold) continue;
 				cass_list_entry_t entry;
-				entry.dist = vecset_dist->__class->dist(ds, i, query->dataset, query->vecset_id, vec_dist, vecset_dist);
+				entry.dist = raw_topk_dist(ds, i, query, vec_dist, vecset_dist, result->u.list.data[0].dist);
 				entry.id = i;
 				TOPK_INSERT_MIN(result->u.list.data, dist, query->topk, entry);
 			}
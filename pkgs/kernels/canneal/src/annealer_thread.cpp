@@ -53,6 +53,16 @@ void annealer_thread::Run()
 	int accepted_bad_moves=-1;
 	double T = _start_temp;
 	Rng rng; //store of randomness
+	long long moves = 0, region_moves = 0, good_moves = 0, bad_moves = 0;
+
+	int thread_id;
+#ifdef ENABLE_THREADS
+	pthread_mutex_lock(&_stats_lock);
+	thread_id = _next_thread_id++;
+	pthread_mutex_unlock(&_stats_lock);
+#else
+	thread_id = _next_thread_id++;
+#endif
 	
 	long a_id;
 	long b_id;
@@ -69,7 +79,14 @@ void annealer_thread::Run()
 			//get a new element. Only get one new element, so that reuse should help the cache
 			a = b;
 			a_id = b_id;
-			b = _netlist->get_random_element(&b_id, a_id, &rng);
+			if (_locality > 0 && rng.drand() < _locality){
+				//the next move starts from b as well, so both stay in the region
+				int region = (thread_id + temp_steps_completed) % _nthreads;
+				b = _netlist->get_random_element_in_region(&b_id, a_id, region, _nthreads, &rng);
+				region_moves++;
+			} else {
+				b = _netlist->get_random_element(&b_id, a_id, &rng);
+			}
 			
 			routing_cost_t delta_cost = calculate_delta_routing_cost(a,b);
 			move_decision_t is_good_move = accept_move(delta_cost, T, &rng);
@@ -86,10 +103,37 @@ void annealer_thread::Run()
 			}
 		}
 		temp_steps_completed++;
+		moves += _moves_per_thread_temp;
+		good_moves += accepted_good_moves;
+		bad_moves += accepted_bad_moves;
 #ifdef ENABLE_THREADS
 		pthread_barrier_wait(&_barrier);
 #endif
 	}
+
+#ifdef ENABLE_THREADS
+	pthread_mutex_lock(&_stats_lock);
+#endif
+	_total_moves += moves;
+	_total_region_moves += region_moves;
+	_total_good_moves += good_moves;
+	_total_bad_moves += bad_moves;
+#ifdef ENABLE_THREADS
+	pthread_mutex_unlock(&_stats_lock);
+#endif
+}
+
+//*****************************************************************************************
+//  Print the move statistics of all threads, call after all threads have finished
+//*****************************************************************************************
+void annealer_thread::print_stats()
+{
+	long long accepted = _total_good_moves + _total_bad_moves;
+	cout << "Moves: " << _total_moves << " (" << _total_region_moves << " within region)" << endl;
+	cout << "Accepted moves: " << accepted << " (" << _total_good_moves << " good, " << _total_bad_moves << " bad)" << endl;
+	if (_total_moves > 0){
+		cout << "Acceptance rate: " << (double)accepted / _total_moves << endl;
+	}
 }
 
 //*****************************************************************************************
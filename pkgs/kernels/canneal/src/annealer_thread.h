@@ -56,26 +56,37 @@ public:
 		int nthreads,
 		int swaps_per_temp,
 		int start_temp,
-		int number_temp_steps
+		int number_temp_steps,
+		double locality = 0
 	)
 	:_netlist(netlist),
 	_keep_going_global_flag(true),
 	_moves_per_thread_temp(swaps_per_temp/nthreads),
 	_start_temp(start_temp),
-	_number_temp_steps(number_temp_steps)
+	_number_temp_steps(number_temp_steps),
+	_nthreads(nthreads),
+	_locality(locality),
+	_next_thread_id(0),
+	_total_moves(0),
+	_total_region_moves(0),
+	_total_good_moves(0),
+	_total_bad_moves(0)
 	{
 		assert(_netlist != NULL);
 #ifdef ENABLE_THREADS
 		pthread_barrier_init(&_barrier, NULL, nthreads);
+		pthread_mutex_init(&_stats_lock, NULL);
 #endif
 	};
 	
 	~annealer_thread() {
 #ifdef ENABLE_THREADS
 		pthread_barrier_destroy(&_barrier);
+		pthread_mutex_destroy(&_stats_lock);
 #endif
 	}					
 	void Run();
+	void print_stats();
 					
 protected:
 	move_decision_t accept_move(routing_cost_t delta_cost, double T, Rng* rng);
@@ -88,8 +99,19 @@ protected:
 	int _moves_per_thread_temp;
 	int _start_temp;
 	int _number_temp_steps;
+	int _nthreads;
+	//fraction of the moves which stay in the region of the thread, 0 picks all elements
+	//from the whole chip. The regions rotate among the threads every temperature step
+	double _locality;
+	int _next_thread_id;
+	//move statistics of all threads, added up when the threads finish
+	long long _total_moves;
+	long long _total_region_moves;
+	long long _total_good_moves;
+	long long _total_bad_moves;
 #ifdef ENABLE_THREADS
 	pthread_barrier_t _barrier;
+	pthread_mutex_t _stats_lock;
 #endif
 };
 
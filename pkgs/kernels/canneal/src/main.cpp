@@ -67,8 +67,8 @@ int main (int argc, char * const argv[]) {
 
 	srandom(3);
 
-	if(argc != 5 && argc != 6) {
-		cout << "Usage: " << argv[0] << " NTHREADS NSWAPS TEMP NETLIST [NSTEPS]" << endl;
+	if(argc < 5 || argc > 7) {
+		cout << "Usage: " << argv[0] << " NTHREADS NSWAPS TEMP NETLIST [NSTEPS [LOCALITY]]" << endl;
 		exit(1);
 	}	
 	
@@ -96,15 +96,29 @@ int main (int argc, char * const argv[]) {
 	
 	//argument 5 (optional) is the number of temperature steps before termination
 	int number_temp_steps = -1;
-        if(argc == 6) {
+        if(argc >= 6) {
 		number_temp_steps = atoi(argv[5]);
 		cout << "number of temperature steps: " << number_temp_steps << endl;
         }
 
+	//argument 6 (optional) is the fraction of moves that stay in the region of a thread
+	//0 picks the elements from the whole chip like the original annealer
+	double locality = 0;
+	if(argc == 7) {
+		locality = atof(argv[6]);
+		if (locality < 0 || locality > 1){
+			cout << "LOCALITY must be between 0 and 1" << endl;
+			exit(1);
+		}
+		cout << "locality: " << locality << endl;
+	}
+
 	//now that we've read in the commandline, run the program
 	netlist my_netlist(filename);
 	
-	annealer_thread a_thread(&my_netlist,num_threads,swaps_per_temp,start_temp,number_temp_steps);
+	annealer_thread a_thread(&my_netlist,num_threads,swaps_per_temp,start_temp,number_temp_steps,locality);
+
+	cout << "Initial routing is: " << my_netlist.total_routing_cost() << endl;
 	
 #ifdef ENABLE_PARSEC_HOOKS
 	__parsec_roi_begin();
@@ -125,6 +139,7 @@ int main (int argc, char * const argv[]) {
 	__parsec_roi_end();
 #endif
 	
+	a_thread.print_stats();
 	cout << "Final routing is: " << my_netlist.total_routing_cost() << endl;
 
 #ifdef ENABLE_PARSEC_HOOKS
@@ -138,4 +153,5 @@ void* entry_pt(void* data)
 {
 	annealer_thread* ptr = static_cast<annealer_thread*>(data);
 	ptr->Run();
+	return NULL;
 }
@@ -34,10 +34,41 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
+//*****************************************************************************************
+// Binary netlist format, written by write_binary and mapped by read_binary
+// All numbers use the byte order of the machine that wrote the file. The header is
+// followed by these arrays, each of them is suitably aligned:
+//   uint64_t fan_start[num_named+1]  first entry in fan of each named element
+//   uint32_t fanin_count[num_named]  number of fanins, the rest of the range is fanout
+//   uint32_t name_offset[num_named]  position of the name of each element in names
+//   uint32_t fan[num_fan]            element ids
+//   char names[names_size]           NUL terminated names
+//*****************************************************************************************
+static const char NETLIST_MAGIC[8] = {'C', 'N', 'L', 'B', 'I', 'N', '0', '1'};
+
+struct netlist_header {
+	char magic[8];
+	uint32_t num_elements;
+	uint32_t max_x;
+	uint32_t max_y;
+	uint32_t num_named;
+	uint64_t num_fan;
+	uint64_t names_size;
+};
+
 void netlist::release(netlist_elem* elem)
 {
 	return;
@@ -51,10 +82,8 @@ void netlist::release(netlist_elem* elem)
 routing_cost_t netlist::total_routing_cost()
 {
 	routing_cost_t rval = 0;
-	for (std::map<std::string, netlist_elem*>::iterator iter = _elem_names.begin();
-		 iter != _elem_names.end();
-		 ++iter){
-		netlist_elem* elem = iter->second;
+	for (unsigned i = 0; i < _num_named; ++i){
+		netlist_elem* elem = &_elements[i];
 		rval += elem->routing_cost_given_loc(*(elem->present_loc.Get()));
 	}
 	return rval / 2; //since routing_cost calculates both input and output routing, we have double counted
@@ -106,6 +135,28 @@ netlist_elem* netlist::get_random_element(long* elem_id, long different_from, Rn
 }
 
 
+//*****************************************************************************************
+//like get_random_element, but only returns elements of one of num_regions contiguous
+//parts of the chip, so threads working on different regions touch different memory
+//*****************************************************************************************
+netlist_elem* netlist::get_random_element_in_region(long* elem_id, long different_from, int region, int num_regions, Rng* rng)
+{
+	long first = (long)_chip_size * region / num_regions;
+	long size = (long)_chip_size * (region + 1) / num_regions - first;
+	if (size < 2){
+		//too small to find a different element
+		return get_random_element(elem_id, different_from, rng);
+	}
+
+	long id = first + rng->rand(size);
+	while (id == different_from){
+		id = first + rng->rand(size);
+	}
+	*elem_id=id;
+	return &(_elements[id]);
+}
+
+
 //*****************************************************************************************
 //assumption: will return elements a, b which we can get a valid lock on
 //*****************************************************************************************
@@ -147,20 +198,43 @@ netlist_elem* netlist::netlist_elem_from_loc(location_t& loc)
 //*****************************************************************************************
 netlist_elem* netlist::netlist_elem_from_name(std::string& name)
 {
-	return (_elem_names[name]);
+	//names are not indexed after loading, this is not used by the annealer
+	for (unsigned i = 0; i < _num_named; ++i){
+		if (name == _elements[i].item_name){
+			return &_elements[i];
+		}
+	}
+	return NULL;
 }
 
 //*****************************************************************************************
 //  TODO add errorchecking
 // ctor.  Takes a properly formatted input file, and converts it into a 
+// The file can be a text netlist or a binary one written by write_binary
 //*****************************************************************************************
 netlist::netlist(const std::string& filename)
+:_num_named(0),
+_map(NULL),
+_map_size(0)
 {
-	ifstream fin (filename.c_str());
-	assert(fin.is_open()); // were there any errors on opening?
+	if (!read_binary(filename)){
+		read_text(filename);
+	}
+}
 
-	//read the chip_array paramaters
-	fin >> _num_elements >> _max_x >> _max_y;
+netlist::~netlist()
+{
+	if (_map != NULL){
+		munmap(_map, _map_size);
+	}
+}
+
+//*****************************************************************************************
+// Used in the ctor.  Creates a chip of the right size and puts every element on its
+// own location
+//*****************************************************************************************
+void netlist::create_locations()
+{
 	_chip_size = _max_x * _max_y;
 	assert(_num_elements < _chip_size);
 	
@@ -184,71 +258,321 @@ netlist::netlist(const std::string& filename)
 		}//for (int y = 0; y < _max_y; y++)
 	}//for (int x = 0; x < _max_x; x++)
 	cout << "locs assigned" << endl;
+}
+
+//returns the next whitespace separated token of the buffer and terminates it, NULL at the end
+static char* next_token(char*& pos, char* end)
+{
+	while (pos < end && isspace((unsigned char)*pos)){
+		pos++;
+	}
+	if (pos == end){
+		return NULL;
+	}
+	char* token = pos;
+	while (pos < end && !isspace((unsigned char)*pos)){
+		pos++;
+	}
+	*pos = '\0'; //the buffer has room for a terminator at the end
+	if (pos < end){
+		pos++;
+	}
+	return token;
+}
+
+//FNV-1a
+static unsigned hash_name(const char* name)
+{
+	unsigned h = 2166136261u;
+	for (; *name != '\0'; name++){
+		h = (h ^ (unsigned char)*name) * 16777619u;
+	}
+	return h;
+}
+
+//returns the id of the element with the given name, the next unused element gets the
+//name if there is none. table is an open addressing hash table of the ids plus one
+static unsigned intern_name(char* name, vector<unsigned>& table, vector<netlist_elem>& elements, unsigned& num_named)
+{
+	unsigned mask = table.size() - 1;
+	unsigned h = hash_name(name) & mask;
+	while (table[h] != 0){
+		if (strcmp(elements[table[h] - 1].item_name, name) == 0){
+			return table[h] - 1;
+		}
+		h = (h + 1) & mask;
+	}
+	if (num_named == elements.size()){
+		cerr << "netlist has more elements than the chip has locations" << endl;
+		exit(1);
+	}
+	elements[num_named].item_name = name;
+	table[h] = ++num_named;
+	return num_named - 1;
+}
+
+//*****************************************************************************************
+// Used in the ctor.  Reads the whole text netlist into memory and turns its tokens into
+// the names of the elements, so every name is stored once. An element can have fanin
+// from an element that occurs both earlier and later in the input file, elements are
+// numbered in the order their names first occur.
+//*****************************************************************************************
+void netlist::read_text(const std::string& filename)
+{
+	ifstream fin (filename.c_str(), ios::binary);
+	assert(fin.is_open()); // were there any errors on opening?
+	fin.seekg(0, ios::end);
+	size_t size = fin.tellg();
+	fin.seekg(0, ios::beg);
+	_names.resize(size + 1);
+	fin.read(&_names[0], size);
+	assert(fin.gcount() == (streamsize)size);
+	char* pos = &_names[0];
+	char* end = pos + size;
+
+	//read the chip_array paramaters
+	char* num_elements = next_token(pos, end);
+	char* max_x = next_token(pos, end);
+	char* max_y = next_token(pos, end);
+	if (max_y == NULL){
+		cerr << "netlist has no header: " << filename << endl;
+		exit(1);
+	}
+	_num_elements = strtoul(num_elements, NULL, 10);
+	_max_x = strtoul(max_x, NULL, 10);
+	_max_y = strtoul(max_y, NULL, 10);
+	create_locations();
+
+	//ids of the elements by name, 0 marks an empty slot
+	unsigned table_size = 1;
+	while (table_size < 2 * _chip_size){
+		table_size *= 2;
+	}
+	vector<unsigned> table(table_size, 0);
+
+	//the fanins in input order, the fanout is derived from them
+	vector<unsigned> edge_elem;
+	vector<unsigned> edge_fanin;
+	vector<unsigned> fanin_count(_chip_size, 0);
+	vector<unsigned> fanout_count(_chip_size, 0);
 
 	int i=0;
-	while (!fin.eof()){
+	char* name;
+	while ((name = next_token(pos, end)) != NULL){
 		i++;
 		if ((i % 100000) == 0){
 			cout << "Just saw element: " << i << endl;
 		}
-		std::string name;
-		fin >> name;
-		netlist_elem* present_elem = create_elem_if_necessary(name); // the element that we are presently working on
-		//use create if necessary because it might have been created as a previous elements fanin
+		unsigned present_elem = intern_name(name, table, _elements, _num_named); // the element that we are presently working on
 
-		//set the basic info for the element
-		present_elem->item_name = name; //its name
+		//its type, presently we don't actually use this
+		next_token(pos, end);
 
-		int type; //its type TODO errorcheck here
-		fin >> type; // presently, don't actually use this 
-
-		std::string fanin_name;
-		while (fin >> fanin_name){
-			if (fanin_name == "END"){
+		char* fanin_name;
+		while ((fanin_name = next_token(pos, end)) != NULL){
+			if (strcmp(fanin_name, "END") == 0){
 				break; //last element in fanin
 			} //otherwise, make present elem the fanout of fanin_elem, and vice versa
-			netlist_elem* fanin_elem = create_elem_if_necessary(fanin_name);
-			present_elem->fanin.push_back(fanin_elem);
-			fanin_elem->fanout.push_back(present_elem);
-		}//while (fin >> fanin_name)
-	}//while (!fin.eof())
-		cout << "netlist created. " << i-1 << " elements." << endl;
+			unsigned fanin_elem = intern_name(fanin_name, table, _elements, _num_named);
+			edge_elem.push_back(present_elem);
+			edge_fanin.push_back(fanin_elem);
+			fanin_count[present_elem]++;
+			fanout_count[fanin_elem]++;
+		}//while ((fanin_name = next_token(pos, end)) != NULL)
+	}//while ((name = next_token(pos, end)) != NULL)
+
+	//place the fanin and then the fanout of each element next to each other
+	vector<size_t> fanin_pos(_num_named);
+	vector<size_t> fanout_pos(_num_named);
+	size_t num_fan = 0;
+	for (unsigned id = 0; id < _num_named; ++id){
+		fanin_pos[id] = num_fan;
+		fanout_pos[id] = num_fan + fanin_count[id];
+		num_fan += fanin_count[id] + fanout_count[id];
+	}
+	_fan.resize(num_fan);
+	for (size_t e = 0; e < edge_elem.size(); ++e){
+		_fan[fanin_pos[edge_elem[e]]++] = &_elements[edge_fanin[e]];
+		_fan[fanout_pos[edge_fanin[e]]++] = &_elements[edge_elem[e]];
+	}
+	netlist_elem** fan_base = _fan.empty() ? NULL : &_fan[0];
+	size_t start = 0;
+	for (unsigned id = 0; id < _num_named; ++id){
+		netlist_elem* elem = &_elements[id];
+		elem->fan = fan_base + start;
+		elem->num_fanin = fanin_count[id];
+		elem->num_fanout = fanout_count[id];
+		start += elem->num_fanin + elem->num_fanout;
+	}
+	cout << "netlist created. " << i << " elements." << endl;
+}
+
+//reports a binary netlist that is truncated or inconsistent
+static void bad_netlist(const std::string& filename)
+{
+	cerr << "invalid binary netlist: " << filename << endl;
+	exit(1);
+}
+
+//*****************************************************************************************
+// Used in the ctor.  Maps a binary netlist, returns false if the file is not one
+//*****************************************************************************************
+bool netlist::read_binary(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0){
+		cerr << "cannot open netlist: " << filename << endl;
+		exit(1);
+	}
+	struct stat st;
+	netlist_header hdr;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(hdr) ||
+	    read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    memcmp(hdr.magic, NETLIST_MAGIC, sizeof(NETLIST_MAGIC)) != 0){
+		close(fd);
+		return false;
+	}
+	_map_size = st.st_size;
+	_map = mmap(NULL, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (_map == MAP_FAILED){
+		_map = NULL;
+		bad_netlist(filename);
+	}
+
+	//locate the arrays and check that they fit into the file
+	if (hdr.num_named > _map_size / sizeof(uint64_t) || hdr.num_fan > _map_size / sizeof(uint32_t) ||
+	    hdr.names_size > _map_size || (uint64_t)hdr.max_x * hdr.max_y < hdr.num_named){
+		bad_netlist(filename);
+	}
+	const char* base = (const char*)_map;
+	size_t off = sizeof(netlist_header);
+	const uint64_t* fan_start = (const uint64_t*)(base + off);
+	off += sizeof(uint64_t) * ((size_t)hdr.num_named + 1);
+	const uint32_t* fanin_count = (const uint32_t*)(base + off);
+	off += sizeof(uint32_t) * (size_t)hdr.num_named;
+	const uint32_t* name_offset = (const uint32_t*)(base + off);
+	off += sizeof(uint32_t) * (size_t)hdr.num_named;
+	const uint32_t* fan = (const uint32_t*)(base + off);
+	off += sizeof(uint32_t) * hdr.num_fan;
+	const char* names = base + off;
+	off += hdr.names_size;
+	if (off != _map_size || hdr.names_size == 0 || names[hdr.names_size - 1] != '\0' ||
+	    fan_start[0] != 0 || fan_start[hdr.num_named] != hdr.num_fan){
+		bad_netlist(filename);
+	}
+
+	_num_elements = hdr.num_elements;
+	_max_x = hdr.max_x;
+	_max_y = hdr.max_y;
+	create_locations();
+	_num_named = hdr.num_named;
+
+	_fan.resize(hdr.num_fan);
+	for (size_t k = 0; k < hdr.num_fan; ++k){
+		if (fan[k] >= _num_named){
+			bad_netlist(filename);
+		}
+		_fan[k] = &_elements[fan[k]];
+	}
+	netlist_elem** fan_base = _fan.empty() ? NULL : &_fan[0];
+	for (unsigned id = 0; id < _num_named; ++id){
+		netlist_elem* elem = &_elements[id];
+		if (fan_start[id] > fan_start[id + 1] || fanin_count[id] > fan_start[id + 1] - fan_start[id] ||
+		    name_offset[id] >= hdr.names_size){
+			bad_netlist(filename);
+		}
+		elem->item_name = names + name_offset[id];
+		elem->fan = fan_base + fan_start[id];
+		elem->num_fanin = fanin_count[id];
+		elem->num_fanout = fan_start[id + 1] - fan_start[id] - fanin_count[id];
+	}
+	cout << "netlist created. " << _num_named << " elements." << endl;
+	return true;
 }
 
 //*****************************************************************************************
-// Used in the ctor.  Since an element have fanin from an element that can occur both
-// earlier and later in the input file, we must handle both cases
+// Writes the netlist in the binary format, which read_binary can map without parsing
+// not threadsafe
 //*****************************************************************************************
-netlist_elem* netlist::create_elem_if_necessary(std::string& name)
+void netlist::write_binary(const std::string& filename)
 {
-	static unsigned unused_elem = 0;//the first unused element
-	netlist_elem* rval;
-	//check whether we already have a netlist element with that name
-	std::map<std::string, netlist_elem*>::iterator iter = _elem_names.find(name);
-	if (iter == _elem_names.end()){
-		rval = &_elements.at(unused_elem);//if not, get one from the _elements pool
-		_elem_names[name] = rval;//put it in the map
-		unused_elem++;
-	} else {
-		//if it is in the map, just get a pointer to it
-		rval = iter->second;
+	netlist_header hdr;
+	memcpy(hdr.magic, NETLIST_MAGIC, sizeof(NETLIST_MAGIC));
+	hdr.num_elements = _num_elements;
+	hdr.max_x = _max_x;
+	hdr.max_y = _max_y;
+	hdr.num_named = _num_named;
+	hdr.num_fan = _fan.size();
+
+	vector<uint64_t> fan_start(_num_named + 1);
+	vector<uint32_t> fanin_count(_num_named);
+	vector<uint32_t> name_offset(_num_named);
+	vector<uint32_t> fan(_fan.size());
+	string names;
+	uint64_t start = 0;
+	for (unsigned id = 0; id < _num_named; ++id){
+		netlist_elem* elem = &_elements[id];
+		fan_start[id] = start;
+		fanin_count[id] = elem->num_fanin;
+		for (unsigned i = 0; i < elem->num_fanin + elem->num_fanout; ++i){
+			fan[start + i] = elem->fan[i] - &_elements[0];
+		}
+		start += elem->num_fanin + elem->num_fanout;
+		if (names.size() > UINT32_MAX){
+			cerr << "names of the netlist are too long for the binary format" << endl;
+			exit(1);
+		}
+		name_offset[id] = names.size();
+		names.append(elem->item_name);
+		names.push_back('\0');
+	}
+	fan_start[_num_named] = start;
+	if (names.empty()){
+		names.push_back('\0');
+	}
+	hdr.names_size = names.size();
+
+	ofstream fout(filename.c_str(), ios::binary);
+	assert(fout.is_open());
+	fout.write((const char*)&hdr, sizeof(hdr));
+	fout.write((const char*)&fan_start[0], sizeof(uint64_t) * fan_start.size());
+	if (_num_named > 0){
+		fout.write((const char*)&fanin_count[0], sizeof(uint32_t) * fanin_count.size());
+		fout.write((const char*)&name_offset[0], sizeof(uint32_t) * name_offset.size());
+	}
+	if (!fan.empty()){
+		fout.write((const char*)&fan[0], sizeof(uint32_t) * fan.size());
+	}
+	fout.write(names.data(), names.size());
+	if (!fout.good()){
+		cerr << "cannot write binary netlist: " << filename << endl;
+		exit(1);
 	}
-	return rval;
 }
 
 //*****************************************************************************************
 // simple dump file
 // not threadsafe
 //*****************************************************************************************
+//sorts elements by name
+static bool name_less(const netlist_elem* a, const netlist_elem* b)
+{
+	return strcmp(a->item_name, b->item_name) < 0;
+}
+
 void netlist::print_locations(const std::string& filename)
 {
 	ofstream fout(filename.c_str());
 	assert(fout.is_open());
 
-	for (std::map<std::string, netlist_elem*>::iterator iter = _elem_names.begin();
-		 iter != _elem_names.end();
-		 ++iter){
-		netlist_elem* elem = iter->second;
+	vector<netlist_elem*> sorted(_num_named);
+	for (unsigned i = 0; i < _num_named; ++i){
+		sorted[i] = &_elements[i];
+	}
+	sort(sorted.begin(), sorted.end(), name_less);
+	for (unsigned i = 0; i < _num_named; ++i){
+		netlist_elem* elem = sorted[i];
 		fout << elem->item_name << "\t" << elem->present_loc.Get()->x << "\t" << elem->present_loc.Get()->y << std::endl;
 	}
 }
@@ -31,7 +31,6 @@
 #define NETLIST_H
 
 #include <vector>
-#include <map>
 #include <string>
 
 #include "annealer_types.h"
@@ -45,7 +44,8 @@ class Rng;
 class netlist
 {
 public:
-	netlist(const std::string& filename); //ctor
+	netlist(const std::string& filename); //ctor, reads a text or a binary netlist
+	~netlist();
 	void get_random_pair(netlist_elem** a, netlist_elem** b, Rng* rng); // will return an element that we have a valid mutex on
 	void swap_locations(netlist_elem* elem_a, netlist_elem* elem_b);
 	void shuffle(Rng* rng);
@@ -55,6 +55,8 @@ public:
 	void print_locations(const std::string& filename);
 	void release(netlist_elem* elem);
 	netlist_elem* get_random_element(long* elem_id, long different_from, Rng* rng);
+	netlist_elem* get_random_element_in_region(long* elem_id, long different_from, int region, int num_regions, Rng* rng);
+	void write_binary(const std::string& filename);
 	
 protected:
 	unsigned _num_elements;
@@ -63,8 +65,18 @@ protected:
 	unsigned _chip_size;
 	std::vector<netlist_elem> _elements;//store the actual elements here
 	std::vector< std::vector<location_t> > _locations;//store the actual locations here
-	std::map<std::string, netlist_elem*> _elem_names;
-	netlist_elem* create_elem_if_necessary(std::string& name);
+	//the elements with a name come first, the rest of the chip is empty
+	unsigned _num_named;
+	//fanin and fanout of all elements in CSR form, see netlist_elem::fan
+	std::vector<netlist_elem*> _fan;
+	//the names of a text netlist, the elements point into it
+	std::vector<char> _names;
+	//the mapped binary netlist, the names of its elements point into it
+	void* _map;
+	size_t _map_size;
+	void create_locations();
+	void read_text(const std::string& filename);
+	bool read_binary(const std::string& filename);
 	//due to the pointers, perhaps I should make the copy operator protected to prevent copying
 };
 
@@ -38,7 +38,11 @@
 
 
 netlist_elem::netlist_elem()
-:present_loc(NULL)//start with the present_loc as nothing at all.  Filled in later by the netlist
+:item_name(""),
+fan(NULL),
+num_fanin(0),
+num_fanout(0),
+present_loc(NULL)//start with the present_loc as nothing at all.  Filled in later by the netlist
 {
 }
 
@@ -53,14 +57,14 @@ routing_cost_t netlist_elem::routing_cost_given_loc(location_t loc)
 	routing_cost_t fanin_cost = 0;
 	routing_cost_t fanout_cost = 0;
 	
-	for (int i = 0; i< fanin.size(); ++i){
-		location_t* fanin_loc = fanin[i]->present_loc.Get();
+	for (unsigned i = 0; i < num_fanin; ++i){
+		location_t* fanin_loc = fan[i]->present_loc.Get();
 		fanin_cost += fabs(loc.x - fanin_loc->x);
 		fanin_cost += fabs(loc.y - fanin_loc->y);
 	}
 
-	for (int i = 0; i< fanout.size(); ++i){
-		location_t* fanout_loc = fanout[i]->present_loc.Get();
+	for (unsigned i = num_fanin; i < num_fanin + num_fanout; ++i){
+		location_t* fanout_loc = fan[i]->present_loc.Get();
 		fanout_cost += fabs(loc.x - fanout_loc->x);
 		fanout_cost += fabs(loc.y - fanout_loc->y);
 	}
@@ -77,22 +81,14 @@ routing_cost_t netlist_elem::swap_cost(location_t* old_loc, location_t* new_loc)
 	routing_cost_t no_swap = 0;
 	routing_cost_t yes_swap = 0;
 	
-	for (int i = 0; i< fanin.size(); ++i){
-		location_t* fanin_loc = fanin[i]->present_loc.Get();
-		no_swap += fabs(old_loc->x - fanin_loc->x);
-		no_swap += fabs(old_loc->y - fanin_loc->y);
+	//the fanin and the fanout are stored back to back and contribute alike
+	for (unsigned i = 0; i < num_fanin + num_fanout; ++i){
+		location_t* fan_loc = fan[i]->present_loc.Get();
+		no_swap += fabs(old_loc->x - fan_loc->x);
+		no_swap += fabs(old_loc->y - fan_loc->y);
 		
-		yes_swap += fabs(new_loc->x - fanin_loc->x);
-		yes_swap += fabs(new_loc->y - fanin_loc->y);
-	}
-	
-	for (int i = 0; i< fanout.size(); ++i){
-		location_t* fanout_loc = fanout[i]->present_loc.Get();
-		no_swap += fabs(old_loc->x - fanout_loc->x);
-		no_swap += fabs(old_loc->y - fanout_loc->y);
-		
-		yes_swap += fabs(new_loc->x - fanout_loc->x);
-		yes_swap += fabs(new_loc->y - fanout_loc->y);
+		yes_swap += fabs(new_loc->x - fan_loc->x);
+		yes_swap += fabs(new_loc->y - fan_loc->y);
 	}
 	
 	return yes_swap - no_swap;
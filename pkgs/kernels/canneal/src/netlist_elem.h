@@ -30,9 +30,6 @@
 #ifndef NETLIST_ELEM_H
 #define NETLIST_ELEM_H
 
-#include <string>
-#include <vector>
-
 #include "AtomicPtr.h"
 #include "location_t.h"
 #include "annealer_types.h" 
@@ -46,9 +43,11 @@ public:
 	routing_cost_t swap_cost(location_t* old_loc, location_t* new_loc);
 
 public:
-	std::string item_name;
-	std::vector<netlist_elem*> fanin;
-	std::vector<netlist_elem*> fanout;
+	const char* item_name; //stored once by the netlist
+	//the fanin followed by the fanout, a contiguous range of the netlist's fan array
+	netlist_elem** fan;
+	unsigned num_fanin;
+	unsigned num_fanout;
 	AtomicPtr<location_t> present_loc;
 	
 protected:
@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#ifdef ENABLE_PTHREADS
+#include <pthread.h>
+#endif //ENABLE_PTHREADS
+
+#ifdef ENABLE_DMALLOC
+#include <dmalloc.h>
+#endif //ENABLE_DMALLOC
+
+#include "debug.h"
+#include "chunkindex.h"
+
+
+
+#ifdef ENABLE_PTHREADS
+
+//Use spin locks instead of mutexes (this file only)
+//Critical sections are very short, threads should never be descheduled while waiting for a shard
+#define ENABLE_SPIN_LOCKS
+
+#ifdef ENABLE_SPIN_LOCKS
+typedef pthread_spinlock_t pthread_lock_t;
+#define PTHREAD_LOCK_INIT(l) pthread_spin_init(l, PTHREAD_PROCESS_PRIVATE)
+#define PTHREAD_LOCK_DESTROY(l) pthread_spin_destroy(l)
+#define PTHREAD_LOCK(l) pthread_spin_lock(l)
+#define PTHREAD_UNLOCK(l) pthread_spin_unlock(l)
+#else
+typedef pthread_mutex_t pthread_lock_t;
+#define PTHREAD_LOCK_INIT(l) pthread_mutex_init(l, NULL)
+#define PTHREAD_LOCK_DESTROY(l) pthread_mutex_destroy(l)
+#define PTHREAD_LOCK(l) pthread_mutex_lock(l)
+#define PTHREAD_UNLOCK(l) pthread_mutex_unlock(l)
+#endif //ENABLE_SPIN_LOCKS
+
+#endif //ENABLE_PTHREADS
+
+//Maximum load factor of a shard in percent, a shard is enlarged if it holds more entries
+#define MAX_LOAD_PERCENT 70
+
+//Minimum number of slots of a shard, must be a power of two
+#define MIN_SHARD_SLOTS 16
+
+//Number of slots of the old table which are migrated by each operation while a shard is resized
+#define MIGRATE_PER_OP 64
+
+//Shards are aligned to cache lines to avoid false sharing between their locks
+#define CACHE_LINE_SIZE 64
+
+//Number of integers in a SHA1 sum
+#define KEY_LEN (SHA1_LEN/sizeof(unsigned int))
+
+//An entry of a shard, the slot is empty if value is NULL
+typedef struct {
+  unsigned int key[KEY_LEN];
+  chunk_t *value;
+} slot_t;
+
+//An open-addressing hash table with a power-of-two number of slots
+typedef struct {
+  slot_t *slots;
+  size_t mask;
+} table_t;
+
+typedef struct {
+#ifdef ENABLE_PTHREADS
+  pthread_lock_t lock;
+#endif //ENABLE_PTHREADS
+  table_t cur; //the table to which new entries are added
+  table_t old; //the table which is migrated to `cur' during a resize, old.slots is NULL otherwise
+  size_t migrated; //number of slots of the old table which have been migrated
+  size_t nEntries; //number of entries in both tables
+#ifdef ENABLE_STATISTICS
+  unsigned long nLookups;
+  unsigned long nHits;
+  unsigned long nProbes;
+  unsigned long maxProbes;
+  unsigned long nResizes;
+#endif //ENABLE_STATISTICS
+} __attribute__ ((aligned (CACHE_LINE_SIZE))) shard_t;
+
+struct _chunkindex_t {
+  shard_t *shards;
+};
+
+
+
+//SHA1 sums are uniformly distributed, so we can use their bits directly.
+//The first integer selects the shard, the following ones the slot.
+static inline shard_t *shard_for(chunkindex_t *idx, const unsigned int *key) {
+  return &idx->shards[key[0] & (CHUNKINDEX_SHARDS-1)];
+}
+
+static inline size_t slot_for(table_t *t, const unsigned int *key) {
+  return (size_t)(((uint64_t)key[1] | ((uint64_t)key[2] << 32)) & t->mask);
+}
+
+static inline int key_eq(const unsigned int *k1, const unsigned int *k2) {
+  return memcmp(k1, k2, SHA1_LEN) == 0;
+}
+
+static int table_init(table_t *t, size_t nslots) {
+  t->slots = (slot_t *)calloc(nslots, sizeof(slot_t));
+  t->mask = nslots-1;
+  return (t->slots == NULL);
+}
+
+//Return the slot with the given key or the empty slot where it would have to be inserted
+//Adds the number of inspected slots to `nProbes'
+static inline slot_t *table_find(table_t *t, const unsigned int *key, unsigned long *nProbes) {
+  size_t i = slot_for(t, key);
+  unsigned long n = 1;
+
+  while(t->slots[i].value != NULL && !key_eq(t->slots[i].key, key)) {
+    i = (i+1) & t->mask;
+    n++;
+  }
+  *nProbes += n;
+  return &t->slots[i];
+}
+
+//Move up to `n' slots of the old table of a shard to the current table
+//NOTE: Entries are never removed, so the old table stays intact until it is released.
+//      Lookups can safely probe both tables while the migration is in progress.
+static void shard_migrate(shard_t *s, size_t n) {
+  size_t i, end;
+  unsigned long dummy = 0;
+
+  assert(s->old.slots != NULL);
+  end = MIN(s->old.mask+1, s->migrated+n);
+  for(i=s->migrated; i<end; i++) {
+    if(s->old.slots[i].value != NULL) {
+      *table_find(&s->cur, s->old.slots[i].key, &dummy) = s->old.slots[i];
+    }
+  }
+  s->migrated = end;
+  if(s->migrated > s->old.mask) {
+    free(s->old.slots);
+    s->old.slots = NULL;
+  }
+}
+
+//Double the number of slots of a shard
+//The entries are migrated incrementally by the next operations on the shard
+static void shard_grow(shard_t *s) {
+  table_t t;
+
+  //Finish previous resize first, the shard can only hold two tables
+  if(s->old.slots != NULL) shard_migrate(s, s->old.mask+1);
+
+  if(table_init(&t, 2*(s->cur.mask+1))) {
+    EXIT_TRACE("Memory allocation failed.\n");
+  }
+  s->old = s->cur;
+  s->cur = t;
+  s->migrated = 0;
+#ifdef ENABLE_STATISTICS
+  s->nResizes++;
+#endif //ENABLE_STATISTICS
+}
+
+
+
+chunkindex_t *chunkindex_create(size_t minsize) {
+  chunkindex_t *idx;
+  size_t nslots;
+  int i, j;
+
+  //Determine number of slots per shard so that minsize entries fit without a resize
+  for(nslots=MIN_SHARD_SLOTS; nslots*CHUNKINDEX_SHARDS*MAX_LOAD_PERCENT < minsize*100; nslots*=2);
+
+  idx = (chunkindex_t *)malloc(sizeof(chunkindex_t));
+  if(idx == NULL) return NULL;
+  if(posix_memalign((void **)&idx->shards, CACHE_LINE_SIZE, CHUNKINDEX_SHARDS * sizeof(shard_t)) != 0) {
+    free(idx);
+    return NULL;
+  }
+  memset(idx->shards, 0, CHUNKINDEX_SHARDS * sizeof(shard_t));
+
+  for(i=0; i<CHUNKINDEX_SHARDS; i++) {
+    shard_t *s = &idx->shards[i];
+    if(table_init(&s->cur, nslots)) {
+      for(j=0; j<i; j++) free(idx->shards[j].cur.slots);
+      free(idx->shards);
+      free(idx);
+      return NULL;
+    }
+    s->old.slots = NULL;
+#ifdef ENABLE_PTHREADS
+    PTHREAD_LOCK_INIT(&s->lock);
+#endif //ENABLE_PTHREADS
+  }
+
+  return idx;
+}
+
+void chunkindex_destroy(chunkindex_t *idx, int free_values) {
+  size_t j;
+  int i;
+
+  assert(idx!=NULL);
+  for(i=0; i<CHUNKINDEX_SHARDS; i++) {
+    shard_t *s = &idx->shards[i];
+    if(free_values) {
+      for(j=0; j<=s->cur.mask; j++) {
+        if(s->cur.slots[j].value != NULL) free(s->cur.slots[j].value);
+      }
+      //Entries below s->migrated have been moved to cur already
+      if(s->old.slots != NULL) {
+        for(j=s->migrated; j<=s->old.mask; j++) {
+          if(s->old.slots[j].value != NULL) free(s->old.slots[j].value);
+        }
+      }
+    }
+    free(s->cur.slots);
+    if(s->old.slots != NULL) free(s->old.slots);
+#ifdef ENABLE_PTHREADS
+    PTHREAD_LOCK_DESTROY(&s->lock);
+#endif //ENABLE_PTHREADS
+  }
+  free(idx->shards);
+  free(idx);
+}
+
+chunk_t *chunkindex_insert_unique(chunkindex_t *idx, chunk_t *chunk) {
+  const unsigned int *key = chunk->sha1;
+  shard_t *s = shard_for(idx, key);
+  slot_t *slot;
+  chunk_t *entry;
+  unsigned long nProbes = 0;
+
+#ifdef ENABLE_PTHREADS
+  PTHREAD_LOCK(&s->lock);
+#endif //ENABLE_PTHREADS
+  if(s->old.slots != NULL) shard_migrate(s, MIGRATE_PER_OP);
+
+  slot = table_find(&s->cur, key, &nProbes);
+  entry = slot->value;
+  if(entry == NULL && s->old.slots != NULL) {
+    entry = table_find(&s->old, key, &nProbes)->value;
+  }
+
+  if(entry == NULL) {
+    //Miss, add chunk to index
+    memcpy(slot->key, key, SHA1_LEN);
+    slot->value = chunk;
+    s->nEntries++;
+    if(s->nEntries*100 > (s->cur.mask+1)*MAX_LOAD_PERCENT) shard_grow(s);
+  }
+
+#ifdef ENABLE_STATISTICS
+  s->nLookups++;
+  if(entry != NULL) s->nHits++;
+  s->nProbes += nProbes;
+  if(nProbes > s->maxProbes) s->maxProbes = nProbes;
+#endif //ENABLE_STATISTICS
+#ifdef ENABLE_PTHREADS
+  PTHREAD_UNLOCK(&s->lock);
+#endif //ENABLE_PTHREADS
+
+  return entry;
+}
+
+chunk_t *chunkindex_lookup(chunkindex_t *idx, const unsigned int *sha1) {
+  shard_t *s = shard_for(idx, sha1);
+  chunk_t *entry;
+  unsigned long nProbes = 0;
+
+#ifdef ENABLE_PTHREADS
+  PTHREAD_LOCK(&s->lock);
+#endif //ENABLE_PTHREADS
+  entry = table_find(&s->cur, sha1, &nProbes)->value;
+  if(entry == NULL && s->old.slots != NULL) {
+    entry = table_find(&s->old, sha1, &nProbes)->value;
+  }
+
+#ifdef ENABLE_STATISTICS
+  s->nLookups++;
+  if(entry != NULL) s->nHits++;
+  s->nProbes += nProbes;
+  if(nProbes > s->maxProbes) s->maxProbes = nProbes;
+#endif //ENABLE_STATISTICS
+#ifdef ENABLE_PTHREADS
+  PTHREAD_UNLOCK(&s->lock);
+#endif //ENABLE_PTHREADS
+
+  return entry;
+}
+
+#ifdef ENABLE_STATISTICS
+void chunkindex_get_stats(chunkindex_t *idx, chunkindex_stats_t *stats) {
+  int i;
+
+  assert(idx!=NULL);
+  assert(stats!=NULL);
+  memset(stats, 0, sizeof(chunkindex_stats_t));
+  for(i=0; i<CHUNKINDEX_SHARDS; i++) {
+    shard_t *s = &idx->shards[i];
+    stats->nLookups += s->nLookups;
+    stats->nHits += s->nHits;
+    stats->nProbes += s->nProbes;
+    stats->maxProbes = MAX(stats->maxProbes, s->maxProbes);
+    stats->nResizes += s->nResizes;
+    stats->nEntries += s->nEntries;
+    stats->nSlots += s->cur.mask+1;
+  }
+}
+#endif //ENABLE_STATISTICS
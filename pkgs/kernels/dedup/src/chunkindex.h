@@ -0,0 +1,60 @@
+/* This file contains methods and data structures to:
+ *  - Maintain the global index of unique data chunks, keyed by the SHA1 sum of the chunk
+ *  - Collect statistics about the efficiency of the index
+ *
+ * The index is partitioned into shards which are selected by the SHA1 sum of a chunk.
+ * Each shard is an open-addressing hash table with linear probing that stores the SHA1
+ * sums inline, so probing never has to touch the chunks themselves. A shard grows
+ * independently from the others once it exceeds its maximum load factor. Entries are
+ * migrated to the enlarged table incrementally by subsequent operations on the shard,
+ * which means no single operation has to pay for rehashing the whole shard.
+ *
+ * Note on use in multithreaded programs:
+ * All functions except chunkindex_create and chunkindex_destroy are thread-safe. Each
+ * shard is protected by its own lock, callers don't need to do any synchronization.
+ * Entries can never be removed, which is sufficient for dedup.
+ */
+
+#ifndef _CHUNKINDEX_H_
+#define _CHUNKINDEX_H_
+
+#include "dedupdef.h"
+
+//Number of shards to use, must be a power of two
+#define CHUNKINDEX_SHARDS 256
+
+//Statistics about index operations (only collected if ENABLE_STATISTICS is defined)
+typedef struct {
+  unsigned long nLookups; //number of lookups
+  unsigned long nHits; //number of lookups which found a matching entry
+  unsigned long nProbes; //total number of slots inspected during all lookups
+  unsigned long maxProbes; //largest number of slots inspected by a single lookup
+  unsigned long nResizes; //number of times a shard was enlarged
+  size_t nEntries; //number of entries in the index
+  size_t nSlots; //number of slots in the index
+} chunkindex_stats_t;
+
+typedef struct _chunkindex_t chunkindex_t;
+
+//Create an index with room for at least `minsize' entries
+//Returns NULL on failure
+chunkindex_t *chunkindex_create(size_t minsize);
+
+//Destroy an index. Call free() for all chunks in the index if `free_values' is nonzero
+void chunkindex_destroy(chunkindex_t *idx, int free_values);
+
+//Look up the chunk with the same SHA1 sum as `chunk' and return it. If there
+//is none then `chunk' is added to the index and NULL is returned.
+//The chunk must have been made ready for concurrent accesses before this call.
+chunk_t *chunkindex_insert_unique(chunkindex_t *idx, chunk_t *chunk);
+
+//Look up the chunk with the SHA1 sum `sha1', returns NULL if there is none
+chunk_t *chunkindex_lookup(chunkindex_t *idx, const unsigned int *sha1);
+
+#ifdef ENABLE_STATISTICS
+//Sum up statistics of all shards into `s'
+//Must not be called while the index is in use
+void chunkindex_get_stats(chunkindex_t *idx, chunkindex_stats_t *s);
+#endif //ENABLE_STATISTICS
+
+#endif //_CHUNKINDEX_H_
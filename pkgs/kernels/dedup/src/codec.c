@@ -0,0 +1,115 @@
+#include <string.h>
+
+#include "codec.h"
+#include "dedupdef.h"
+#include "lz.h"
+
+#ifdef ENABLE_GZIP_COMPRESSION
+#include <zlib.h>
+#endif //ENABLE_GZIP_COMPRESSION
+
+#ifdef ENABLE_BZIP2_COMPRESSION
+#include <bzlib.h>
+#endif //ENABLE_BZIP2_COMPRESSION
+
+
+//No compression, simply copies the data
+static size_t none_bound(size_t n) {
+  return n;
+}
+
+static size_t none_compress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level) {
+  if(n > cap) return 0;
+  memcpy(dst, src, n);
+  return n;
+}
+
+static long none_uncompress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+  if(n > cap) return -1;
+  memcpy(dst, src, n);
+  return (long)n;
+}
+
+static const codec_t codec_none = {"none", 1, 1, none_bound, none_compress, none_uncompress};
+
+
+#ifdef ENABLE_GZIP_COMPRESSION
+static size_t gzip_bound(size_t n) {
+  return compressBound(n);
+}
+
+static size_t gzip_compress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level) {
+  uLongf len = cap;
+  if(compress2(dst, &len, src, n, level) != Z_OK) return 0;
+  return len;
+}
+
+static long gzip_uncompress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+  uLongf len = cap;
+  if(uncompress(dst, &len, src, n) != Z_OK) return -1;
+  return (long)len;
+}
+
+static const codec_t codec_gzip = {"gzip", 6, 9, gzip_bound, gzip_compress, gzip_uncompress};
+#endif //ENABLE_GZIP_COMPRESSION
+
+
+#ifdef ENABLE_BZIP2_COMPRESSION
+//Bzip compression buffer must be at least 1% larger than source buffer plus 600 bytes
+static size_t bzip2_bound(size_t n) {
+  return n + (n >> 6) + 600;
+}
+
+//The level is the block size in units of 100 KB
+static size_t bzip2_compress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level) {
+  unsigned int len = cap;
+  if(BZ2_bzBuffToBuffCompress((char *)dst, &len, (char *)src, n, level, 0, 30) != BZ_OK) return 0;
+  return len;
+}
+
+static long bzip2_uncompress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+  unsigned int len = cap;
+  if(BZ2_bzBuffToBuffDecompress((char *)dst, &len, (char *)src, n, 0, 0) != BZ_OK) return -1;
+  return (long)len;
+}
+
+static const codec_t codec_bzip2 = {"bzip2", 9, 9, bzip2_bound, bzip2_compress, bzip2_uncompress};
+#endif //ENABLE_BZIP2_COMPRESSION
+
+
+static const codec_t codec_lz = {"lz", 1, LZ_MAX_LEVEL, lz_bound, lz_compress, lz_uncompress};
+
+
+//All codecs indexed by compression type, NULL if not compiled in
+static const codec_t *codecs[] = {
+#ifdef ENABLE_GZIP_COMPRESSION
+  [COMPRESS_GZIP] = &codec_gzip,
+#endif //ENABLE_GZIP_COMPRESSION
+#ifdef ENABLE_BZIP2_COMPRESSION
+  [COMPRESS_BZIP2] = &codec_bzip2,
+#endif //ENABLE_BZIP2_COMPRESSION
+  [COMPRESS_NONE] = &codec_none,
+  [COMPRESS_LZ] = &codec_lz,
+};
+
+//Names of all compression types, including those not compiled in
+static const char *names[] = {
+  [COMPRESS_GZIP] = "gzip",
+  [COMPRESS_BZIP2] = "bzip2",
+  [COMPRESS_NONE] = "none",
+  [COMPRESS_LZ] = "lz",
+};
+
+const codec_t *codec_get(int type) {
+  if(type < 0 || type >= (int)NELEM(codecs)) return NULL;
+  return codecs[type];
+}
+
+int codec_lookup(const char *name) {
+  int i;
+
+  for(i=0; i<(int)NELEM(names); i++) {
+    if(names[i] != NULL && strcmp(names[i], name) == 0) return i;
+  }
+  return -1;
+}
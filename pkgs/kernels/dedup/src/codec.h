@@ -0,0 +1,36 @@
+/* Compression back-ends of dedup
+ *
+ * Each compression type (COMPRESS_* in dedupdef.h) is implemented by a
+ * codec with a common interface, so the compression stage and the decoder
+ * do not depend on the libraries which are compiled in. The decoder looks
+ * up the codec of every chunk separately, which allows an output file to
+ * mix chunks of different compression types.
+ */
+
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stddef.h>
+
+typedef struct {
+  const char *name; //name used on the command line
+  int default_level; //level used if none is given
+  int max_level; //highest supported level, levels start at 1
+  //Upper bound of the size of the compressed data for n bytes of input
+  size_t (*bound)(size_t n);
+  //Compress n bytes from src into dst with room for cap bytes
+  //Returns the size of the compressed data or 0 if compression failed
+  size_t (*compress)(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level);
+  //Uncompress n bytes from src into dst with room for cap bytes
+  //Returns the size of the uncompressed data or -1 if uncompression failed
+  long (*uncompress)(const unsigned char *src, size_t n, unsigned char *dst, size_t cap);
+} codec_t;
+
+//Get the codec of a compression type, returns NULL if it is not supported
+const codec_t *codec_get(int type);
+
+//Get the compression type of a codec name, returns -1 if the name is unknown
+//NOTE: The compression type might still not be supported by this build
+int codec_lookup(const char *name);
+
+#endif //_CODEC_H_
@@ -9,6 +9,10 @@
 //greater or equal to #threads/MAX_THREADS_PER_QUEUE
 #define MAX_THREADS_PER_QUEUE 4
 
+//Set to 1 to compute the SHA1 sums of the deduplication stage in batches
+//and of the decoder with the multi-buffer SHA1 implementation (parallel version only)
+#define ENABLE_SHA1_MB 1
+
 //Set to 1 to add support with statistics collection
 //Use argument `-v' to display statistics at end of runtime
 #define ENABLE_STATISTICS 1
@@ -5,6 +5,12 @@
  * All rights reserved.
  *
  * Written by Christian Bienia.
+ *
+ * The pipeline model for the parallel version of Decode is Read->Uncompress->Write
+ * Read and Write are serial stages, Uncompress is a thread pool. Read passes
+ * unique chunks to Uncompress and all chunks in their original order to Write,
+ * which waits until the data of a unique chunk is available and looks up the
+ * originals of duplicate chunks in the chunk index shared with Uncompress.
  */
 
 #include <stdio.h>
@@ -20,14 +26,16 @@
 #include "hashtable.h"
 #include "mbuffer.h"
 #include "debug.h"
+#include "codec.h"
 
-#ifdef ENABLE_GZIP_COMPRESSION
-#include <zlib.h>
-#endif //ENABLE_GZIP_COMPRESSION
-
-#ifdef ENABLE_BZIP2_COMPRESSION
-#include <bzlib.h>
-#endif //ENABLE_BZIP2_COMPRESSION
+#ifdef ENABLE_PTHREADS
+#include <pthread.h>
+#include <sys/uio.h>
+#include "queue.h"
+#include "chunkindex.h"
+#include "slab.h"
+#include "sha1_mb.h"
+#endif //ENABLE_PTHREADS
 
 #ifdef ENABLE_PARSEC_HOOKS
 #include <hooks.h>
@@ -38,6 +46,7 @@
 //The configuration block defined in main
 config_t * conf;
 
+#ifndef ENABLE_PTHREADS
 //Hash table data structure & utility functions
 struct hashtable *cache;
 
@@ -49,6 +58,7 @@ static unsigned int hash_from_key_fn( void *k ) {
 static int keys_equal_fn ( void *key1, void *key2 ) {
   return (memcmp(key1, key2, SHA1_LEN) == 0);
 }
+#endif //ENABLE_PTHREADS
 
 
 
@@ -73,7 +83,7 @@ static int read_chunk(int fd, chunk_t *chunk) {
   if(r < 0) EXIT_TRACE("xread length fails\n")
   else if(r == 0) EXIT_TRACE("incomplete chunk\n");
 
-  switch(type) {
+  switch(type & TYPE_MASK) {
   case TYPE_FINGERPRINT:
     if(len!=SHA1_LEN) EXIT_TRACE("incorrect size of SHA1 sum\n");
     r=xread(fd, (unsigned char *)(chunk->sha1), SHA1_LEN);
@@ -89,6 +99,8 @@ static int read_chunk(int fd, chunk_t *chunk) {
     if(r < 0) EXIT_TRACE("xread data chunk fails\n")
     else if(r == 0) EXIT_TRACE("incomplete chunk\n");
     chunk->header.isDuplicate = FALSE;
+    //Chunks without a compression type use the one of the file
+    chunk->header.codec = TYPE_GET_CODEC(type, conf->compress_type);
     break;
   default:
     EXIT_TRACE("unknown chunk type\n");
@@ -102,88 +114,313 @@ static int read_chunk(int fd, chunk_t *chunk) {
  * Returns the size of the uncompressed data
  */
 static int uncompress_chunk(chunk_t *chunk) {
+  const codec_t *codec;
+  size_t n;
+  long len;
   int r;
 
   assert(chunk!=NULL);
   assert(!chunk->header.isDuplicate);
 
-  //uncompress the item
-  switch (conf->compress_type) {
-  case COMPRESS_NONE: {
-    //Simply duplicate the data
-    r = mbuffer_create(&chunk->uncompressed_data, chunk->compressed_data.n);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    //copy the block
-    memcpy(chunk->uncompressed_data.ptr, chunk->compressed_data.ptr, chunk->compressed_data.n);
-    break;
+  //uncompress the item with the codec selected by the chunk
+  codec = codec_get(chunk->header.codec);
+  if(codec == NULL) {
+    if(chunk->header.codec == COMPRESS_GZIP) EXIT_TRACE("Gzip compression used by input file not supported.\n");
+    if(chunk->header.codec == COMPRESS_BZIP2) EXIT_TRACE("Bzip2 compression used by input file not supported.\n");
+    EXIT_TRACE("unknown compression type\n");
   }
-#ifdef ENABLE_GZIP_COMPRESSION
-  case COMPRESS_GZIP: {
-    unsigned long len_64 = UNCOMPRESS_BOUND;
-    r = mbuffer_create(&chunk->uncompressed_data, len_64);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    r = uncompress(chunk->uncompressed_data.ptr, &len_64, chunk->compressed_data.ptr, chunk->compressed_data.n);
-    //TODO: Automatically enlarge buffer if return value is Z_BUF_ERROR
-    if(r!=Z_OK) EXIT_TRACE("error uncompressing chunk data\n");
-    //Shrink buffer to actual size
-    if(len_64 < chunk->uncompressed_data.n) {
-      r = mbuffer_realloc(&chunk->uncompressed_data, len_64);
-      assert(r == 0);
+  //Chunks stored without compression keep their size
+  n = chunk->header.codec == COMPRESS_NONE ? chunk->compressed_data.n : UNCOMPRESS_BOUND;
+  r = mbuffer_create(&chunk->uncompressed_data, n);
+  if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
+  len = codec->uncompress(chunk->compressed_data.ptr, chunk->compressed_data.n, chunk->uncompressed_data.ptr, n);
+  //TODO: Automatically enlarge buffer if the data does not fit
+  if(len <= 0) EXIT_TRACE("error uncompressing chunk data\n");
+  //Shrink buffer to actual size
+  if((size_t)len < chunk->uncompressed_data.n) {
+    r = mbuffer_realloc(&chunk->uncompressed_data, len);
+    assert(r == 0);
+  }
+
+  mbuffer_free(&chunk->compressed_data);
+  return chunk->uncompressed_data.n;
+}
+
+
+#ifdef ENABLE_PTHREADS
+//Arguments of the pipeline stages
+struct thread_args {
+  //thread id, unique within a thread pool (i.e. unique for a pipeline stage)
+  int tid;
+  //number of queues between Read and Uncompress
+  int nqueues;
+  //file descriptor, first and last pipeline stage only
+  int fd;
+};
+
+//The queues between the pipeline stages
+queue_t *uncompress_que, *write_que;
+
+//Index of the unique chunks, shared by all threads
+static chunkindex_t *chunk_cache;
+
+//Allocator of the chunk_t structures
+static slab_t chunk_slab;
+
+/*
+ * Pipeline stage function of the input stage
+ *
+ * Actions performed:
+ *  - Read the records of the input file
+ *  - Send unique chunks to the uncompression stage
+ *  - Send all chunks in their original order to the output stage
+ */
+void *Read(void *targs) {
+  struct thread_args *args = (struct thread_args *)targs;
+  const int nqueues = args->nqueues;
+  int fd = args->fd;
+  int qid = 0;
+  chunk_t *chunk;
+  int r;
+
+  ringbuffer_t send_buf_uncompress, send_buf_write;
+  r = ringbuffer_init(&send_buf_uncompress, ITEM_PER_INSERT);
+  r += ringbuffer_init(&send_buf_write, ITEM_PER_INSERT);
+  assert(r==0);
+
+  while(TRUE) {
+    chunk = (chunk_t *)slab_alloc(&chunk_slab);
+    if(chunk == NULL) EXIT_TRACE("Memory allocation failed.\n");
+
+    r = read_chunk(fd, chunk);
+    if(r < 0) EXIT_TRACE("error reading from input file")
+    else if(r == 0) {
+      slab_free(&chunk_slab, chunk);
+      break;
+    }
+
+    if(!chunk->header.isDuplicate) {
+      chunk->header.state = CHUNK_STATE_COMPRESSED;
+      r = pthread_mutex_init(&chunk->header.lock, NULL);
+      r += pthread_cond_init(&chunk->header.update, NULL);
+      if(r != 0) EXIT_TRACE("Initialization of chunk synchronization failed.\n");
+      r = ringbuffer_insert(&send_buf_uncompress, chunk);
+      assert(r==0);
+    }
+    r = ringbuffer_insert(&send_buf_write, chunk);
+    assert(r==0);
+
+    if(ringbuffer_isFull(&send_buf_write)) {
+      //The output stage may only see chunks which have been passed to the uncompression stage,
+      //otherwise it could wait for a chunk that is stuck in this stage while it waits for the output stage
+      while(!ringbuffer_isEmpty(&send_buf_uncompress)) {
+        r = queue_enqueue(&uncompress_que[qid], &send_buf_uncompress, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
+      qid = (qid+1) % nqueues;
+      while(!ringbuffer_isEmpty(&send_buf_write)) {
+        r = queue_enqueue(&write_que[0], &send_buf_write, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
     }
-    break;
   }
-#else
-  case COMPRESS_GZIP: {
-    EXIT_TRACE("Gzip compression used by input file not supported.\n");
-    break;
+
+  //empty buffers
+  while(!ringbuffer_isEmpty(&send_buf_uncompress)) {
+    r = queue_enqueue(&uncompress_que[qid], &send_buf_uncompress, ITEM_PER_INSERT);
+    assert(r>=1);
   }
-#endif //ENABLE_GZIP_COMPRESSION
-#ifdef ENABLE_BZIP2_COMPRESSION
-  case COMPRESS_BZIP2: {
-    unsigned int len_32 = UNCOMPRESS_BOUND;
-    r = mbuffer_create(&chunk->uncompressed_data, len_32);
-    if(r != 0) EXIT_TRACE("Creation of decompression buffer failed.\n");
-    r = BZ2_bzBuffToBuffDecompress(chunk->uncompressed_data.ptr, &len_32, chunk->compressed_data.ptr, chunk->compressed_data.n, 0, 0);
-    //TODO: Automatically enlarge buffer if return value is BZ_OUTBUFF_FULL
-    if(r!=BZ_OK) EXIT_TRACE("error uncompressing chunk data\n");
-    //Shrink buffer to actual size
-    if(len_32 < chunk->uncompressed_data.n) {
-      r = mbuffer_realloc(&chunk->uncompressed_data, len_32);
-      assert(r == 0);
-    }
-    break;
+  while(!ringbuffer_isEmpty(&send_buf_write)) {
+    r = queue_enqueue(&write_que[0], &send_buf_write, ITEM_PER_INSERT);
+    assert(r>=1);
   }
+
+  ringbuffer_destroy(&send_buf_uncompress);
+  ringbuffer_destroy(&send_buf_write);
+
+  //shutdown
+  for(qid=0; qid<nqueues; qid++) {
+    queue_terminate(&uncompress_que[qid]);
+  }
+  queue_terminate(&write_que[0]);
+
+  return NULL;
+}
+
+/*
+ * Computational kernel of the uncompression stage
+ *
+ * Computes the SHA1 sums of a batch of uncompressed chunks, in parallel
+ * with the multi-buffer SHA1 implementation if ENABLE_SHA1_MB is set.
+ */
+static void sub_Uncompress_hash_batch(chunk_t **chunks, int n) {
+  int i;
+
+#ifdef ENABLE_SHA1_MB
+  const void *data[ITEM_PER_FETCH];
+  size_t len[ITEM_PER_FETCH];
+  unsigned char *digest[ITEM_PER_FETCH];
+
+  assert(n <= ITEM_PER_FETCH);
+  for(i=0; i<n; i++) {
+    data[i] = chunks[i]->uncompressed_data.ptr;
+    len[i] = chunks[i]->uncompressed_data.n;
+    digest[i] = (unsigned char *)(chunks[i]->sha1);
+  }
+  SHA1_Digest_mb(data, len, digest, n);
 #else
-  case COMPRESS_BZIP2: {
-    EXIT_TRACE("Bzip2 compression used by input file not supported.\n");
-    break;
+  for(i=0; i<n; i++) {
+    SHA1_Digest(chunks[i]->uncompressed_data.ptr, chunks[i]->uncompressed_data.n, (unsigned char *)(chunks[i]->sha1));
   }
-#endif //ENABLE_BZIP2_COMPRESSION
-  default: {
-    EXIT_TRACE("unknown compression type\n");
-    break;
+#endif //ENABLE_SHA1_MB
+}
+
+/*
+ * Pipeline stage function of the uncompression stage
+ *
+ * Actions performed:
+ *  - Uncompress a group of unique chunks
+ *  - Compute their SHA1 sums and add them to the chunk index
+ *  - Notify the output stage that the uncompressed data is available
+ */
+void *Uncompress(void *targs) {
+  struct thread_args *args = (struct thread_args *)targs;
+  const int qid = args->tid / MAX_THREADS_PER_QUEUE;
+  chunk_t *batch[ITEM_PER_FETCH];
+  int nbatch, i;
+  int r;
+
+  ringbuffer_t recv_buf;
+  r = ringbuffer_init(&recv_buf, ITEM_PER_FETCH);
+  assert(r==0);
+
+  while(TRUE) {
+    //get a group of chunks
+    r = queue_dequeue(&uncompress_que[qid], &recv_buf, ITEM_PER_FETCH);
+    if(r < 0) break;
+
+    nbatch = 0;
+    while(!ringbuffer_isEmpty(&recv_buf)) {
+      batch[nbatch] = (chunk_t *)ringbuffer_remove(&recv_buf);
+      assert(batch[nbatch]!=NULL);
+      r = uncompress_chunk(batch[nbatch]);
+      if(r<=0) EXIT_TRACE("error uncompressing data")
+      nbatch++;
+    }
+    sub_Uncompress_hash_batch(batch, nbatch);
+
+    for(i=0; i<nbatch; i++) {
+      //NOTE: Archives never contain the same unique chunk twice, if they do the first one stays in the index
+      chunkindex_insert_unique(chunk_cache, batch[i]);
+      pthread_mutex_lock(&batch[i]->header.lock);
+      batch[i]->header.state = CHUNK_STATE_UNCOMPRESSED;
+      pthread_cond_broadcast(&batch[i]->header.update);
+      pthread_mutex_unlock(&batch[i]->header.lock);
+    }
   }
+
+  ringbuffer_destroy(&recv_buf);
+  return NULL;
+}
+
+/*
+ * Pipeline stage function of the output stage
+ *
+ * Actions performed:
+ *  - Receive all chunks in their original order
+ *  - Wait until the data of unique chunks has been uncompressed
+ *  - Look up the originals of duplicate chunks in the chunk index
+ *  - Write the uncompressed data with one writev call per group of chunks
+ *
+ * Every duplicate chunk refers to a unique chunk which appeared earlier in the
+ * input file, so the original has always been written and added to the index.
+ */
+void *Write(void *targs) {
+  struct thread_args *args = (struct thread_args *)targs;
+  struct iovec iov[WRITEV_CHUNKS];
+  int niov = 0;
+  chunk_t *chunk, *entry;
+  int r;
+
+  ringbuffer_t recv_buf;
+  r = ringbuffer_init(&recv_buf, ITEM_PER_FETCH);
+  assert(r==0);
+
+  while(TRUE) {
+    r = queue_dequeue(&write_que[0], &recv_buf, ITEM_PER_FETCH);
+    if(r < 0) break;
+
+    while(!ringbuffer_isEmpty(&recv_buf)) {
+      chunk = (chunk_t *)ringbuffer_remove(&recv_buf);
+      assert(chunk!=NULL);
+
+      if(!chunk->header.isDuplicate) {
+        pthread_mutex_lock(&chunk->header.lock);
+        if(chunk->header.state == CHUNK_STATE_COMPRESSED && niov > 0) {
+          //Write out what is ready before waiting
+          pthread_mutex_unlock(&chunk->header.lock);
+          if(xwritev(args->fd, iov, niov) < 0) EXIT_TRACE("error writing to output file");
+          niov = 0;
+          pthread_mutex_lock(&chunk->header.lock);
+        }
+        while(chunk->header.state == CHUNK_STATE_COMPRESSED) {
+          pthread_cond_wait(&chunk->header.update, &chunk->header.lock);
+        }
+        pthread_mutex_unlock(&chunk->header.lock);
+        entry = chunk;
+      } else {
+        entry = chunkindex_lookup(chunk_cache, chunk->sha1);
+        if(entry==NULL) {
+          EXIT_TRACE("Encountered a duplicate chunk in input file but not its unique counterpart. Maybe data is out of order?");
+        }
+        slab_free(&chunk_slab, chunk);
+      }
+
+      //NOTE: Unique chunks keep their uncompressed data until the end
+      iov[niov].iov_base = entry->uncompressed_data.ptr;
+      iov[niov].iov_len = entry->uncompressed_data.n;
+      niov++;
+      if(niov == WRITEV_CHUNKS) {
+        if(xwritev(args->fd, iov, niov) < 0) EXIT_TRACE("error writing to output file");
+        niov = 0;
+      }
+    }
+  }
+  if(niov > 0) {
+    if(xwritev(args->fd, iov, niov) < 0) EXIT_TRACE("error writing to output file");
   }
 
-  mbuffer_free(&chunk->compressed_data);
-  return chunk->uncompressed_data.n;
+  ringbuffer_destroy(&recv_buf);
+  return NULL;
 }
+#endif //ENABLE_PTHREADS
 
 
 void Decode(config_t * _conf) {
   int fd_in;
   int fd_out;
+#ifndef ENABLE_PTHREADS
   chunk_t *chunk=NULL;
   int r;
+#endif //ENABLE_PTHREADS
 
   conf = _conf;
+  SHA1_mb_init();
 
   //Create chunk cache
+#ifdef ENABLE_PTHREADS
+  chunk_cache = chunkindex_create(65536);
+  if(chunk_cache == NULL || slab_init(&chunk_slab, sizeof(chunk_t)) != 0) {
+    printf("ERROR: Out of memory\n");
+    exit(1);
+  }
+#else
   cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
   if(cache == NULL) {
     printf("ERROR: Out of memory\n");
     exit(1);
   }
+#endif //ENABLE_PTHREADS
 
   mbuffer_system_init();
 
@@ -206,6 +443,70 @@ void Decode(config_t * _conf) {
     exit(1);
   }
 
+#ifdef ENABLE_PTHREADS
+  int i;
+
+  //queue allocation & initialization
+  //NOTE: The small output queue limits how far the input stage can run ahead of
+  //      the output stage, which bounds the amount of compressed data in flight
+  const int nqueues = (conf->nthreads / MAX_THREADS_PER_QUEUE) +
+                      ((conf->nthreads % MAX_THREADS_PER_QUEUE != 0) ? 1 : 0);
+  uncompress_que = malloc(sizeof(queue_t) * nqueues);
+  write_que = malloc(sizeof(queue_t));
+  if( (uncompress_que == NULL) || (write_que == NULL)) {
+    printf("Out of memory\n");
+    exit(1);
+  }
+  for(i=0; i<nqueues; i++) {
+    queue_init(&uncompress_que[i], QUEUE_SIZE, 1);
+  }
+  queue_init(&write_que[0], DECODE_QUEUE_SIZE, 1);
+
+  pthread_t threads_read, threads_uncompress[MAX_THREADS], threads_write;
+  struct thread_args read_args, write_args;
+  struct thread_args uncompress_args[conf->nthreads];
+
+#ifdef ENABLE_PARSEC_HOOKS
+    __parsec_roi_begin();
+#endif
+
+  read_args.tid = 0;
+  read_args.nqueues = nqueues;
+  read_args.fd = fd_in;
+  pthread_create(&threads_read, NULL, Read, &read_args);
+
+  for (i = 0; i < conf->nthreads; i ++) {
+    uncompress_args[i].tid = i;
+    uncompress_args[i].nqueues = nqueues;
+    uncompress_args[i].fd = -1;
+    pthread_create(&threads_uncompress[i], NULL, Uncompress, &uncompress_args[i]);
+  }
+
+  write_args.tid = 0;
+  write_args.nqueues = nqueues;
+  write_args.fd = fd_out;
+  pthread_create(&threads_write, NULL, Write, &write_args);
+
+  /*** parallel phase ***/
+
+  pthread_join(threads_read, NULL);
+  for (i = 0; i < conf->nthreads; i ++)
+    pthread_join(threads_uncompress[i], NULL);
+  pthread_join(threads_write, NULL);
+
+#ifdef ENABLE_PARSEC_HOOKS
+    __parsec_roi_end();
+#endif
+
+  for(i=0; i<nqueues; i++) {
+    queue_destroy(&uncompress_que[i]);
+  }
+  queue_destroy(&write_que[0]);
+  free(uncompress_que);
+  free(write_que);
+
+#else //serial version
+
 #ifdef ENABLE_PARSEC_HOOKS
     __parsec_roi_begin();
 #endif
@@ -253,13 +554,21 @@ void Decode(config_t * _conf) {
     __parsec_roi_end();
 #endif
 
+#endif //ENABLE_PTHREADS
+
   close(fd_in);
   close(fd_out);
 
+#ifdef ENABLE_PTHREADS
+  mbuffer_system_destroy();
+  //NOTE: The chunks are released with their allocator, their uncompressed data is not freed (see below)
+  chunkindex_destroy(chunk_cache, FALSE);
+  slab_destroy(&chunk_slab);
+#else
   free(chunk);
   mbuffer_system_destroy();
   //NOTE: Would have to iterate through hashtable and manually free all buffers. Calling
   //      hashtable_destroy will cause those buffers to be reported as leaked memory.
   //hashtable_destroy(cache, TRUE);
+#endif //ENABLE_PTHREADS
 }
-
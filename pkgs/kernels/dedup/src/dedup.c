@@ -8,6 +8,7 @@
 #include "decoder.h"
 #include "config.h"
 #include "queue.h"
+#include "codec.h"
 
 #ifdef ENABLE_DMALLOC
 #include <dmalloc.h>
@@ -30,11 +31,14 @@ config_t * conf;
 static void
 usage(char* prog)
 {
-  printf("usage: %s [-cusfvh] [-w gzip/bzip2/none] [-i file] [-o file] [-t number_of_threads]\n",prog);
+  printf("usage: %s [-cupmvh] [-w gzip/bzip2/lz/none] [-l level] [-a rabin/gear] [-i file] [-o file] [-t number_of_threads]\n",prog);
   printf("-c \t\t\tcompress\n");
   printf("-u \t\t\tuncompress\n");
   printf("-p \t\t\tpreloading (for benchmarking purposes)\n");
-  printf("-w \t\t\tcompression type: gzip/bzip2/none\n");
+  printf("-m \t\t\tmemory-map input file instead of reading it\n");
+  printf("-w \t\t\tcompression type: gzip/bzip2/lz/none\n");
+  printf("-l \t\t\tcompression level, lower is faster (default depends on type)\n");
+  printf("-a \t\t\tchunking algorithm: rabin/gear\n");
   printf("-i file\t\t\tthe input file\n");
   printf("-o file\t\t\tthe output file\n");
   printf("-t \t\t\tnumber of threads per stage \n");
@@ -66,7 +70,10 @@ int main(int argc, char** argv) {
 
   strcpy(conf->outfile, "");
   conf->compress_type = COMPRESS_GZIP;
+  conf->compress_level = 0;
+  conf->chunking = CHUNKING_RABIN;
   conf->preloading = 0;
+  conf->mmap_input = 0;
   conf->nthreads = 1;
   conf->verbose = 0;
 
@@ -74,7 +81,7 @@ int main(int argc, char** argv) {
   int ch;
   opterr = 0;
   optind = 1;
-  while (-1 != (ch = getopt(argc, argv, "cupvo:i:w:t:h"))) {
+  while (-1 != (ch = getopt(argc, argv, "cupmvo:i:w:l:a:t:h"))) {
     switch (ch) {
     case 'c':
       compress = TRUE;
@@ -87,18 +94,27 @@ int main(int argc, char** argv) {
       strcpy(conf->outfile, "new.txt");
       break;
     case 'w':
-      if (strcmp(optarg, "gzip") == 0)
-        conf->compress_type = COMPRESS_GZIP;
-      else if (strcmp(optarg, "bzip2") == 0) 
-        conf->compress_type = COMPRESS_BZIP2;
-      else if (strcmp(optarg, "none") == 0)
-        conf->compress_type = COMPRESS_NONE;
-      else {
+      conf->compress_type = codec_lookup(optarg);
+      if (conf->compress_type < 0) {
         fprintf(stdout, "Unknown compression type `%s'.\n", optarg);
         usage(argv[0]);
         return -1;
       }
       break;
+    case 'l':
+      conf->compress_level = atoi(optarg);
+      break;
+    case 'a':
+      if (strcmp(optarg, "rabin") == 0)
+        conf->chunking = CHUNKING_RABIN;
+      else if (strcmp(optarg, "gear") == 0)
+        conf->chunking = CHUNKING_GEAR;
+      else {
+        fprintf(stdout, "Unknown chunking algorithm `%s'.\n", optarg);
+        usage(argv[0]);
+        return -1;
+      }
+      break;
     case 'o':
       strcpy(conf->outfile, optarg);
       break;
@@ -111,6 +127,9 @@ int main(int argc, char** argv) {
     case 'p':
       conf->preloading = TRUE;
       break;
+    case 'm':
+      conf->mmap_input = TRUE;
+      break;
     case 't':
       conf->nthreads = atoi(optarg);
       break;
@@ -124,19 +143,21 @@ int main(int argc, char** argv) {
     }
   }
 
-#ifndef ENABLE_BZIP2_COMPRESSION
- if (conf->compress_type == COMPRESS_BZIP2){
-    printf("Bzip2 compression not supported\n");
+ if (conf->preloading && conf->mmap_input){
+    printf("Preloading and memory-mapped input cannot be used together\n");
     exit(1);
   }
-#endif
 
-#ifndef ENABLE_GZIP_COMPRESSION
- if (conf->compress_type == COMPRESS_GZIP){
-    printf("Gzip compression not supported\n");
+ if (compress && codec_get(conf->compress_type) == NULL){
+    printf("Compression type not supported\n");
+    exit(1);
+  }
+
+ if (compress && conf->compress_level != 0 &&
+     (conf->compress_level < 1 || conf->compress_level > codec_get(conf->compress_type)->max_level)){
+    printf("Compression level must be between 1 and %d\n", codec_get(conf->compress_type)->max_level);
     exit(1);
   }
-#endif
 
 #ifndef ENABLE_STATISTICS
  if (conf->verbose){
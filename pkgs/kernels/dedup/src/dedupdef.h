@@ -151,6 +151,7 @@ typedef struct _chunk_t {
   struct {
     int isDuplicate;        //whether this is an original chunk or a duplicate
     chunk_state_t state;    //which type of data this chunk contains
+    int codec;              //compression type of the compressed data
 #ifdef ENABLE_PTHREADS
     //once a chunk has been added to the global database accesses
     //to the state require synchronization b/c the chunk is globally viewable
@@ -183,6 +184,13 @@ typedef struct _chunk_t {
 #define TYPE_COMPRESS 1
 #define TYPE_ORIGINAL 2
 
+//The upper 4 bits of the type of a data chunk select the compression type of the
+//chunk plus one, 0 means the compression type in the file header is used
+#define TYPE_MASK 0x0f
+#define TYPE_CODEC_SHIFT 4
+#define TYPE_WITH_CODEC(type, codec) ((type) | (((codec)+1) << TYPE_CODEC_SHIFT))
+#define TYPE_GET_CODEC(type, dflt) (((type) >> TYPE_CODEC_SHIFT) == 0 ? (dflt) : ((type) >> TYPE_CODEC_SHIFT) - 1)
+
 #define QUEUE_SIZE 1024UL*1024
 
 
@@ -199,12 +207,27 @@ typedef struct _chunk_t {
 
 #define ANCHOR_DATA_PER_INSERT 1
 
+//Maximum number of coarse-grained chunks in flight between the first and the last
+//pipeline stage, bounds the amount of data the reorder stage has to buffer
+//NOTE: Must be at least 2 because the first stage holds on to one coarse-grained chunk
+#define REORDER_WINDOW 64
+
+//Maximum number of chunks written to the output file with a single system call
+#define WRITEV_CHUNKS 64
+
+//Maximum number of chunks in flight between the input and the output stage of the
+//parallel decoder, bounds the amount of compressed data read ahead
+#define DECODE_QUEUE_SIZE (16*1024)
+
 
 typedef struct {
   char infile[LEN_FILENAME];
   char outfile[LEN_FILENAME];
   int compress_type;
+  int compress_level; //0 selects the default level of the compression type
+  int chunking;
   int preloading;
+  int mmap_input;
   int nthreads;
   int verbose;
 } config_t;
@@ -212,6 +235,10 @@ typedef struct {
 #define COMPRESS_GZIP 0
 #define COMPRESS_BZIP2 1
 #define COMPRESS_NONE 2
+#define COMPRESS_LZ 3
+
+#define CHUNKING_RABIN 0
+#define CHUNKING_GEAR 1
 
 #define UNCOMPRESS_BOUND 10000000
 
@@ -30,10 +30,14 @@
 #include "dedupdef.h"
 #include "encoder.h"
 #include "debug.h"
-#include "hashtable.h"
+#include "chunkindex.h"
 #include "config.h"
 #include "rabin.h"
+#include "gear.h"
 #include "mbuffer.h"
+#include "sha1_mb.h"
+#include "slab.h"
+#include "codec.h"
 
 #ifdef ENABLE_PTHREADS
 #include "queue.h"
@@ -41,14 +45,6 @@
 #include "tree.h"
 #endif //ENABLE_PTHREADS
 
-#ifdef ENABLE_GZIP_COMPRESSION
-#include <zlib.h>
-#endif //ENABLE_GZIP_COMPRESSION
-
-#ifdef ENABLE_BZIP2_COMPRESSION
-#include <bzlib.h>
-#endif //ENABLE_BZIP2_COMPRESSION
-
 #ifdef ENABLE_PTHREADS
 #include <pthread.h>
 #endif //ENABLE_PTHREADS
@@ -64,17 +60,11 @@
 //The configuration block defined in main
 config_t * conf;
 
-//Hash table data structure & utility functions
-struct hashtable *cache;
+//Global index of unique chunks
+static chunkindex_t *cache;
 
-static unsigned int hash_from_key_fn( void *k ) {
-  //NOTE: sha1 sum is integer-aligned
-  return ((unsigned int *)k)[0];
-}
-
-static int keys_equal_fn ( void *key1, void *key2 ) {
-  return (memcmp(key1, key2, SHA1_LEN) == 0);
-}
+//Allocator for chunk_t structures
+static slab_t chunk_slab;
 
 //Arguments to pass to each thread
 struct thread_args {
@@ -84,10 +74,11 @@ struct thread_args {
   int nqueues;
   //file descriptor, first pipeline stage only
   int fd;
-  //input file buffer, first pipeline stage & preloading only
+  //input file buffer, first pipeline stage & preloading or memory-mapped input only
   struct {
     void *buffer;
-    size_t size;
+    size_t size; //with memory-mapped input: number of bytes not yet taken from map
+    mbuffer_t map; //with memory-mapped input: part of the file not yet taken
   } input_file;
 };
 
@@ -112,6 +103,30 @@ typedef struct {
   /* Size distribution & other properties */
   unsigned int nChunks[CHUNK_MAX_NUM]; //Coarse-granular size distribution of data chunks
   unsigned int nDuplicates; //Total number of duplicate blocks
+  unsigned int nStored; //Number of unique blocks stored uncompressed because they did not compress
+
+  /* Chunk index efficiency */
+  chunkindex_stats_t index; //Lookup & probing statistics of the chunk index
+
+  /* Memory allocation */
+  slab_stats_t chunk_alloc; //Allocations of chunk_t structures
+  slab_stats_t mcb_alloc; //Allocations of memory control blocks of the memory buffers
+
+#ifdef ENABLE_PTHREADS
+  /* Synchronization overhead */
+  queue_stats_t queues; //Contention of the queues between the pipeline stages
+
+  /* Fingerprinting */
+  unsigned int nHashBatches; //Number of batches of chunks hashed together in the deduplication stage
+  unsigned int nHashed; //Number of chunks hashed in batches
+
+  /* Reordering & output */
+  unsigned int nReorderMax; //High-water mark of chunks buffered by the reorder stage
+  size_t reorderMaxBytes; //High-water mark of uncompressed data represented by the buffered chunks
+  unsigned int nWindowStalls; //Number of times the fragmentation stage waited for the reorder stage
+  unsigned int nWrites; //Number of system calls to write chunks to the output file
+  unsigned int nWrittenChunks; //Number of chunks written to the output file
+#endif //ENABLE_PTHREADS
 } stats_t;
 
 //Initialize a statistics record
@@ -128,6 +143,20 @@ static void init_stats(stats_t *s) {
     s->nChunks[i] = 0;
   }
   s->nDuplicates = 0;
+  s->nStored = 0;
+  memset(&s->index, 0, sizeof(chunkindex_stats_t));
+  memset(&s->chunk_alloc, 0, sizeof(slab_stats_t));
+  memset(&s->mcb_alloc, 0, sizeof(slab_stats_t));
+#ifdef ENABLE_PTHREADS
+  memset(&s->queues, 0, sizeof(queue_stats_t));
+  s->nHashBatches = 0;
+  s->nHashed = 0;
+  s->nReorderMax = 0;
+  s->reorderMaxBytes = 0;
+  s->nWindowStalls = 0;
+  s->nWrites = 0;
+  s->nWrittenChunks = 0;
+#endif //ENABLE_PTHREADS
 }
 
 #ifdef ENABLE_PTHREADS
@@ -149,9 +178,29 @@ static void merge_stats(stats_t *s1, stats_t *s2) {
     s1->nChunks[i] += s2->nChunks[i];
   }
   s1->nDuplicates += s2->nDuplicates;
+  s1->nStored += s2->nStored;
+  s1->nHashBatches += s2->nHashBatches;
+  s1->nHashed += s2->nHashed;
+  s1->nReorderMax = MAX(s1->nReorderMax, s2->nReorderMax);
+  s1->reorderMaxBytes = MAX(s1->reorderMaxBytes, s2->reorderMaxBytes);
+  s1->nWindowStalls += s2->nWindowStalls;
+  s1->nWrites += s2->nWrites;
+  s1->nWrittenChunks += s2->nWrittenChunks;
 }
 #endif //ENABLE_PTHREADS
 
+//Print allocation statistics of a slab allocator
+static void print_alloc_stats(const char *name, slab_stats_t *a) {
+  char label[32];
+
+  snprintf(label, sizeof(label), "%s allocations:", name);
+  printf("%-30s %14lu (%.2f MB, frees: %lu, objects of %lu bytes)\n", label, (unsigned long)a->nAllocs,
+         (float)(a->nAllocs * a->objsize)/(1024.0*1024.0), (unsigned long)a->nFrees, (unsigned long)a->objsize);
+  snprintf(label, sizeof(label), "%s slabs:", name);
+  printf("%-30s %14lu (%.2f MB, batches returned: %lu, fetched: %lu)\n", label, (unsigned long)a->nSlabs,
+         (float)(a->nBytes)/(1024.0*1024.0), (unsigned long)a->nBatchesReturned, (unsigned long)a->nBatchesFetched);
+}
+
 //Print statistics
 static void print_stats(stats_t *s) {
   const unsigned int unit_str_size = 7; //elements in unit_str array
@@ -198,7 +247,55 @@ static void print_stats(stats_t *s) {
   printf("Amount of duplicate chunks:    %14.2f%%\n", 100.0*(float)(s->nDuplicates)/(float)(nTotalChunks));
   printf("Data size after deduplication: %14.2f %s (compression factor: %.2fx)\n", (float)(s->total_dedup)/(float)(unit_div), unit_str[unit_idx], (float)(s->total_input)/(float)(s->total_dedup));
   printf("Data size after compression:   %14.2f %s (compression factor: %.2fx)\n", (float)(s->total_compressed)/(float)(unit_div), unit_str[unit_idx], (float)(s->total_dedup)/(float)(s->total_compressed));
+  printf("Compression type:              %14s (level: %d, stored uncompressed: %.2f%% of unique chunks)\n", codec_get(conf->compress_type)->name,
+         conf->compress_level > 0 ? conf->compress_level : codec_get(conf->compress_type)->default_level,
+         nTotalChunks > s->nDuplicates ? 100.0*(float)(s->nStored)/(float)(nTotalChunks - s->nDuplicates) : 0.0);
   printf("Output overhead:               %14.2f%%\n", 100.0*(float)(s->total_output-s->total_compressed)/(float)(s->total_output));
+
+  //Efficiency of the chunk index
+  printf("\n");
+  printf("Index lookups:                 %14lu (hit rate: %.2f%%)\n", s->index.nLookups,
+         s->index.nLookups > 0 ? 100.0*(float)(s->index.nHits)/(float)(s->index.nLookups) : 0.0);
+  printf("Index probe length:            %14.2f (max: %lu)\n",
+         s->index.nLookups > 0 ? (float)(s->index.nProbes)/(float)(s->index.nLookups) : 0.0, s->index.maxProbes);
+  printf("Index entries:                 %14lu (load factor: %.2f%%, resizes: %lu)\n", (unsigned long)s->index.nEntries,
+         s->index.nSlots > 0 ? 100.0*(float)(s->index.nEntries)/(float)(s->index.nSlots) : 0.0, s->index.nResizes);
+
+  //Memory allocation of the chunk meta data
+  printf("\n");
+  print_alloc_stats("Chunk", &s->chunk_alloc);
+  print_alloc_stats("MCB", &s->mcb_alloc);
+
+#ifdef ENABLE_PTHREADS
+  //Contention of the pipeline queues
+  printf("\n");
+#ifdef ENABLE_LOCKFREE_QUEUE
+  printf("Queue implementation:          %14s\n", "lock-free");
+#else
+  printf("Queue implementation:          %14s\n", "mutex");
+#endif //ENABLE_LOCKFREE_QUEUE
+  printf("Queue enqueue operations:      %14lu (contended: %.2f%%, waits: %lu)\n", s->queues.nEnqueues,
+         s->queues.nEnqueues > 0 ? 100.0*(float)(s->queues.nEnqueueContended)/(float)(s->queues.nEnqueues) : 0.0, s->queues.nEnqueueWaits);
+  printf("Queue dequeue operations:      %14lu (contended: %.2f%%, waits: %lu)\n", s->queues.nDequeues,
+         s->queues.nDequeues > 0 ? 100.0*(float)(s->queues.nDequeueContended)/(float)(s->queues.nDequeues) : 0.0, s->queues.nDequeueWaits);
+
+  //Batching of the SHA1 computations
+  printf("\n");
+#ifdef ENABLE_SHA1_MB
+  printf("SHA1 implementation:           %14s (%d lanes, %s)\n", "multi-buffer", SHA1_MB_LANES, SHA1_mb_isa());
+#else
+  printf("SHA1 implementation:           %14s\n", "scalar");
+#endif //ENABLE_SHA1_MB
+  printf("SHA1 batches:                  %14u (mean batch size: %.2f chunks)\n", s->nHashBatches,
+         s->nHashBatches > 0 ? (float)(s->nHashed)/(float)(s->nHashBatches) : 0.0);
+
+  //Buffering in the reorder stage
+  printf("\n");
+  printf("Reorder buffer high-water mark:%14u chunks (%.2f MB uncompressed)\n", s->nReorderMax, (float)(s->reorderMaxBytes)/(1024.0*1024.0));
+  printf("Reorder window stalls:         %14u (window: %d coarse chunks)\n", s->nWindowStalls, REORDER_WINDOW);
+  printf("Output write operations:       %14u (mean chunks per write: %.2f)\n", s->nWrites,
+         s->nWrites > 0 ? (float)(s->nWrittenChunks)/(float)(s->nWrites) : 0.0);
+#endif //ENABLE_PTHREADS
 }
 
 //variable with global statistics
@@ -246,6 +343,16 @@ static int create_output_file(char *outfile) {
 
 
 
+/*
+ * Helper function that returns the type of the record with the compressed
+ * data of a chunk. The compression type is only stored with the chunk if it
+ * differs from the one in the file header.
+ */
+static inline u_char compressed_chunk_type(chunk_t *chunk) {
+  if(chunk->header.codec == conf->compress_type) return TYPE_COMPRESS;
+  return TYPE_WITH_CODEC(TYPE_COMPRESS, chunk->header.codec);
+}
+
 /*
  * Helper function that writes a chunk to an output file depending on
  * its state. The function will write the SHA1 sum if the chunk has
@@ -272,7 +379,7 @@ static void write_chunk_to_file(int fd, chunk_t *chunk) {
   //state is now guaranteed to be either COMPRESSED or FLUSHED
   if(chunk->header.state == CHUNK_STATE_COMPRESSED) {
     //Chunk data has not been written yet, do so now
-    write_file(fd, TYPE_COMPRESS, chunk->compressed_data.n, chunk->compressed_data.ptr);
+    write_file(fd, compressed_chunk_type(chunk), chunk->compressed_data.n, chunk->compressed_data.ptr);
     mbuffer_free(&chunk->compressed_data);
     chunk->header.state = CHUNK_STATE_FLUSHED;
   } else {
@@ -289,7 +396,7 @@ static void write_chunk_to_file(int fd, chunk_t *chunk) {
 
   if(!chunk->header.isDuplicate) {
     //Unique chunk, data has not been written yet, do so now
-    write_file(fd, TYPE_COMPRESS, chunk->compressed_data.n, chunk->compressed_data.ptr);
+    write_file(fd, compressed_chunk_type(chunk), chunk->compressed_data.n, chunk->compressed_data.ptr);
     mbuffer_free(&chunk->compressed_data);
   } else {
     //Duplicate chunk, data has been written to file before, just write SHA1
@@ -298,9 +405,194 @@ static void write_chunk_to_file(int fd, chunk_t *chunk) {
 }
 #endif //ENABLE_PTHREADS
 
+#ifdef ENABLE_PTHREADS
+/*
+ * Output buffer of the reorder stage
+ *
+ * Collects the records of consecutive chunks so they can be written to
+ * the output file with a single writev call. The compressed data is not
+ * copied, so it is only freed after the records have been written.
+ */
+typedef struct {
+  int fd;
+  int n; //number of records in the buffer
+  u_char type[WRITEV_CHUNKS];
+  u_long len[WRITEV_CHUNKS];
+  struct iovec iov[3*WRITEV_CHUNKS];
+  int nbuffers;
+  mbuffer_t buffers[WRITEV_CHUNKS]; //compressed data to free once it has been written
+  unsigned int nWrites; //number of writev calls
+  unsigned int nWrittenChunks; //number of records written
+} write_batch_t;
+
+static void write_batch_init(write_batch_t *b, int fd) {
+  b->fd = fd;
+  b->n = 0;
+  b->nbuffers = 0;
+  b->nWrites = 0;
+  b->nWrittenChunks = 0;
+}
+
+//Write all buffered records to the output file
+static void write_batch_flush(write_batch_t *b) {
+  int i;
+
+  if(b->n == 0) return;
+  if(xwritev(b->fd, b->iov, 3*b->n) < 0) {
+    EXIT_TRACE("xwritev fails\n");
+  }
+  for(i=0; i<b->nbuffers; i++) {
+    mbuffer_free(&b->buffers[i]);
+  }
+  b->nWrites++;
+  b->nWrittenChunks += b->n;
+  b->n = 0;
+  b->nbuffers = 0;
+}
+
+//Append a record with the same format as write_file
+static void write_batch_add(write_batch_t *b, u_char type, u_long len, u_char *content) {
+  struct iovec *iov = &b->iov[3*b->n];
+
+  b->type[b->n] = type;
+  b->len[b->n] = len;
+  iov[0].iov_base = &b->type[b->n];
+  iov[0].iov_len = sizeof(u_char);
+  iov[1].iov_base = &b->len[b->n];
+  iov[1].iov_len = sizeof(u_long);
+  iov[2].iov_base = content;
+  iov[2].iov_len = len;
+  b->n++;
+}
+
+/*
+ * Same as write_chunk_to_file, but appends the chunk to an output buffer.
+ * The buffer is written to the file once it is full.
+ */
+static void write_chunk_to_batch(write_batch_t *b, chunk_t *chunk) {
+  assert(chunk!=NULL);
+
+  //Find original chunk
+  if(chunk->header.isDuplicate) chunk = chunk->compressed_data_ref;
+
+  pthread_mutex_lock(&chunk->header.lock);
+  while(chunk->header.state == CHUNK_STATE_UNCOMPRESSED) {
+    pthread_cond_wait(&chunk->header.update, &chunk->header.lock);
+  }
+
+  //state is now guaranteed to be either COMPRESSED or FLUSHED
+  if(chunk->header.state == CHUNK_STATE_COMPRESSED) {
+    //Chunk data has not been written yet, do so now
+    write_batch_add(b, compressed_chunk_type(chunk), chunk->compressed_data.n, chunk->compressed_data.ptr);
+    b->buffers[b->nbuffers++] = chunk->compressed_data;
+    chunk->header.state = CHUNK_STATE_FLUSHED;
+  } else {
+    //Chunk data has been written to file before, just write SHA1
+    //NOTE: The SHA1 sum belongs to the original chunk, which stays alive until the end
+    write_batch_add(b, TYPE_FINGERPRINT, SHA1_LEN, (unsigned char *)(chunk->sha1));
+  }
+  pthread_mutex_unlock(&chunk->header.lock);
+
+  if(b->n == WRITEV_CHUNKS) write_batch_flush(b);
+}
+
+/*
+ * Flow control between the first and the last pipeline stage
+ *
+ * The reorder stage has to buffer every chunk that arrives before its
+ * predecessors, which can be a lot of data if one thread falls behind.
+ * To bound the amount of buffered data the fragmentation stage may only
+ * start a new coarse-grained chunk if it is less than REORDER_WINDOW
+ * coarse-grained chunks ahead of the output.
+ */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t advance;
+  sequence_number_t written; //all coarse-grained chunks with a lower L1 number have been written
+  int waiting; //whether the fragmentation stage waits for the reorder stage
+  unsigned int nStalls; //number of times the fragmentation stage had to wait
+} reorder_window;
+
+static void reorder_window_init() {
+  pthread_mutex_init(&reorder_window.lock, NULL);
+  pthread_cond_init(&reorder_window.advance, NULL);
+  reorder_window.written = 0;
+  reorder_window.waiting = 0;
+  reorder_window.nStalls = 0;
+}
+
+static void reorder_window_destroy() {
+  pthread_mutex_destroy(&reorder_window.lock);
+  pthread_cond_destroy(&reorder_window.advance);
+}
+
+//Block until the coarse-grained chunk with L1 number l1num may be created
+//NOTE: The caller must have sent all coarse-grained chunks before l1num-1 down the pipeline
+static void reorder_window_wait(sequence_number_t l1num) {
+  pthread_mutex_lock(&reorder_window.lock);
+  if(l1num >= reorder_window.written + REORDER_WINDOW) {
+    reorder_window.nStalls++;
+    reorder_window.waiting = 1;
+    while(l1num >= reorder_window.written + REORDER_WINDOW) {
+      pthread_cond_wait(&reorder_window.advance, &reorder_window.lock);
+    }
+    reorder_window.waiting = 0;
+  }
+  pthread_mutex_unlock(&reorder_window.lock);
+}
+
+//Signal that all coarse-grained chunks before L1 number l1num have been written
+static void reorder_window_advance(sequence_number_t l1num) {
+  pthread_mutex_lock(&reorder_window.lock);
+  reorder_window.written = l1num;
+  if(reorder_window.waiting) pthread_cond_signal(&reorder_window.advance);
+  pthread_mutex_unlock(&reorder_window.lock);
+}
+#endif //ENABLE_PTHREADS
+
+/*
+ * Helper function for the first pipeline stage that takes the next block of
+ * at most MAXBUF bytes from the memory-mapped input file. If `append' is set
+ * the block is appended to `m', which must hold the data directly preceding
+ * the block, otherwise `m' is initialized with the block. No data is copied.
+ * Returns the number of bytes taken from the file.
+ */
+static size_t take_mapped_block(struct thread_args *args, mbuffer_t *m, int append) {
+  size_t n = MIN(MAXBUF, args->input_file.size);
+  mbuffer_t block, rest;
+  int r;
+
+  if(n == 0) return 0;
+  block = args->input_file.map;
+  if(n < args->input_file.size) {
+    r = mbuffer_split(&block, &rest, n);
+    if(r!=0) EXIT_TRACE("Unable to split memory buffer.\n");
+    args->input_file.map = rest;
+  }
+  args->input_file.size -= n;
+
+  if(append) {
+    r = mbuffer_merge(m, &block);
+    if(r!=0) EXIT_TRACE("Unable to merge memory buffers.\n");
+  } else {
+    *m = block;
+  }
+  return n;
+}
+
 int rf_win;
 int rf_win_dataprocess;
 
+/*
+ * Helper function that finds the next anchor in a buffer with the
+ * chunking algorithm selected by the user. Returns the offset of the
+ * anchor or n if there is none.
+ */
+static inline int segment(uchar *p, int n, int winlen, u32int *rabintab, u32int *rabinwintab) {
+  if(conf->chunking == CHUNKING_GEAR) return gearseg(p, n);
+  return rabinseg(p, n, winlen, rabintab, rabinwintab);
+}
+
 /*
  * Computational kernel of compression stage
  *
@@ -308,6 +600,7 @@ int rf_win_dataprocess;
  *  - Compress a data chunk
  */
 void sub_Compress(chunk_t *chunk) {
+    const codec_t *codec;
     size_t n;
     int r;
 
@@ -317,62 +610,30 @@ void sub_Compress(chunk_t *chunk) {
     pthread_mutex_lock(&chunk->header.lock);
     assert(chunk->header.state == CHUNK_STATE_UNCOMPRESSED);
 #endif //ENABLE_PTHREADS
-    switch (conf->compress_type) {
-      case COMPRESS_NONE:
-        //Simply duplicate the data
-        n = chunk->uncompressed_data.n;
-        r = mbuffer_create(&chunk->compressed_data, n);
-        if(r != 0) {
-          EXIT_TRACE("Creation of compression buffer failed.\n");
-        }
-        //copy the block
-        memcpy(chunk->compressed_data.ptr, chunk->uncompressed_data.ptr, chunk->uncompressed_data.n);
-        break;
-#ifdef ENABLE_GZIP_COMPRESSION
-      case COMPRESS_GZIP:
-        //Gzip compression buffer must be at least 0.1% larger than source buffer plus 12 bytes
-        n = chunk->uncompressed_data.n + (chunk->uncompressed_data.n >> 9) + 12;
-        r = mbuffer_create(&chunk->compressed_data, n);
-        if(r != 0) {
-          EXIT_TRACE("Creation of compression buffer failed.\n");
-        }
-        //compress the block
-        r = compress(chunk->compressed_data.ptr, &n, chunk->uncompressed_data.ptr, chunk->uncompressed_data.n);
-        if (r != Z_OK) {
-          EXIT_TRACE("Compression failed\n");
-        }
-        //Shrink buffer to actual size
-        if(n < chunk->compressed_data.n) {
-          r = mbuffer_realloc(&chunk->compressed_data, n);
-          assert(r == 0);
-        }
-        break;
-#endif //ENABLE_GZIP_COMPRESSION
-#ifdef ENABLE_BZIP2_COMPRESSION
-      case COMPRESS_BZIP2:
-        //Bzip compression buffer must be at least 1% larger than source buffer plus 600 bytes
-        n = chunk->uncompressed_data.n + (chunk->uncompressed_data.n >> 6) + 600;
-        r = mbuffer_create(&chunk->compressed_data, n);
-        if(r != 0) {
-          EXIT_TRACE("Creation of compression buffer failed.\n");
-        }
-        //compress the block
-        unsigned int int_n = n;
-        r = BZ2_bzBuffToBuffCompress(chunk->compressed_data.ptr, &int_n, chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, 9, 0, 30);
-        n = int_n;
-        if (r != BZ_OK) {
-          EXIT_TRACE("Compression failed\n");
-        }
-        //Shrink buffer to actual size
-        if(n < chunk->compressed_data.n) {
-          r = mbuffer_realloc(&chunk->compressed_data, n);
-          assert(r == 0);
-        }
-        break;
-#endif //ENABLE_BZIP2_COMPRESSION
-      default:
-        EXIT_TRACE("Compression type not implemented.\n");
-        break;
+    codec = codec_get(conf->compress_type);
+    if(codec == NULL) {
+      EXIT_TRACE("Compression type not implemented.\n");
+    }
+    n = codec->bound(chunk->uncompressed_data.n);
+    r = mbuffer_create(&chunk->compressed_data, n);
+    if(r != 0) {
+      EXIT_TRACE("Creation of compression buffer failed.\n");
+    }
+    //compress the block
+    n = codec->compress(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, chunk->compressed_data.ptr, chunk->compressed_data.n,
+                        conf->compress_level > 0 ? conf->compress_level : codec->default_level);
+    chunk->header.codec = conf->compress_type;
+    //Store data which cannot be compressed as it is, the chunk type tells the decoder
+    //NOTE: The bound of every codec is at least the size of the input
+    if(n == 0 || n >= chunk->uncompressed_data.n) {
+      n = chunk->uncompressed_data.n;
+      memcpy(chunk->compressed_data.ptr, chunk->uncompressed_data.ptr, n);
+      chunk->header.codec = COMPRESS_NONE;
+    }
+    //Shrink buffer to actual size
+    if(n < chunk->compressed_data.n) {
+      r = mbuffer_realloc(&chunk->compressed_data, n);
+      assert(r == 0);
     }
     mbuffer_free(&chunk->uncompressed_data);
 
@@ -416,7 +677,15 @@ void *Compress(void * targs) {
   while(1) {
     //get items from the queue
     if (ringbuffer_isEmpty(&recv_buf)) {
-      r = queue_dequeue(&compress_que[qid], &recv_buf, ITEM_PER_FETCH);
+      r = queue_trydequeue(&compress_que[qid], &recv_buf, ITEM_PER_FETCH);
+      if (r == 0) {
+        //Pass on left over items before waiting, the reorder window might depend on them
+        while (!ringbuffer_isEmpty(&send_buf)) {
+          r = queue_enqueue(&reorder_que[qid], &send_buf, ITEM_PER_INSERT);
+          assert(r>=1);
+        }
+        r = queue_dequeue(&compress_que[qid], &recv_buf, ITEM_PER_FETCH);
+      }
       if (r < 0) break;
     }
 
@@ -428,6 +697,7 @@ void *Compress(void * targs) {
 
 #ifdef ENABLE_STATISTICS
     thread_stats->total_compressed += chunk->compressed_data.n;
+    thread_stats->nStored += (chunk->header.codec == COMPRESS_NONE && conf->compress_type != COMPRESS_NONE);
 #endif //ENABLE_STATISTICS
 
     r = ringbuffer_insert(&send_buf, chunk);
@@ -463,58 +733,102 @@ void *Compress(void * targs) {
 
 
 /*
- * Computational kernel of deduplication stage
+ * Database part of the computational kernel of deduplication stage
  *
  * Actions performed:
- *  - Calculate SHA1 signature for each incoming data chunk
  *  - Perform database lookup to determine chunk redundancy status
  *  - On miss add chunk to database
  *  - Returns chunk redundancy status
+ *
+ * The SHA1 signature of the chunk must have been computed already.
  */
-int sub_Deduplicate(chunk_t *chunk) {
+static int sub_Deduplicate_hashed(chunk_t *chunk) {
   int isDuplicate;
   chunk_t *entry;
 
   assert(chunk!=NULL);
   assert(chunk->uncompressed_data.ptr!=NULL);
 
-  SHA1_Digest(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
-
   //Query database to determine whether we've seen the data chunk before
+  //On a miss the chunk gets added and will be visible to other threads
+  //immediately, so it must be ready for concurrent accesses before the lookup
+  chunk->header.isDuplicate = FALSE;
 #ifdef ENABLE_PTHREADS
-  pthread_mutex_t *ht_lock = hashtable_getlock(cache, (void *)(chunk->sha1));
-  pthread_mutex_lock(ht_lock);
+  pthread_mutex_init(&chunk->header.lock, NULL);
+  pthread_cond_init(&chunk->header.update, NULL);
 #endif
-  entry = (chunk_t *)hashtable_search(cache, (void *)(chunk->sha1));
+  //NOTE: chunk->compressed_data.buffer will be computed in compression stage
+  entry = chunkindex_insert_unique(cache, chunk);
   isDuplicate = (entry != NULL);
-  chunk->header.isDuplicate = isDuplicate;
-  if (!isDuplicate) {
-    // Cache miss: Create entry in hash table and forward data to compression stage
+  if (isDuplicate) {
+    // Cache hit: Skipping compression stage
 #ifdef ENABLE_PTHREADS
-    pthread_mutex_init(&chunk->header.lock, NULL);
-    pthread_cond_init(&chunk->header.update, NULL);
+    pthread_mutex_destroy(&chunk->header.lock);
+    pthread_cond_destroy(&chunk->header.update);
 #endif
-    //NOTE: chunk->compressed_data.buffer will be computed in compression stage
-    if (hashtable_insert(cache, (void *)(chunk->sha1), (void *)chunk) == 0) {
-      EXIT_TRACE("hashtable_insert failed");
-    }
-  } else {
-    // Cache hit: Skipping compression stage
+    chunk->header.isDuplicate = TRUE;
     chunk->compressed_data_ref = entry;
     mbuffer_free(&chunk->uncompressed_data);
   }
-#ifdef ENABLE_PTHREADS
-  pthread_mutex_unlock(ht_lock);
-#endif
 
   return isDuplicate;
 }
 
+/*
+ * Computational kernel of deduplication stage
+ *
+ * Actions performed:
+ *  - Calculate SHA1 signature for each incoming data chunk
+ *  - Perform database lookup to determine chunk redundancy status
+ *  - On miss add chunk to database
+ *  - Returns chunk redundancy status
+ */
+int sub_Deduplicate(chunk_t *chunk) {
+  assert(chunk!=NULL);
+  assert(chunk->uncompressed_data.ptr!=NULL);
+
+  SHA1_Digest(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, (unsigned char *)(chunk->sha1));
+  return sub_Deduplicate_hashed(chunk);
+}
+
+#ifdef ENABLE_PTHREADS
+/*
+ * Calculate the SHA1 signatures of a batch of data chunks
+ *
+ * With ENABLE_SHA1_MB the chunks are hashed in parallel with the multi-buffer
+ * SHA1 implementation, otherwise one after another.
+ */
+static void sub_Deduplicate_hash_batch(chunk_t **chunks, int n) {
+  int i;
+
+#ifdef ENABLE_SHA1_MB
+  const void *data[CHUNK_ANCHOR_PER_FETCH];
+  size_t len[CHUNK_ANCHOR_PER_FETCH];
+  unsigned char *digest[CHUNK_ANCHOR_PER_FETCH];
+
+  assert(n <= CHUNK_ANCHOR_PER_FETCH);
+  for(i=0; i<n; i++) {
+    assert(chunks[i]->uncompressed_data.ptr!=NULL);
+    data[i] = chunks[i]->uncompressed_data.ptr;
+    len[i] = chunks[i]->uncompressed_data.n;
+    digest[i] = (unsigned char *)(chunks[i]->sha1);
+  }
+  SHA1_Digest_mb(data, len, digest, n);
+#else
+  for(i=0; i<n; i++) {
+    assert(chunks[i]->uncompressed_data.ptr!=NULL);
+    SHA1_Digest(chunks[i]->uncompressed_data.ptr, chunks[i]->uncompressed_data.n, (unsigned char *)(chunks[i]->sha1));
+  }
+#endif //ENABLE_SHA1_MB
+}
+#endif //ENABLE_PTHREADS
+
 /*
  * Pipeline stage function of deduplication stage
  *
  * Actions performed:
  *  - Take input data from fragmentation stages
+ *  - Calculate SHA1 signatures for each fetched group of data chunks at once
  *  - Execute deduplication kernel for each data chunk
  *  - Route resulting package either to compression stage or to reorder stage, depending on deduplication status
  */
@@ -523,6 +837,8 @@ void * Deduplicate(void * targs) {
   struct thread_args *args = (struct thread_args *)targs;
   const int qid = args->tid / MAX_THREADS_PER_QUEUE;
   chunk_t *chunk;
+  chunk_t *batch[CHUNK_ANCHOR_PER_FETCH];
+  int nbatch, i;
   int r;
 
   ringbuffer_t recv_buf, send_buf_reorder, send_buf_compress;
@@ -542,41 +858,61 @@ void * Deduplicate(void * targs) {
   assert(r==0);
 
   while (1) {
-    //if no items available, fetch a group of items from the queue
-    if (ringbuffer_isEmpty(&recv_buf)) {
+    //fetch a group of items from the queue and fingerprint them together
+    r = queue_trydequeue(&deduplicate_que[qid], &recv_buf, CHUNK_ANCHOR_PER_FETCH);
+    if (r == 0) {
+      //Pass on left over items before waiting, the reorder window might depend on them
+      while (!ringbuffer_isEmpty(&send_buf_compress)) {
+        r = queue_enqueue(&compress_que[qid], &send_buf_compress, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
+      while (!ringbuffer_isEmpty(&send_buf_reorder)) {
+        r = queue_enqueue(&reorder_que[qid], &send_buf_reorder, ITEM_PER_INSERT);
+        assert(r>=1);
+      }
       r = queue_dequeue(&deduplicate_que[qid], &recv_buf, CHUNK_ANCHOR_PER_FETCH);
-      if (r < 0) break;
     }
+    if (r < 0) break;
+    nbatch = 0;
+    while (!ringbuffer_isEmpty(&recv_buf)) {
+      batch[nbatch++] = (chunk_t *)ringbuffer_remove(&recv_buf);
+      assert(batch[nbatch-1]!=NULL);
+    }
+    sub_Deduplicate_hash_batch(batch, nbatch);
+#ifdef ENABLE_STATISTICS
+    thread_stats->nHashBatches++;
+    thread_stats->nHashed += nbatch;
+#endif //ENABLE_STATISTICS
 
-    //get one chunk
-    chunk = (chunk_t *)ringbuffer_remove(&recv_buf);
-    assert(chunk!=NULL);
+    for (i=0; i<nbatch; i++) {
+      chunk = batch[i];
 
-    //Do the processing
-    int isDuplicate = sub_Deduplicate(chunk);
+      //Do the processing
+      int isDuplicate = sub_Deduplicate_hashed(chunk);
 
 #ifdef ENABLE_STATISTICS
-    if(isDuplicate) {
-      thread_stats->nDuplicates++;
-    } else {
-      thread_stats->total_dedup += chunk->uncompressed_data.n;
-    }
+      if(isDuplicate) {
+        thread_stats->nDuplicates++;
+      } else {
+        thread_stats->total_dedup += chunk->uncompressed_data.n;
+      }
 #endif //ENABLE_STATISTICS
 
-    //Enqueue chunk either into compression queue or into send queue
-    if(!isDuplicate) {
-      r = ringbuffer_insert(&send_buf_compress, chunk);
-      assert(r==0);
-      if (ringbuffer_isFull(&send_buf_compress)) {
-        r = queue_enqueue(&compress_que[qid], &send_buf_compress, ITEM_PER_INSERT);
-        assert(r>=1);
-      }
-    } else {
-      r = ringbuffer_insert(&send_buf_reorder, chunk);
-      assert(r==0);
-      if (ringbuffer_isFull(&send_buf_reorder)) {
-        r = queue_enqueue(&reorder_que[qid], &send_buf_reorder, ITEM_PER_INSERT);
-        assert(r>=1);
+      //Enqueue chunk either into compression queue or into send queue
+      if(!isDuplicate) {
+        r = ringbuffer_insert(&send_buf_compress, chunk);
+        assert(r==0);
+        if (ringbuffer_isFull(&send_buf_compress)) {
+          r = queue_enqueue(&compress_que[qid], &send_buf_compress, ITEM_PER_INSERT);
+          assert(r>=1);
+        }
+      } else {
+        r = ringbuffer_insert(&send_buf_reorder, chunk);
+        assert(r==0);
+        if (ringbuffer_isFull(&send_buf_reorder)) {
+          r = queue_enqueue(&reorder_que[qid], &send_buf_reorder, ITEM_PER_INSERT);
+          assert(r>=1);
+        }
       }
     }
   }
@@ -648,7 +984,15 @@ void *FragmentRefine(void * targs) {
   while (TRUE) {
     //if no item for process, get a group of items from the pipeline
     if (ringbuffer_isEmpty(&recv_buf)) {
-      r = queue_dequeue(&refine_que[qid], &recv_buf, MAX_PER_FETCH);
+      r = queue_trydequeue(&refine_que[qid], &recv_buf, MAX_PER_FETCH);
+      if (r == 0) {
+        //Pass on left over items before waiting, the reorder window might depend on them
+        while(!ringbuffer_isEmpty(&send_buf)) {
+          r = queue_enqueue(&deduplicate_que[qid], &send_buf, CHUNK_ANCHOR_PER_INSERT);
+          assert(r>=1);
+        }
+        r = queue_dequeue(&refine_que[qid], &recv_buf, MAX_PER_FETCH);
+      }
       if (r < 0) {
         break;
       }
@@ -664,11 +1008,11 @@ void *FragmentRefine(void * targs) {
     sequence_number_t chcount = 0;
     do {
       //Find next anchor with Rabin fingerprint
-      int offset = rabinseg(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
+      int offset = segment(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win, rabintab, rabinwintab);
       //Can we split the buffer?
       if(offset < chunk->uncompressed_data.n) {
         //Allocate a new chunk and create a new memory buffer
-        temp = (chunk_t *)malloc(sizeof(chunk_t));
+        temp = (chunk_t *)slab_alloc(&chunk_slab);
         if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
         temp->header.state = chunk->header.state;
         temp->sequence.l1num = chunk->sequence.l1num;
@@ -783,64 +1127,80 @@ void *SerialIntegratedPipeline(void * targs) {
       bytes_left = 0;
     }
 
-    //Make sure that system supports new buffer size
-    if(MAXBUF+bytes_left > SSIZE_MAX) {
-      EXIT_TRACE("Input buffer size exceeds system maximum.\n");
-    }
-    //Allocate a new chunk and create a new memory buffer
-    chunk = (chunk_t *)malloc(sizeof(chunk_t));
-    if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
-    r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
-    if(r!=0) {
-      EXIT_TRACE("Unable to initialize memory buffer.\n");
-    }
-    chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
-    if(bytes_left > 0) {
-      //FIXME: Short-circuit this if no more data available
-
-      //"Extension" of existing buffer, copy sequence number and left over data to beginning of new buffer
-      //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
-      memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
-      mbuffer_free(&temp->uncompressed_data);
-      free(temp);
-      temp = NULL;
-    }
-    //Read data until buffer full
     size_t bytes_read=0;
-    if(conf->preloading) {
-      size_t max_read = MIN(MAXBUF, args->input_file.size-preloading_buffer_seek);
-      memcpy(chunk->uncompressed_data.ptr+bytes_left, args->input_file.buffer+preloading_buffer_seek, max_read);
-      bytes_read = max_read;
-      preloading_buffer_seek += max_read;
+    if(conf->mmap_input) {
+      //Nothing left over from last iteration and end of file reached, quit
+      if(bytes_left == 0 && args->input_file.size == 0) break;
+      if(bytes_left > 0) {
+        //"Extension" of existing buffer, the next block of the mapped file directly follows the left over data
+        chunk = temp;
+        temp = NULL;
+        bytes_read = take_mapped_block(args, &chunk->uncompressed_data, TRUE);
+      } else {
+        chunk = (chunk_t *)slab_alloc(&chunk_slab);
+        if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        bytes_read = take_mapped_block(args, &chunk->uncompressed_data, FALSE);
+      }
     } else {
-      while(bytes_read < MAXBUF) {
-        r = read(fd, chunk->uncompressed_data.ptr+bytes_left+bytes_read, MAXBUF-bytes_read);
-        if(r<0) switch(errno) {
-          case EAGAIN:
-            EXIT_TRACE("I/O error: No data available\n");break;
-          case EBADF:
-            EXIT_TRACE("I/O error: Invalid file descriptor\n");break;
-          case EFAULT:
-            EXIT_TRACE("I/O error: Buffer out of range\n");break;
-          case EINTR:
-            EXIT_TRACE("I/O error: Interruption\n");break;
-          case EINVAL:
-            EXIT_TRACE("I/O error: Unable to read from file descriptor\n");break;
-          case EIO:
-            EXIT_TRACE("I/O error: Generic I/O error\n");break;
-          case EISDIR:
-            EXIT_TRACE("I/O error: Cannot read from a directory\n");break;
-          default:
-            EXIT_TRACE("I/O error: Unrecognized error\n");break;
+      //Make sure that system supports new buffer size
+      if(MAXBUF+bytes_left > SSIZE_MAX) {
+        EXIT_TRACE("Input buffer size exceeds system maximum.\n");
+      }
+      //Allocate a new chunk and create a new memory buffer
+      chunk = (chunk_t *)slab_alloc(&chunk_slab);
+      if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+      r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
+      if(r!=0) {
+        EXIT_TRACE("Unable to initialize memory buffer.\n");
+      }
+      chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+      if(bytes_left > 0) {
+        //FIXME: Short-circuit this if no more data available
+
+        //"Extension" of existing buffer, copy sequence number and left over data to beginning of new buffer
+        //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
+        memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
+        mbuffer_free(&temp->uncompressed_data);
+        slab_free(&chunk_slab, temp);
+        temp = NULL;
+      }
+      //Read data until buffer full
+      if(conf->preloading) {
+        size_t max_read = MIN(MAXBUF, args->input_file.size-preloading_buffer_seek);
+        memcpy(chunk->uncompressed_data.ptr+bytes_left, args->input_file.buffer+preloading_buffer_seek, max_read);
+        bytes_read = max_read;
+        preloading_buffer_seek += max_read;
+      } else {
+        while(bytes_read < MAXBUF) {
+          r = read(fd, chunk->uncompressed_data.ptr+bytes_left+bytes_read, MAXBUF-bytes_read);
+          if(r<0) switch(errno) {
+            case EAGAIN:
+              EXIT_TRACE("I/O error: No data available\n");break;
+            case EBADF:
+              EXIT_TRACE("I/O error: Invalid file descriptor\n");break;
+            case EFAULT:
+              EXIT_TRACE("I/O error: Buffer out of range\n");break;
+            case EINTR:
+              EXIT_TRACE("I/O error: Interruption\n");break;
+            case EINVAL:
+              EXIT_TRACE("I/O error: Unable to read from file descriptor\n");break;
+            case EIO:
+              EXIT_TRACE("I/O error: Generic I/O error\n");break;
+            case EISDIR:
+              EXIT_TRACE("I/O error: Cannot read from a directory\n");break;
+            default:
+              EXIT_TRACE("I/O error: Unrecognized error\n");break;
+          }
+          if(r==0) break;
+          bytes_read += r;
         }
-        if(r==0) break;
-        bytes_read += r;
       }
     }
     //No data left over from last iteration and also nothing new read in, simply clean up and quit
     if(bytes_left + bytes_read == 0) {
       mbuffer_free(&chunk->uncompressed_data);
-      free(chunk);
+      slab_free(&chunk_slab, chunk);
       chunk = NULL;
       break;
     }
@@ -872,12 +1232,13 @@ void *SerialIntegratedPipeline(void * targs) {
         sub_Compress(chunk);
 #ifdef ENABLE_STATISTICS
         stats.total_compressed += chunk->compressed_data.n;
+        stats.nStored += (chunk->header.codec == COMPRESS_NONE && conf->compress_type != COMPRESS_NONE);
 #endif //ENABLE_STATISTICS
       }
 
       write_chunk_to_file(fd_out, chunk);
       if(chunk->header.isDuplicate) {
-        free(chunk);
+        slab_free(&chunk_slab, chunk);
         chunk=NULL;
       }
 
@@ -890,7 +1251,7 @@ void *SerialIntegratedPipeline(void * targs) {
     do {
       split = 0;
       //Try to split the buffer
-      int offset = rabinseg(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win_dataprocess, rabintab, rabinwintab);
+      int offset = segment(chunk->uncompressed_data.ptr, chunk->uncompressed_data.n, rf_win_dataprocess, rabintab, rabinwintab);
       //Did we find a split location?
       if(offset == 0) {
         //Split found at the very beginning of the buffer (should never happen due to technical limitations)
@@ -899,7 +1260,7 @@ void *SerialIntegratedPipeline(void * targs) {
       } else if(offset < chunk->uncompressed_data.n) {
         //Split found somewhere in the middle of the buffer
         //Allocate a new chunk and create a new memory buffer
-        temp = (chunk_t *)malloc(sizeof(chunk_t));
+        temp = (chunk_t *)slab_alloc(&chunk_slab);
         if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
 
         //split it into two pieces
@@ -927,12 +1288,13 @@ void *SerialIntegratedPipeline(void * targs) {
           sub_Compress(chunk);
 #ifdef ENABLE_STATISTICS
           stats.total_compressed += chunk->compressed_data.n;
+          stats.nStored += (chunk->header.codec == COMPRESS_NONE && conf->compress_type != COMPRESS_NONE);
 #endif //ENABLE_STATISTICS
         }
 
         write_chunk_to_file(fd_out, chunk);
         if(chunk->header.isDuplicate){
-          free(chunk);
+          slab_free(&chunk_slab, chunk);
           chunk=NULL;
         }
 
@@ -1018,71 +1380,94 @@ void *Fragment(void * targs){
       bytes_left = 0;
     }
 
-    //Make sure that system supports new buffer size
-    if(MAXBUF+bytes_left > SSIZE_MAX) {
-      EXIT_TRACE("Input buffer size exceeds system maximum.\n");
-    }
-    //Allocate a new chunk and create a new memory buffer
-    chunk = (chunk_t *)malloc(sizeof(chunk_t));
-    if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
-    r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
-    if(r!=0) {
-      EXIT_TRACE("Unable to initialize memory buffer.\n");
-    }
-    if(bytes_left > 0) {
-      //FIXME: Short-circuit this if no more data available
-
-      //"Extension" of existing buffer, copy sequence number and left over data to beginning of new buffer
-      chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
-      chunk->sequence.l1num = temp->sequence.l1num;
-
-      //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
-      memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
-      mbuffer_free(&temp->uncompressed_data);
-      free(temp);
-      temp = NULL;
-    } else {
-      //brand new mbuffer, increment sequence number
-      chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
-      chunk->sequence.l1num = anchorcount;
-      anchorcount++;
-    }
-    //Read data until buffer full
     size_t bytes_read=0;
-    if(conf->preloading) {
-      size_t max_read = MIN(MAXBUF, args->input_file.size-preloading_buffer_seek);
-      memcpy(chunk->uncompressed_data.ptr+bytes_left, args->input_file.buffer+preloading_buffer_seek, max_read);
-      bytes_read = max_read;
-      preloading_buffer_seek += max_read;
+    if(conf->mmap_input) {
+      //Nothing left over from last iteration and end of file reached, quit
+      if(bytes_left == 0 && args->input_file.size == 0) break;
+      if(bytes_left > 0) {
+        //"Extension" of existing buffer, the next block of the mapped file directly follows the left over data
+        chunk = temp;
+        temp = NULL;
+        bytes_read = take_mapped_block(args, &chunk->uncompressed_data, TRUE);
+      } else {
+        //brand new mbuffer, increment sequence number
+        chunk = (chunk_t *)slab_alloc(&chunk_slab);
+        if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        //Respect the reorder window before starting a new coarse-grained chunk
+        reorder_window_wait(anchorcount);
+        chunk->sequence.l1num = anchorcount;
+        anchorcount++;
+        bytes_read = take_mapped_block(args, &chunk->uncompressed_data, FALSE);
+      }
     } else {
-      while(bytes_read < MAXBUF) {
-        r = read(fd, chunk->uncompressed_data.ptr+bytes_left+bytes_read, MAXBUF-bytes_read);
-        if(r<0) switch(errno) {
-          case EAGAIN:
-            EXIT_TRACE("I/O error: No data available\n");break;
-          case EBADF:
-            EXIT_TRACE("I/O error: Invalid file descriptor\n");break;
-          case EFAULT:
-            EXIT_TRACE("I/O error: Buffer out of range\n");break;
-          case EINTR:
-            EXIT_TRACE("I/O error: Interruption\n");break;
-          case EINVAL:
-            EXIT_TRACE("I/O error: Unable to read from file descriptor\n");break;
-          case EIO:
-            EXIT_TRACE("I/O error: Generic I/O error\n");break;
-          case EISDIR:
-            EXIT_TRACE("I/O error: Cannot read from a directory\n");break;
-          default:
-            EXIT_TRACE("I/O error: Unrecognized error\n");break;
+      //Make sure that system supports new buffer size
+      if(MAXBUF+bytes_left > SSIZE_MAX) {
+        EXIT_TRACE("Input buffer size exceeds system maximum.\n");
+      }
+      //Allocate a new chunk and create a new memory buffer
+      chunk = (chunk_t *)slab_alloc(&chunk_slab);
+      if(chunk==NULL) EXIT_TRACE("Memory allocation failed.\n");
+      r = mbuffer_create(&chunk->uncompressed_data, MAXBUF+bytes_left);
+      if(r!=0) {
+        EXIT_TRACE("Unable to initialize memory buffer.\n");
+      }
+      if(bytes_left > 0) {
+        //FIXME: Short-circuit this if no more data available
+
+        //"Extension" of existing buffer, copy sequence number and left over data to beginning of new buffer
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        chunk->sequence.l1num = temp->sequence.l1num;
+
+        //NOTE: We cannot safely extend the current memory region because it has already been given to another thread
+        memcpy(chunk->uncompressed_data.ptr, temp->uncompressed_data.ptr, temp->uncompressed_data.n);
+        mbuffer_free(&temp->uncompressed_data);
+        slab_free(&chunk_slab, temp);
+        temp = NULL;
+      } else {
+        //brand new mbuffer, increment sequence number
+        chunk->header.state = CHUNK_STATE_UNCOMPRESSED;
+        //Respect the reorder window before starting a new coarse-grained chunk
+        reorder_window_wait(anchorcount);
+        chunk->sequence.l1num = anchorcount;
+        anchorcount++;
+      }
+      //Read data until buffer full
+      if(conf->preloading) {
+        size_t max_read = MIN(MAXBUF, args->input_file.size-preloading_buffer_seek);
+        memcpy(chunk->uncompressed_data.ptr+bytes_left, args->input_file.buffer+preloading_buffer_seek, max_read);
+        bytes_read = max_read;
+        preloading_buffer_seek += max_read;
+      } else {
+        while(bytes_read < MAXBUF) {
+          r = read(fd, chunk->uncompressed_data.ptr+bytes_left+bytes_read, MAXBUF-bytes_read);
+          if(r<0) switch(errno) {
+            case EAGAIN:
+              EXIT_TRACE("I/O error: No data available\n");break;
+            case EBADF:
+              EXIT_TRACE("I/O error: Invalid file descriptor\n");break;
+            case EFAULT:
+              EXIT_TRACE("I/O error: Buffer out of range\n");break;
+            case EINTR:
+              EXIT_TRACE("I/O error: Interruption\n");break;
+            case EINVAL:
+              EXIT_TRACE("I/O error: Unable to read from file descriptor\n");break;
+            case EIO:
+              EXIT_TRACE("I/O error: Generic I/O error\n");break;
+            case EISDIR:
+              EXIT_TRACE("I/O error: Cannot read from a directory\n");break;
+            default:
+              EXIT_TRACE("I/O error: Unrecognized error\n");break;
+          }
+          if(r==0) break;
+          bytes_read += r;
         }
-        if(r==0) break;
-        bytes_read += r;
       }
     }
     //No data left over from last iteration and also nothing new read in, simply clean up and quit
     if(bytes_left + bytes_read == 0) {
       mbuffer_free(&chunk->uncompressed_data);
-      free(chunk);
+      slab_free(&chunk_slab, chunk);
       chunk = NULL;
       break;
     }
@@ -1105,7 +1490,7 @@ void *Fragment(void * targs){
       split = 0;
       //Try to split the buffer at least ANCHOR_JUMP bytes away from its beginning
       if(ANCHOR_JUMP < chunk->uncompressed_data.n) {
-        int offset = rabinseg(chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
+        int offset = segment(chunk->uncompressed_data.ptr + ANCHOR_JUMP, chunk->uncompressed_data.n - ANCHOR_JUMP, rf_win_dataprocess, rabintab, rabinwintab);
         //Did we find a split location?
         if(offset == 0) {
           //Split found at the very beginning of the buffer (should never happen due to technical limitations)
@@ -1114,13 +1499,15 @@ void *Fragment(void * targs){
         } else if(offset + ANCHOR_JUMP < chunk->uncompressed_data.n) {
           //Split found somewhere in the middle of the buffer
           //Allocate a new chunk and create a new memory buffer
-          temp = (chunk_t *)malloc(sizeof(chunk_t));
+          temp = (chunk_t *)slab_alloc(&chunk_slab);
           if(temp==NULL) EXIT_TRACE("Memory allocation failed.\n");
 
           //split it into two pieces
           r = mbuffer_split(&chunk->uncompressed_data, &temp->uncompressed_data, offset + ANCHOR_JUMP);
           if(r!=0) EXIT_TRACE("Unable to split memory buffer.\n");
           temp->header.state = CHUNK_STATE_UNCOMPRESSED;
+          //Respect the reorder window before starting a new coarse-grained chunk
+          reorder_window_wait(anchorcount);
           temp->sequence.l1num = anchorcount;
           anchorcount++;
 
@@ -1197,6 +1584,19 @@ void *Reorder(void * targs) {
 
   ringbuffer_t recv_buf;
   chunk_t *chunk;
+  write_batch_t batch;
+
+  //Number of chunks buffered in the search tree and their uncompressed size
+  unsigned int nbuffered = 0;
+  size_t nbuffered_bytes = 0;
+
+#ifdef ENABLE_STATISTICS
+  stats_t *thread_stats = malloc(sizeof(stats_t));
+  if(thread_stats == NULL) {
+    EXIT_TRACE("Memory allocation failed.\n");
+  }
+  init_stats(thread_stats);
+#endif //ENABLE_STATISTICS
 
   SearchTree T;
   T = TreeMakeEmpty(NULL);
@@ -1221,10 +1621,13 @@ void *Reorder(void * targs) {
   assert(r==0);
 
   fd = create_output_file(conf->outfile);
+  write_batch_init(&batch, fd);
 
   while(1) {
     //get a group of items
     if (ringbuffer_isEmpty(&recv_buf)) {
+      //write everything that is ready before waiting for more chunks
+      write_batch_flush(&batch);
       //process queues in round-robin fashion
       for(i=0,r=0; r<=0 && i<args->nqueues; i++) {
         r = queue_dequeue(&reorder_que[qid], &recv_buf, ITEM_PER_FETCH);
@@ -1261,19 +1664,28 @@ void *Reorder(void * targs) {
       } else {
         Insert(chunk, pos->Element.queue);
       }
+      nbuffered++;
+      nbuffered_bytes += chunk->uncompressed_data.n;
+#ifdef ENABLE_STATISTICS
+      thread_stats->nReorderMax = MAX(thread_stats->nReorderMax, nbuffered);
+      thread_stats->reorderMaxBytes = MAX(thread_stats->reorderMaxBytes, nbuffered_bytes);
+#endif //ENABLE_STATISTICS
       continue;
     }
 
     //write as many chunks as possible, current chunk is next in sequence
     pos = TreeFindMin(T);
     do {
-      write_chunk_to_file(fd, chunk);
+      write_chunk_to_batch(&batch, chunk);
       if(chunk->header.isDuplicate) {
-        free(chunk);
+        slab_free(&chunk_slab, chunk);
         chunk=NULL;
       }
       sequence_inc_l2(&next);
-      if(chunks_per_anchor[next.l1num]!=0 && next.l2num==chunks_per_anchor[next.l1num]) sequence_inc_l1(&next);
+      if(chunks_per_anchor[next.l1num]!=0 && next.l2num==chunks_per_anchor[next.l1num]) {
+        sequence_inc_l1(&next);
+        reorder_window_advance(next.l1num);
+      }
 
       //Check whether we can write more chunks from cache
       if(pos != NULL && (pos->Element.l1num == next.l1num)) {
@@ -1281,6 +1693,8 @@ void *Reorder(void * targs) {
         if(sequence_eq(chunk->sequence, next)) {
           //Remove chunk from cache, update position for next iteration
           DeleteMin(pos->Element.queue);
+          nbuffered--;
+          nbuffered_bytes -= chunk->uncompressed_data.n;
           if(IsEmpty(pos->Element.queue)) {
             Destroy(pos->Element.queue);
             T = TreeDelete(pos->Element, T);
@@ -1305,6 +1719,8 @@ void *Reorder(void * targs) {
       if(sequence_eq(chunk->sequence, next)) {
         //Remove chunk from cache, update position for next iteration
         DeleteMin(pos->Element.queue);
+        nbuffered--;
+        nbuffered_bytes -= chunk->uncompressed_data.n;
         if(IsEmpty(pos->Element.queue)) {
           Destroy(pos->Element.queue);
           T = TreeDelete(pos->Element, T);
@@ -1318,9 +1734,9 @@ void *Reorder(void * targs) {
       //level 1 sequence number does not match
       EXIT_TRACE("L1 sequence number mismatch.\n");
     }
-    write_chunk_to_file(fd, chunk);
+    write_chunk_to_batch(&batch, chunk);
     if(chunk->header.isDuplicate) {
-      free(chunk);
+      slab_free(&chunk_slab, chunk);
       chunk=NULL;
     }
     sequence_inc_l2(&next);
@@ -1328,12 +1744,19 @@ void *Reorder(void * targs) {
 
   }
 
+  write_batch_flush(&batch);
   close(fd);
 
   ringbuffer_destroy(&recv_buf);
   free(chunks_per_anchor);
 
+#ifdef ENABLE_STATISTICS
+  thread_stats->nWrites = batch.nWrites;
+  thread_stats->nWrittenChunks = batch.nWrittenChunks;
+  return thread_stats;
+#else
   return NULL;
+#endif //ENABLE_STATISTICS
 }
 #endif //ENABLE_PTHREADS
 
@@ -1357,12 +1780,20 @@ void Encode(config_t * _conf) {
   init_stats(&stats);
 #endif
 
+  //Initialize chunking algorithm (Rabin tables are set up by each thread)
+  if(conf->chunking == CHUNKING_GEAR) gearinit();
+  SHA1_mb_init();
+
   //Create chunk cache
-  cache = hashtable_create(65536, hash_from_key_fn, keys_equal_fn, FALSE);
+  cache = chunkindex_create(65536);
   if(cache == NULL) {
     printf("ERROR: Out of memory\n");
     exit(1);
   }
+  if(slab_init(&chunk_slab, sizeof(chunk_t)) != 0) {
+    printf("ERROR: Out of memory\n");
+    exit(1);
+  }
 
 #ifdef ENABLE_PTHREADS
   struct thread_args data_process_args;
@@ -1458,6 +1889,23 @@ void Encode(config_t * _conf) {
 #endif //ENABLE_PTHREADS
   }
 
+  //Map input file into memory if requested by user
+  //NOTE: The mapping is released automatically once all chunks referencing it have been freed
+  if(conf->mmap_input) {
+    struct thread_args *input_args;
+#ifdef ENABLE_PTHREADS
+    input_args = &data_process_args;
+#else
+    input_args = &generic_args;
+#endif //ENABLE_PTHREADS
+    input_args->input_file.buffer = NULL;
+    input_args->input_file.size = filestat.st_size;
+    if(filestat.st_size > 0) {
+      if(mbuffer_map(&input_args->input_file.map, fd, filestat.st_size) != 0)
+        EXIT_TRACE("Unable to map input file %s: %s\n", conf->infile, strerror(errno));
+    }
+  }
+
 #ifdef ENABLE_PTHREADS
   /* Variables for 3 thread pools and 2 pipeline stage threads.
    * The first and the last stage are serial (mostly I/O).
@@ -1475,6 +1923,8 @@ void Encode(config_t * _conf) {
     __parsec_roi_begin();
 #endif
 
+  reorder_window_init();
+
   //thread for first pipeline stage (input)
   pthread_create(&threads_process, NULL, Fragment, &data_process_args);
 
@@ -1509,6 +1959,7 @@ void Encode(config_t * _conf) {
   stats_t *threads_anchor_rv[conf->nthreads];
   stats_t *threads_chunk_rv[conf->nthreads];
   stats_t *threads_compress_rv[conf->nthreads];
+  stats_t *threads_send_rv;
 
   //join all threads 
   pthread_join(threads_process, NULL);
@@ -1518,7 +1969,7 @@ void Encode(config_t * _conf) {
     pthread_join(threads_chunk[i], (void **)&threads_chunk_rv[i]);
   for (i = 0; i < conf->nthreads; i ++)
     pthread_join(threads_compress[i], (void **)&threads_compress_rv[i]);
-  pthread_join(threads_send, NULL);
+  pthread_join(threads_send, (void **)&threads_send_rv);
 
 #ifdef ENABLE_PARSEC_HOOKS
   __parsec_roi_end();
@@ -1526,6 +1977,12 @@ void Encode(config_t * _conf) {
 
   /* free queues */
   for(i=0; i<nqueues; i++) {
+#ifdef ENABLE_STATISTICS
+    queue_merge_stats(&deduplicate_que[i], &stats.queues);
+    queue_merge_stats(&refine_que[i], &stats.queues);
+    queue_merge_stats(&reorder_que[i], &stats.queues);
+    queue_merge_stats(&compress_que[i], &stats.queues);
+#endif //ENABLE_STATISTICS
     queue_destroy(&deduplicate_que[i]);
     queue_destroy(&refine_que[i]);
     queue_destroy(&reorder_que[i]);
@@ -1550,7 +2007,11 @@ void Encode(config_t * _conf) {
     merge_stats(&stats, threads_compress_rv[i]);
     free(threads_compress_rv[i]);
   }
+  merge_stats(&stats, threads_send_rv);
+  free(threads_send_rv);
+  stats.nWindowStalls = reorder_window.nStalls;
 #endif //ENABLE_STATISTICS
+  reorder_window_destroy();
 
 #else //serial version
 
@@ -1580,9 +2041,18 @@ void Encode(config_t * _conf) {
   if (conf->infile != NULL)
     close(fd);
 
+#ifdef ENABLE_STATISTICS
+  mbuffer_system_get_stats(&stats.mcb_alloc);
+#endif //ENABLE_STATISTICS
   assert(!mbuffer_system_destroy());
 
-  hashtable_destroy(cache, TRUE);
+#ifdef ENABLE_STATISTICS
+  chunkindex_get_stats(cache, &stats.index);
+  slab_get_stats(&chunk_slab, &stats.chunk_alloc);
+#endif //ENABLE_STATISTICS
+  //The chunks in the index are released together with their allocator
+  chunkindex_destroy(cache, FALSE);
+  slab_destroy(&chunk_slab);
 
 #ifdef ENABLE_STATISTICS
   /* dest file stat */
@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "dedupdef.h"
+#include "gear.h"
+
+//Use a vectorized boundary scan with AVX2 gathers if the CPU supports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENABLE_GEAR_AVX2
+#include <immintrin.h>
+#endif
+
+//Number of SIMD lanes and number of consecutive positions each lane scans per round
+#define GEAR_LANES 8
+#define GEAR_LANE_LEN 128
+
+static u32int geartab[256];
+static int use_avx2 = 0;
+
+//Fill table with pseudo-random numbers (splitmix64), the table must be the same for every run
+void gearinit() {
+  uint64_t x = 0x2545f4914f6cdd1dULL;
+  uint64_t z;
+  int i;
+
+  for(i=0; i<256; i++) {
+    x += 0x9e3779b97f4a7c15ULL;
+    z = x;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = z ^ (z >> 31);
+    geartab[i] = (u32int)(z >> 32);
+  }
+
+#ifdef ENABLE_GEAR_AVX2
+  __builtin_cpu_init();
+  use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+int gearseg_is_vectorized() {
+  return use_avx2;
+}
+
+int gearseg_scalar(uchar *p, int n) {
+  u32int h = 0;
+  int i;
+
+  if(n < NWINDOW)
+    return n;
+
+  //Fill window
+  for(i=0; i<NWINDOW-1; i++) {
+    h = (h << 1) + geartab[p[i]];
+  }
+  while(i<n) {
+    h = (h << 1) + geartab[p[i++]];
+    if((h & GearMask) == 0)
+      return i;
+  }
+  return n;
+}
+
+#ifdef ENABLE_GEAR_AVX2
+//Scan GEAR_LANES blocks of GEAR_LANE_LEN consecutive positions in parallel, starting with position `start'
+//(i.e. after consuming byte start-1). Returns the first anchor or -1 if none was found.
+//The caller must guarantee that start >= NWINDOW and that 3 bytes can be read beyond the last block.
+__attribute__ ((target ("avx2")))
+static int gearseg_round_avx2(uchar *p, int start) {
+  const __m256i lane_ofs = _mm256_setr_epi32(0, GEAR_LANE_LEN, 2*GEAR_LANE_LEN, 3*GEAR_LANE_LEN,
+                                             4*GEAR_LANE_LEN, 5*GEAR_LANE_LEN, 6*GEAR_LANE_LEN, 7*GEAR_LANE_LEN);
+  const __m256i mask = _mm256_set1_epi32((int)GearMask);
+  const __m256i bytemask = _mm256_set1_epi32(0xff);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i h = zero;
+  __m256i idx, words, hits;
+  int found = 0; //bit mask of lanes with an anchor
+  int first[GEAR_LANES];
+  int t, j, k, m;
+
+  //Byte offsets of the first window byte of each lane
+  idx = _mm256_add_epi32(_mm256_set1_epi32(start - NWINDOW), lane_ofs);
+
+  //Fill windows, 4 bytes per gather
+  for(t=0; t<NWINDOW-4; t+=4) {
+    words = _mm256_i32gather_epi32((const int *)p, idx, 1);
+    for(j=0; j<4; j++) {
+      __m256i b = _mm256_and_si256(_mm256_srli_epi32(words, 8*j), bytemask);
+      h = _mm256_add_epi32(_mm256_slli_epi32(h, 1), _mm256_i32gather_epi32((const int *)geartab, b, 4));
+    }
+    idx = _mm256_add_epi32(idx, _mm256_set1_epi32(4));
+  }
+  //Last 3 bytes of the window, the 4th byte is the first position
+  words = _mm256_i32gather_epi32((const int *)p, idx, 1);
+  for(j=0; j<3; j++) {
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(words, 8*j), bytemask);
+    h = _mm256_add_epi32(_mm256_slli_epi32(h, 1), _mm256_i32gather_epi32((const int *)geartab, b, 4));
+  }
+  idx = _mm256_add_epi32(idx, _mm256_set1_epi32(3));
+
+  //Scan positions, 4 bytes per gather
+  for(t=0; t<GEAR_LANE_LEN; t+=4) {
+    words = _mm256_i32gather_epi32((const int *)p, idx, 1);
+    for(j=0; j<4; j++) {
+      __m256i b = _mm256_and_si256(_mm256_srli_epi32(words, 8*j), bytemask);
+      h = _mm256_add_epi32(_mm256_slli_epi32(h, 1), _mm256_i32gather_epi32((const int *)geartab, b, 4));
+      hits = _mm256_cmpeq_epi32(_mm256_and_si256(h, mask), zero);
+      m = _mm256_movemask_ps(_mm256_castsi256_ps(hits)) & ~found;
+      if(m) {
+        for(k=0; k<GEAR_LANES; k++) {
+          if(m & (1<<k)) first[k] = start + k*GEAR_LANE_LEN + t + j;
+        }
+        found |= m;
+        //An anchor in the first lane cannot be preceded by anchors of other lanes
+        if(found & 1) return first[0];
+      }
+    }
+    idx = _mm256_add_epi32(idx, _mm256_set1_epi32(4));
+  }
+
+  if(found == 0) return -1;
+  for(k=0; !(found & (1<<k)); k++);
+  return first[k];
+}
+#endif //ENABLE_GEAR_AVX2
+
+int gearseg(uchar *p, int n) {
+#ifdef ENABLE_GEAR_AVX2
+  if(use_avx2) {
+    //First position at which an anchor can be placed
+    int pos = NWINDOW;
+    int r;
+
+    //Vectorized scan of whole rounds, the rest is handled by the scalar code
+    while(pos + GEAR_LANES*GEAR_LANE_LEN + 3 <= n) {
+      r = gearseg_round_avx2(p, pos);
+      if(r >= 0) return r;
+      pos += GEAR_LANES*GEAR_LANE_LEN;
+    }
+    if(pos == NWINDOW) return gearseg_scalar(p, n);
+    //Restart scalar scan with a full window before the first unscanned position
+    r = gearseg_scalar(p + pos - NWINDOW, n - pos + NWINDOW);
+    return r + pos - NWINDOW;
+  }
+#endif //ENABLE_GEAR_AVX2
+  return gearseg_scalar(p, n);
+}
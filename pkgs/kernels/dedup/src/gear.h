@@ -0,0 +1,37 @@
+#ifndef _GEAR_H_
+#define _GEAR_H_
+
+#include "dedupdef.h"
+#include "rabin.h"
+
+/* Content-defined chunking with a gear hash
+ *
+ * The gear hash is updated with a single shift and addition per byte:
+ *   h = (h << 1) + geartab[byte]
+ * With a 32-bit hash each byte is shifted out after 32 steps, so the hash
+ * only depends on a sliding window of the last NWINDOW bytes, like the Rabin
+ * fingerprint. Anchors are placed where the upper bits of the hash are zero.
+ * GearMask selects as many bits as RabinMask, so both algorithms produce
+ * chunks with the same expected size and the same minimum size of NWINDOW.
+ *
+ * Hashes at different positions are independent of each other beyond the
+ * window, which allows the boundary scan to evaluate several positions in
+ * parallel in SIMD lanes.
+ */
+
+#define GearMask 0xfff00000
+
+//Initialize gear hash table, must be called before gearseg
+void gearinit();
+
+//Find the next anchor in a buffer with n bytes
+//Returns offset of the anchor or n if there is none, same semantics as rabinseg
+int gearseg(uchar *p, int n);
+
+//Same as gearseg but always uses the scalar implementation
+int gearseg_scalar(uchar *p, int n);
+
+//Returns nonzero if gearseg uses a vectorized implementation on this machine
+int gearseg_is_vectorized();
+
+#endif //_GEAR_H_
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+//Maximum distance of a match
+#define MAX_DISTANCE 65535
+//The last bytes of a block are always literals, no match may start in the last MATCH_LIMIT bytes
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+//Level 1 skips ahead faster after 2^SKIP_SHIFT positions without a match
+#define SKIP_SHIFT 6
+
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint32_t hash32(uint32_t x, int bits) {
+  return (x * 2654435761u) >> (32 - bits);
+}
+
+size_t lz_bound(size_t n) {
+  return n + n / 255 + 16;
+}
+
+//Write a length extension, returns new output position
+static inline unsigned char *put_length(unsigned char *op, size_t len) {
+  while(len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (unsigned char)len;
+  return op;
+}
+
+//Emit a record, returns new output position or NULL if it does not fit
+static unsigned char *put_record(unsigned char *op, unsigned char *oend, const unsigned char *lit, size_t nlit,
+                                 size_t offset, size_t mlen) {
+  unsigned char *token = op++;
+  size_t need = 1 + nlit + nlit / 255 + 1 + (mlen > 0 ? 2 + mlen / 255 + 1 : 0);
+
+  if(need > (size_t)(oend - token)) return NULL;
+
+  if(nlit >= 15) {
+    *token = 15 << 4;
+    op = put_length(op, nlit - 15);
+  } else {
+    *token = (unsigned char)(nlit << 4);
+  }
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if(mlen > 0) {
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    mlen -= LZ_MIN_MATCH;
+    if(mlen >= 15) {
+      *token |= 15;
+      op = put_length(op, mlen - 15);
+    } else {
+      *token |= (unsigned char)mlen;
+    }
+  }
+  return op;
+}
+
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level) {
+  unsigned char *op = dst;
+  unsigned char *oend = dst + cap;
+  size_t ip = 0, anchor = 0;
+  size_t limit, match_end;
+  int32_t *table;
+  uint16_t *chain = NULL;
+  size_t wmask = 0;
+  int bits, depth;
+  unsigned int misses = 0;
+
+  if(level < 1) level = 1;
+  if(level > LZ_MAX_LEVEL) level = LZ_MAX_LEVEL;
+
+  if(n < MATCH_LIMIT + 1) {
+    op = put_record(op, oend, src, n, 0, 0);
+    return op == NULL ? 0 : (size_t)(op - dst);
+  }
+
+  //Hash table with one entry per 4 input bytes, at least 2^8 and at most 2^14 entries
+  for(bits=8; bits<14 && ((size_t)1 << (bits+2)) < n; bits++);
+  table = (int32_t *)malloc(sizeof(int32_t) << bits);
+  if(table == NULL) return 0;
+  memset(table, 0xff, sizeof(int32_t) << bits);
+
+  //Hash chains store the distance to the previous position with the same hash
+  depth = 1 << (level - 1);
+  if(level > 1) {
+    size_t w = 1;
+    while(w < n && w <= MAX_DISTANCE) w <<= 1;
+    wmask = w - 1;
+    chain = (uint16_t *)malloc(w * sizeof(uint16_t));
+    if(chain == NULL) {
+      free(table);
+      return 0;
+    }
+  }
+
+  limit = n - MATCH_LIMIT;
+  match_end = n - LAST_LITERALS;
+  while(ip < limit) {
+    uint32_t seq = read32(src + ip);
+    uint32_t h = hash32(seq, bits);
+    int32_t cand = table[h];
+    size_t best_len = 0, best_off = 0;
+    int probes = depth;
+
+    table[h] = (int32_t)ip;
+    if(chain != NULL) {
+      chain[ip & wmask] = (cand >= 0 && ip - (size_t)cand <= MAX_DISTANCE) ? (uint16_t)(ip - (size_t)cand) : 0;
+    }
+
+    //Find longest match among the candidates
+    while(cand >= 0 && ip - (size_t)cand <= MAX_DISTANCE && probes-- > 0) {
+      if(read32(src + cand) == seq) {
+        size_t len = LZ_MIN_MATCH;
+        while(ip + len < match_end && src[cand + len] == src[ip + len]) len++;
+        if(len > best_len) {
+          best_len = len;
+          best_off = ip - (size_t)cand;
+        }
+      }
+      if(chain == NULL || chain[cand & wmask] == 0) break;
+      cand -= chain[cand & wmask];
+    }
+
+    if(best_len < LZ_MIN_MATCH) {
+      //Skip incompressible data faster at level 1
+      ip += (level == 1) ? 1 + (misses++ >> SKIP_SHIFT) : 1;
+      continue;
+    }
+    misses = 0;
+
+    op = put_record(op, oend, src + anchor, ip - anchor, best_off, best_len);
+    if(op == NULL) break;
+    ip += best_len;
+    anchor = ip;
+    //Make the position right before the next one findable, it often starts the next match
+    if(ip < limit) {
+      size_t p = ip - 2;
+      uint32_t hp = hash32(read32(src + p), bits);
+      if(chain != NULL) {
+        cand = table[hp];
+        chain[p & wmask] = (cand >= 0 && p - (size_t)cand <= MAX_DISTANCE) ? (uint16_t)(p - (size_t)cand) : 0;
+      }
+      table[hp] = (int32_t)p;
+    }
+  }
+
+  free(table);
+  free(chain);
+  if(op == NULL) return 0;
+
+  //Remaining input is emitted as literals
+  op = put_record(op, oend, src + anchor, n - anchor, 0, 0);
+  return op == NULL ? 0 : (size_t)(op - dst);
+}
+
+long lz_uncompress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+  size_t ip = 0, op = 0;
+
+  while(ip < n) {
+    unsigned int token = src[ip++];
+    size_t nlit = token >> 4;
+    size_t mlen = token & 15;
+    size_t offset;
+    unsigned char b;
+
+    if(nlit == 15) {
+      do {
+        if(ip >= n) return -1;
+        b = src[ip++];
+        nlit += b;
+      } while(b == 255);
+    }
+    if(nlit > n - ip || nlit > cap - op) return -1;
+    memcpy(dst + op, src + ip, nlit);
+    ip += nlit;
+    op += nlit;
+
+    //Last record has no match
+    if(ip == n) break;
+
+    if(n - ip < 2) return -1;
+    offset = src[ip] | ((size_t)src[ip+1] << 8);
+    ip += 2;
+    if(offset == 0 || offset > op) return -1;
+    if(mlen == 15) {
+      do {
+        if(ip >= n) return -1;
+        b = src[ip++];
+        mlen += b;
+      } while(b == 255);
+    }
+    mlen += LZ_MIN_MATCH;
+    if(mlen > cap - op) return -1;
+
+    if(offset >= mlen) {
+      memcpy(dst + op, dst + op - offset, mlen);
+      op += mlen;
+    } else {
+      //Overlapping match, repeats the last `offset' bytes
+      size_t i;
+      for(i=0; i<mlen; i++, op++) dst[op] = dst[op - offset];
+    }
+  }
+
+  return (long)op;
+}
@@ -0,0 +1,37 @@
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stddef.h>
+
+/* Fast LZ77 compressor for dedup
+ *
+ * The compressed data is a sequence of records with the same layout as
+ * LZ4 blocks: A token byte holds the number of literals in its upper and
+ * the match length minus LZ_MIN_MATCH in its lower 4 bits. A value of 15
+ * is followed by extension bytes which are added to the length until one
+ * of them is less than 255. The literals follow the token, then the
+ * 16-bit little-endian match offset and the extension bytes of the match
+ * length. The last record of a block only consists of literals.
+ *
+ * Level 1 finds matches with a single hash table lookup and skips faster
+ * over incompressible data. Higher levels keep hash chains and compare up
+ * to 2^(level-1) candidates per position to find longer matches, which trades
+ * compression speed for compression ratio. Decompression speed does not
+ * depend on the level.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_LEVEL 9
+
+//Upper bound of the size of the compressed data for n bytes of input
+size_t lz_bound(size_t n);
+
+//Compress n bytes from src into dst, which has room for cap bytes
+//Returns the size of the compressed data or 0 if it does not fit into dst
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap, int level);
+
+//Uncompress n bytes from src into dst, which has room for cap bytes
+//Returns the size of the uncompressed data or -1 if the data is corrupt or does not fit into dst
+long lz_uncompress(const unsigned char *src, size_t n, unsigned char *dst, size_t cap);
+
+#endif //_LZ_H_
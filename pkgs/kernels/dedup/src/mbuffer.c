@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
 
 #ifdef ENABLE_PTHREADS
 #include <pthread.h>
@@ -15,7 +16,10 @@
 
 
 #include "mbuffer.h"
+#include "slab.h"
 
+//Allocator for the memory control blocks
+static slab_t mcb_slab;
 
 
 #ifdef ENABLE_PTHREADS
@@ -60,10 +64,16 @@ static inline int lock_hash(void *p) {
 int mbuffer_system_init() {
 #ifdef ENABLE_PTHREADS
   int i;
+#endif
 
+  if(slab_init(&mcb_slab, sizeof(mcb_t)) != 0) return -1;
+#ifdef ENABLE_PTHREADS
   assert(locks==NULL);
   locks = malloc(NUMBER_OF_LOCKS * sizeof(pthread_lock_t));
-  if(locks==NULL) return -1;
+  if(locks==NULL) {
+    slab_destroy(&mcb_slab);
+    return -1;
+  }
   for(i=0; i<NUMBER_OF_LOCKS; i++) {
     if(PTHREAD_LOCK_INIT(&locks[i]) != 0) {
       int j;
@@ -72,6 +82,7 @@ int mbuffer_system_init() {
       }
       free((void *)locks);
       locks=NULL;
+      slab_destroy(&mcb_slab);
       return -1;
     }
   }
@@ -83,6 +94,10 @@ int mbuffer_system_init() {
 int mbuffer_system_destroy() {
 #ifdef ENABLE_PTHREADS
   int i, rv;
+#endif
+
+  slab_destroy(&mcb_slab);
+#ifdef ENABLE_PTHREADS
   rv=0;
   for(i=0; i<NUMBER_OF_LOCKS; i++) {
     rv+=PTHREAD_LOCK_DESTROY(&locks[i]);
@@ -95,6 +110,11 @@ int mbuffer_system_destroy() {
 #endif
 }
 
+//Get allocation statistics of the memory control blocks
+void mbuffer_system_get_stats(slab_stats_t *stats) {
+  slab_get_stats(&mcb_slab, stats);
+}
+
 //Initialize a memory buffer
 int mbuffer_create(mbuffer_t *m, size_t size) {
   void *ptr;
@@ -105,7 +125,7 @@ int mbuffer_create(mbuffer_t *m, size_t size) {
   //FIXME: Merge both mallocs to one
   ptr = malloc(size);
   if(ptr==NULL) return -1;
-  m->mcb = (mcb_t *)malloc(sizeof(mcb_t));
+  m->mcb = (mcb_t *)slab_alloc(&mcb_slab);
   if(m->mcb==NULL) {
     free(ptr);
     ptr=NULL;
@@ -116,6 +136,38 @@ int mbuffer_create(mbuffer_t *m, size_t size) {
   m->n = size;
   m->mcb->i = 1;
   m->mcb->ptr = ptr;
+  m->mcb->n = size;
+  m->mcb->mapped = 0;
+#ifdef ENABLE_MBUFFER_CHECK
+  m->check_flag=MBUFFER_CHECK_MAGIC;
+#endif
+
+  return 0;
+}
+
+//Initialize a memory buffer with a read-only mapping of a file
+int mbuffer_map(mbuffer_t *m, int fd, size_t size) {
+  void *ptr;
+
+  assert(m!=NULL);
+  assert(size > 0);
+
+  ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(ptr==MAP_FAILED) return -1;
+  //The file is read front to back exactly once, let the OS prefetch aggressively and drop pages early
+  posix_madvise(ptr, size, POSIX_MADV_SEQUENTIAL);
+  m->mcb = (mcb_t *)slab_alloc(&mcb_slab);
+  if(m->mcb==NULL) {
+    munmap(ptr, size);
+    return -1;
+  }
+
+  m->ptr = ptr;
+  m->n = size;
+  m->mcb->i = 1;
+  m->mcb->ptr = ptr;
+  m->mcb->n = size;
+  m->mcb->mapped = 1;
 #ifdef ENABLE_MBUFFER_CHECK
   m->check_flag=MBUFFER_CHECK_MAGIC;
 #endif
@@ -205,9 +257,13 @@ void mbuffer_free(mbuffer_t *m) {
 
   //NOTE: No need to synchronize access to ref counter value again because if it has hit 0 the buffer is dead
   if(ref==0) {
-    free(m->mcb->ptr);
+    if(m->mcb->mapped) {
+      munmap(m->mcb->ptr, m->mcb->n);
+    } else {
+      free(m->mcb->ptr);
+    }
     m->mcb->ptr=NULL;
-    free(m->mcb);
+    slab_free(&mcb_slab, m->mcb);
     m->mcb=NULL;
   }
 #ifdef ENABLE_MBUFFER_CHECK
@@ -238,7 +294,8 @@ int mbuffer_realloc(mbuffer_t *m, size_t size) {
     return -1;
   }
   //This must be the original mbuffer, otherwise we'd have to do something more complicated
-  if(m->ptr != m->mcb->ptr) {
+  //Mapped files cannot be resized
+  if(m->ptr != m->mcb->ptr || m->mcb->mapped) {
 #ifdef ENABLE_PTHREADS
     PTHREAD_UNLOCK(&locks[lock_hash(m->mcb)]);
 #endif
@@ -297,3 +354,39 @@ int mbuffer_split(mbuffer_t *m1, mbuffer_t *m2, size_t split) {
 
   return 0;
 }
+
+//Merge memory buffer m2 into m1
+//Returns 0 if the operation was successful
+int mbuffer_merge(mbuffer_t *m1, mbuffer_t *m2) {
+  assert(m1!=NULL);
+  assert(m2!=NULL);
+#ifdef ENABLE_MBUFFER_CHECK
+  assert(m1->check_flag==MBUFFER_CHECK_MAGIC);
+  assert(m2->check_flag==MBUFFER_CHECK_MAGIC);
+#endif
+
+  //Buffers must be adjacent parts of the same memory region
+  if(m1->mcb != m2->mcb) return -1;
+  if(m1->ptr + m1->n != m2->ptr) return -1;
+
+  //Update reference counter, m1 still holds a reference so it cannot drop to 0
+#ifdef ENABLE_PTHREADS
+  PTHREAD_LOCK(&locks[lock_hash(m1->mcb)]);
+  assert(m1->mcb->i>=2);
+  m1->mcb->i--;
+  PTHREAD_UNLOCK(&locks[lock_hash(m1->mcb)]);
+#else
+  assert(m1->mcb->i>=2);
+  m1->mcb->i--;
+#endif //ENABLE_PTHREADS
+
+  m1->n += m2->n;
+  m2->ptr = NULL;
+  m2->n = 0;
+  m2->mcb = NULL;
+#ifdef ENABLE_MBUFFER_CHECK
+  m2->check_flag=0;
+#endif
+
+  return 0;
+}
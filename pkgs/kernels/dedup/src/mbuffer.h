@@ -26,6 +26,8 @@
 
 #include <stdlib.h>
 
+#include "slab.h"
+
 //Add additional code to catch unallocated mbuffers and multiple frees
 //#define ENABLE_MBUFFER_CHECK
 
@@ -38,9 +40,14 @@
 //Dedup breaks memory buffers into smaller memory buffers during its operation, which means that free() cannot
 //be called until all resulting buffers are no longer used. Furthermore we need to keep track of the original
 //pointer returned by malloc & co so we know which one to pass to free().
+//Buffers can also be read-only views into a memory-mapped file, in which case the whole mapping
+//is released with munmap() once the last buffer referencing it has been freed.
+//MCBs are allocated from a slab allocator which is private to the memory buffer subsystem.
 typedef struct {
   unsigned int i; //reference counter
-  void *ptr; //original pointer returned by malloc that needs to be passed to free()
+  void *ptr; //original pointer returned by malloc (or mmap) that needs to be passed to free() (or munmap)
+  size_t n; //size of the mapping (only used if mapped)
+  int mapped; //whether ptr points to a memory-mapped file
 } mcb_t;
 
 //Definition of a memory buffer
@@ -61,10 +68,18 @@ int mbuffer_system_init();
 //Shutdown memory buffer subsystem
 int mbuffer_system_destroy();
 
+//Get allocation statistics of the memory control blocks
+//Must be called before the memory buffer subsystem is shut down
+void mbuffer_system_get_stats(slab_stats_t *stats);
+
 //Initialize a memory buffer that has been manually or statically allocated
 //The mbuffer system will not attempt to free argument *m
 int mbuffer_create(mbuffer_t *m, size_t size);
 
+//Initialize a memory buffer with a read-only mapping of the first `size' bytes of file `fd'
+//The contents of the buffer must not be modified. Buffers derived from it share the mapping.
+int mbuffer_map(mbuffer_t *m, int fd, size_t size);
+
 //Make a shallow copy of a memory buffer
 mbuffer_t *mbuffer_clone(mbuffer_t *m);
 
@@ -82,5 +97,10 @@ int mbuffer_realloc(mbuffer_t *m, size_t size);
 //Returns 0 if the operation was successful
 int mbuffer_split(mbuffer_t *m1, mbuffer_t *m2, size_t split);
 
+//Merge memory buffer m2 into m1. Both buffers must have been derived from the same
+//buffer and m2 must immediately follow m1. Buffer m2 is no longer valid afterwards.
+//Returns 0 if the operation was successful
+int mbuffer_merge(mbuffer_t *m1, mbuffer_t *m2);
+
 #endif //_MBUFFER_H_
 
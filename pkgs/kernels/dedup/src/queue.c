@@ -1,6 +1,9 @@
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "util.h"
+#include "debug.h"
 #include "queue.h"
 #include "config.h"
 
@@ -8,6 +11,8 @@
 #include <pthread.h>
 #endif //ENABLE_PTHREADS
 
+#ifndef ENABLE_LOCKFREE_QUEUE
+
 void queue_init(queue_t * que, size_t size, int nProducers) {
 #ifdef ENABLE_PTHREADS
   pthread_mutex_init(&que->mutex, NULL);
@@ -17,6 +22,9 @@ void queue_init(queue_t * que, size_t size, int nProducers) {
   assert(!ringbuffer_init(&(que->buf), size));
   que->nProducers = nProducers;
   que->nTerminated = 0;
+#ifdef ENABLE_STATISTICS
+  memset(&que->stats, 0, sizeof(queue_stats_t));
+#endif //ENABLE_STATISTICS
 }
 
 void queue_destroy(queue_t * que) {
@@ -28,6 +36,23 @@ void queue_destroy(queue_t * que) {
   ringbuffer_destroy(&(que->buf));
 }
 
+/* Private function which acquires the queue lock and records whether it was contended */
+#ifdef ENABLE_PTHREADS
+static inline void queue_lock(queue_t * que, int isEnqueue) {
+#ifdef ENABLE_STATISTICS
+  if(pthread_mutex_trylock(&que->mutex) == 0) return;
+  pthread_mutex_lock(&que->mutex);
+  if(isEnqueue) {
+    que->stats.nEnqueueContended++;
+  } else {
+    que->stats.nDequeueContended++;
+  }
+#else
+  pthread_mutex_lock(&que->mutex);
+#endif //ENABLE_STATISTICS
+}
+#endif //ENABLE_PTHREADS
+
 /* Private function which requires synchronization */
 static inline int queue_isTerminated(queue_t * que) {
   assert(que->nTerminated <= que->nProducers);
@@ -46,12 +71,20 @@ void queue_terminate(queue_t * que) {
 #endif
 }
 
-int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit) {
+//Transfer up to `limit' elements to buf, waits for elements only if `block' is set
+static int dequeue(queue_t *que, ringbuffer_t *buf, int limit, int block) {
   int i;
 
 #ifdef ENABLE_PTHREADS
-  pthread_mutex_lock(&que->mutex);
+  queue_lock(que, FALSE);
+  if (!block && ringbuffer_isEmpty(&que->buf) && !queue_isTerminated(que)) {
+    pthread_mutex_unlock(&que->mutex);
+    return 0;
+  }
   while (ringbuffer_isEmpty(&que->buf) && !queue_isTerminated(que)) {
+#ifdef ENABLE_STATISTICS
+    que->stats.nDequeueWaits++;
+#endif //ENABLE_STATISTICS
     pthread_cond_wait(&que->notEmpty, &que->mutex);
   }
 #endif
@@ -73,6 +106,9 @@ int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit) {
     rv = ringbuffer_insert(buf, temp);
     assert(rv==0);
   }
+#ifdef ENABLE_STATISTICS
+  if(i>0) que->stats.nDequeues++;
+#endif //ENABLE_STATISTICS
 #ifdef ENABLE_PTHREADS
   if(i>0) pthread_cond_signal(&que->notFull);
   pthread_mutex_unlock(&que->mutex);
@@ -80,14 +116,26 @@ int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit) {
   return i;
 }
 
+int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit) {
+  return dequeue(que, buf, limit, TRUE);
+}
+
+int queue_trydequeue(queue_t *que, ringbuffer_t *buf, int limit) {
+  return dequeue(que, buf, limit, FALSE);
+}
+
 int queue_enqueue(queue_t *que, ringbuffer_t *buf, int limit) {
   int i;
 
 #ifdef ENABLE_PTHREADS
-  pthread_mutex_lock(&que->mutex);
+  queue_lock(que, TRUE);
   assert(!queue_isTerminated(que));
-  while (ringbuffer_isFull(&que->buf))
+  while (ringbuffer_isFull(&que->buf)) {
+#ifdef ENABLE_STATISTICS
+    que->stats.nEnqueueWaits++;
+#endif //ENABLE_STATISTICS
     pthread_cond_wait(&que->notFull, &que->mutex);
+  }
 #else
   assert(!queue_isTerminated(que));
 #endif
@@ -103,9 +151,259 @@ int queue_enqueue(queue_t *que, ringbuffer_t *buf, int limit) {
     rv = ringbuffer_insert(&que->buf, temp);
     assert(rv==0);
   }
+#ifdef ENABLE_STATISTICS
+  if(i>0) que->stats.nEnqueues++;
+#endif //ENABLE_STATISTICS
 #ifdef ENABLE_PTHREADS
   if(i>0) pthread_cond_signal(&que->notEmpty);
   pthread_mutex_unlock(&que->mutex);
 #endif
   return i;
 }
+
+#else //ENABLE_LOCKFREE_QUEUE
+
+//Number of times a thread polls the queue before it gets parked
+#define QUEUE_SPIN_COUNT 1024
+
+static inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__("pause" ::: "memory");
+#else
+  __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+void queue_init(queue_t * que, size_t size, int nProducers) {
+  size_t i, n;
+
+  //Round capacity up to a power of two so slot indices can be computed with a mask
+  for(n=2; n<size; n<<=1);
+  que->slots = (queue_slot_t *)malloc(sizeof(queue_slot_t) * n);
+  if(que->slots == NULL) EXIT_TRACE("Memory allocation failed.\n");
+  for(i=0; i<n; i++) {
+    que->slots[i].seq = i;
+    que->slots[i].data = NULL;
+  }
+  que->mask = n-1;
+  que->head = 0;
+  que->tail = 0;
+
+  pthread_mutex_init(&que->mutex, NULL);
+  pthread_cond_init(&que->notEmpty, NULL);
+  pthread_cond_init(&que->notFull, NULL);
+  que->nWaitingEmpty = 0;
+  que->nWaitingFull = 0;
+  que->nProducers = nProducers;
+  que->nTerminated = 0;
+#ifdef ENABLE_STATISTICS
+  memset(&que->stats, 0, sizeof(queue_stats_t));
+#endif //ENABLE_STATISTICS
+}
+
+void queue_destroy(queue_t * que) {
+  pthread_mutex_destroy(&que->mutex);
+  pthread_cond_destroy(&que->notEmpty);
+  pthread_cond_destroy(&que->notFull);
+  free(que->slots);
+}
+
+/* Private function, safe to call without synchronization */
+static inline int queue_isTerminated(queue_t * que) {
+  int n = __atomic_load_n(&que->nTerminated, __ATOMIC_ACQUIRE);
+  assert(n <= que->nProducers);
+  return n == que->nProducers;
+}
+
+//Try to insert one element, returns 0 if the operation succeeded and -1 if the queue is full
+static inline int queue_tryinsert(queue_t *que, void *ptr, unsigned long *nRetries) {
+  size_t pos = __atomic_load_n(&que->head, __ATOMIC_RELAXED);
+  queue_slot_t *slot;
+  intptr_t dif;
+
+  while(1) {
+    slot = &que->slots[pos & que->mask];
+    dif = (intptr_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+    if(dif == 0) {
+      //Slot is free, try to claim it (updates pos on failure)
+      if(__atomic_compare_exchange_n(&que->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+      (*nRetries)++;
+    } else if(dif < 0) {
+      //Slot still occupied by element from previous lap
+      return -1;
+    } else {
+      //Another producer claimed the slot before us
+      pos = __atomic_load_n(&que->head, __ATOMIC_RELAXED);
+      (*nRetries)++;
+    }
+  }
+  slot->data = ptr;
+  __atomic_store_n(&slot->seq, pos+1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+//Try to remove one element, returns NULL if the queue is empty
+static inline void *queue_tryremove(queue_t *que, unsigned long *nRetries) {
+  size_t pos = __atomic_load_n(&que->tail, __ATOMIC_RELAXED);
+  queue_slot_t *slot;
+  intptr_t dif;
+  void *ptr;
+
+  while(1) {
+    slot = &que->slots[pos & que->mask];
+    dif = (intptr_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t)(pos+1);
+    if(dif == 0) {
+      //Slot contains an element, try to claim it (updates pos on failure)
+      if(__atomic_compare_exchange_n(&que->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+      (*nRetries)++;
+    } else if(dif < 0) {
+      //Slot has not been written yet
+      return NULL;
+    } else {
+      //Another consumer claimed the slot before us
+      pos = __atomic_load_n(&que->tail, __ATOMIC_RELAXED);
+      (*nRetries)++;
+    }
+  }
+  ptr = slot->data;
+  __atomic_store_n(&slot->seq, pos + que->mask + 1, __ATOMIC_RELEASE);
+  return ptr;
+}
+
+/* Private functions which check whether a waiting thread can make progress */
+static int queue_canEnqueue(queue_t *que) {
+  size_t pos = __atomic_load_n(&que->head, __ATOMIC_RELAXED);
+  size_t seq = __atomic_load_n(&que->slots[pos & que->mask].seq, __ATOMIC_ACQUIRE);
+  return (intptr_t)(seq - pos) >= 0;
+}
+
+static int queue_canDequeue(queue_t *que) {
+  size_t pos = __atomic_load_n(&que->tail, __ATOMIC_RELAXED);
+  size_t seq = __atomic_load_n(&que->slots[pos & que->mask].seq, __ATOMIC_ACQUIRE);
+  return (intptr_t)(seq - (pos+1)) >= 0 || queue_isTerminated(que);
+}
+
+//Wait until `ready' holds, spinning for a while before parking the thread on `cond'
+//Returns 1 if the thread had to be parked
+static int queue_wait(queue_t *que, int (*ready)(queue_t *), int *nWaiting, pthread_cond_t *cond) {
+  int i;
+
+  for(i=0; i<QUEUE_SPIN_COUNT; i++) {
+    if(ready(que)) return 0;
+    cpu_relax();
+  }
+
+  pthread_mutex_lock(&que->mutex);
+  //NOTE: The atomic increment is a full barrier, it pairs with the fence in queue_wakeup
+  __atomic_add_fetch(nWaiting, 1, __ATOMIC_SEQ_CST);
+  while(!ready(que)) {
+    pthread_cond_wait(cond, &que->mutex);
+  }
+  __atomic_sub_fetch(nWaiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&que->mutex);
+  return 1;
+}
+
+//Wake up a parked thread after the queue has been modified
+static inline void queue_wakeup(queue_t *que, int *nWaiting, pthread_cond_t *cond) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(nWaiting, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&que->mutex);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&que->mutex);
+  }
+}
+
+void queue_terminate(queue_t * que) {
+  int n = __atomic_add_fetch(&que->nTerminated, 1, __ATOMIC_SEQ_CST);
+  assert(n <= que->nProducers);
+  if(n == que->nProducers) {
+    pthread_mutex_lock(&que->mutex);
+    pthread_cond_broadcast(&que->notEmpty);
+    pthread_mutex_unlock(&que->mutex);
+  }
+}
+
+//Transfer up to `limit' elements to buf, waits for elements only if `block' is set
+static int dequeue(queue_t *que, ringbuffer_t *buf, int limit, int block) {
+  unsigned long nRetries = 0;
+  int nWaits = 0;
+  int i;
+  void *temp;
+
+  while(1) {
+    for(i=0; i<limit && !ringbuffer_isFull(buf); i++) {
+      temp = queue_tryremove(que, &nRetries);
+      if(temp == NULL) break;
+      ringbuffer_insert(buf, temp);
+    }
+    if(i > 0 || ringbuffer_isFull(buf)) break;
+
+    if(queue_isTerminated(que)) {
+      //All producers are done. Elements they enqueued before terminating are
+      //guaranteed to be visible now, so the queue is empty if this fails.
+      temp = queue_tryremove(que, &nRetries);
+      if(temp == NULL) return -1;
+      ringbuffer_insert(buf, temp);
+      i = 1;
+      break;
+    }
+    if(!block) break;
+    nWaits += queue_wait(que, queue_canDequeue, &que->nWaitingEmpty, &que->notEmpty);
+  }
+
+#ifdef ENABLE_STATISTICS
+  if(i > 0) __atomic_fetch_add(&que->stats.nDequeues, 1, __ATOMIC_RELAXED);
+  if(nRetries > 0) __atomic_fetch_add(&que->stats.nDequeueContended, 1, __ATOMIC_RELAXED);
+  if(nWaits > 0) __atomic_fetch_add(&que->stats.nDequeueWaits, nWaits, __ATOMIC_RELAXED);
+#endif //ENABLE_STATISTICS
+  if(i > 0) queue_wakeup(que, &que->nWaitingFull, &que->notFull);
+  return i;
+}
+
+int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit) {
+  return dequeue(que, buf, limit, TRUE);
+}
+
+int queue_trydequeue(queue_t *que, ringbuffer_t *buf, int limit) {
+  return dequeue(que, buf, limit, FALSE);
+}
+
+int queue_enqueue(queue_t *que, ringbuffer_t *buf, int limit) {
+  unsigned long nRetries = 0;
+  int nWaits = 0;
+  int i;
+
+  assert(!queue_isTerminated(que));
+  while(1) {
+    for(i=0; i<limit && !ringbuffer_isEmpty(buf); i++) {
+      if(queue_tryinsert(que, buf->data[buf->tail], &nRetries) != 0) break;
+      ringbuffer_remove(buf);
+    }
+    if(i > 0 || ringbuffer_isEmpty(buf)) break;
+    nWaits += queue_wait(que, queue_canEnqueue, &que->nWaitingFull, &que->notFull);
+  }
+
+#ifdef ENABLE_STATISTICS
+  if(i > 0) __atomic_fetch_add(&que->stats.nEnqueues, 1, __ATOMIC_RELAXED);
+  if(nRetries > 0) __atomic_fetch_add(&que->stats.nEnqueueContended, 1, __ATOMIC_RELAXED);
+  if(nWaits > 0) __atomic_fetch_add(&que->stats.nEnqueueWaits, nWaits, __ATOMIC_RELAXED);
+#endif //ENABLE_STATISTICS
+  if(i > 0) queue_wakeup(que, &que->nWaitingEmpty, &que->notEmpty);
+  return i;
+}
+
+#endif //ENABLE_LOCKFREE_QUEUE
+
+#ifdef ENABLE_STATISTICS
+void queue_merge_stats(queue_t *que, queue_stats_t *s) {
+  assert(que!=NULL);
+  assert(s!=NULL);
+  s->nEnqueues += que->stats.nEnqueues;
+  s->nDequeues += que->stats.nDequeues;
+  s->nEnqueueContended += que->stats.nEnqueueContended;
+  s->nDequeueContended += que->stats.nDequeueContended;
+  s->nEnqueueWaits += que->stats.nEnqueueWaits;
+  s->nDequeueWaits += que->stats.nDequeueWaits;
+}
+#endif //ENABLE_STATISTICS
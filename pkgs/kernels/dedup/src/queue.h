@@ -3,10 +3,17 @@
 
 #include <stdlib.h>
 
+#include "config.h"
+
 #ifdef ENABLE_PTHREADS
 #include <pthread.h>
 #endif //ENABLE_PTHREADS
 
+//The lock-free queue needs pthreads to park waiting threads
+#if defined(ENABLE_LOCKFREE_QUEUE) && !defined(ENABLE_PTHREADS)
+#error "ENABLE_LOCKFREE_QUEUE requires ENABLE_PTHREADS"
+#endif
+
 //A simple ring buffer that can store a certain number of elements.
 //This is used for two purposes:
 // 1. To manage the elements inside a queue
@@ -19,6 +26,16 @@ struct _ringbuffer_t {
 
 typedef struct _ringbuffer_t ringbuffer_t;
 
+//Contention counters of a queue
+//Only maintained if ENABLE_STATISTICS is defined
+typedef struct {
+  unsigned long nEnqueues, nDequeues;         //number of successful queue operations
+  unsigned long nEnqueueContended;            //enqueue operations which had to compete for the queue
+  unsigned long nDequeueContended;            //dequeue operations which had to compete for the queue
+  unsigned long nEnqueueWaits, nDequeueWaits; //number of times a thread had to block because the queue was full resp. empty
+} queue_stats_t;
+
+#ifndef ENABLE_LOCKFREE_QUEUE
 //A synchronized queue.
 //Basically just a ring buffer with some synchronization added
 struct _queue_t {
@@ -29,7 +46,43 @@ struct _queue_t {
   pthread_mutex_t mutex;
   pthread_cond_t notEmpty, notFull;
 #endif //ENABLE_PTHREADS
+#ifdef ENABLE_STATISTICS
+  queue_stats_t stats;
+#endif //ENABLE_STATISTICS
+};
+#else
+#define QUEUE_CACHE_LINE_SIZE 64
+
+//A slot of the lock-free queue.
+//The sequence number tells producers and consumers whether the slot is ready for them:
+//A producer may use slot i if seq==pos, a consumer may use it if seq==pos+1.
+typedef struct {
+  size_t seq;
+  void *data;
+} queue_slot_t;
+
+//A lock-free bounded multi-producer multi-consumer queue.
+//Based on the array-based bounded queue by Dmitry Vyukov. Threads that
+//cannot make progress spin for a while before they park on a condition variable.
+struct _queue_t {
+  queue_slot_t *slots;
+  size_t mask; //number of slots - 1, number of slots is a power of two
+  int nProducers;
+  char pad0[QUEUE_CACHE_LINE_SIZE];
+  size_t head; //next position to enqueue
+  char pad1[QUEUE_CACHE_LINE_SIZE];
+  size_t tail; //next position to dequeue
+  char pad2[QUEUE_CACHE_LINE_SIZE];
+  int nTerminated;
+  //Waiting threads which have been parked, protected by mutex
+  int nWaitingEmpty, nWaitingFull;
+  pthread_mutex_t mutex;
+  pthread_cond_t notEmpty, notFull;
+#ifdef ENABLE_STATISTICS
+  queue_stats_t stats;
+#endif //ENABLE_STATISTICS
 };
+#endif //ENABLE_LOCKFREE_QUEUE
 
 typedef struct _queue_t queue_t;
 
@@ -105,7 +158,15 @@ void queue_destroy(queue_t * que);
 void queue_terminate(queue_t * que);
 
 int queue_dequeue(queue_t *que, ringbuffer_t *buf, int limit);
+//Same as queue_dequeue, but returns 0 instead of waiting if the queue is empty
+int queue_trydequeue(queue_t *que, ringbuffer_t *buf, int limit);
 int queue_enqueue(queue_t *que, ringbuffer_t *buf, int limit);
 
+#ifdef ENABLE_STATISTICS
+//Add the contention counters of a queue to `s'
+//Must not be called while the queue is in use
+void queue_merge_stats(queue_t *que, queue_stats_t *s);
+#endif //ENABLE_STATISTICS
+
 #endif //_QUEUE_H_
 
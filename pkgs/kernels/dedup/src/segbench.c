@@ -0,0 +1,242 @@
+/*
+ * Micro-benchmark for the content-defined chunking and fingerprinting
+ * algorithms of dedup
+ *
+ * Segments a buffer into chunks with each algorithm and reports the
+ * throughput of the segmentation alone, without any of the other
+ * pipeline stages. Afterwards the SHA1 sums of the resulting chunks are
+ * computed one at a time and in batches with the multi-buffer
+ * implementation, like the deduplication stage does. The buffer is either
+ * filled with pseudo-random data or loaded from a file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "dedupdef.h"
+#include "debug.h"
+#include "rabin.h"
+#include "gear.h"
+#include "sha.h"
+#include "sha1_mb.h"
+
+enum {
+  ALGO_RABIN = 0,
+  ALGO_GEAR_SCALAR,
+  ALGO_GEAR,
+  NALGOS
+};
+
+static const char *algo_str[NALGOS] = {"rabin", "gear (scalar)", "gear"};
+
+enum {
+  SHA1_SCALAR = 0,
+  SHA1_MB,
+  NSHA1
+};
+
+static const char *sha1_str[NSHA1] = {"sha1 (scalar)", "sha1 (mb)"};
+
+static u32int rabintab[256];
+static u32int rabinwintab[256];
+
+static double wtime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+//Segment the whole buffer with the given algorithm, returns the number of chunks
+static size_t segment_all(int algo, uchar *p, size_t n) {
+  size_t pos = 0;
+  size_t nchunks = 0;
+  int len, offset;
+
+  while(pos < n) {
+    //Segment in pieces of at most ANCHOR_JUMP bytes like the pipeline does
+    len = (int)MIN(n - pos, (size_t)ANCHOR_JUMP);
+    switch(algo) {
+      case ALGO_RABIN:
+        offset = rabinseg(p + pos, len, 0, rabintab, rabinwintab);
+        break;
+      case ALGO_GEAR_SCALAR:
+        offset = gearseg_scalar(p + pos, len);
+        break;
+      default:
+        offset = gearseg(p + pos, len);
+        break;
+    }
+    pos += offset;
+    nchunks++;
+  }
+  return nchunks;
+}
+
+//Record the chunks of the whole buffer, returns the number of chunks
+static size_t chunk_all(uchar *p, size_t n, size_t *ofs, size_t *len) {
+  size_t pos = 0;
+  size_t nchunks = 0;
+  int offset;
+
+  while(pos < n) {
+    offset = gearseg(p + pos, (int)MIN(n - pos, (size_t)ANCHOR_JUMP));
+    ofs[nchunks] = pos;
+    len[nchunks] = offset;
+    pos += offset;
+    nchunks++;
+  }
+  return nchunks;
+}
+
+//Compute SHA1 sums of all chunks in groups of CHUNK_ANCHOR_PER_FETCH like the deduplication stage
+static void hash_all(int impl, uchar *p, size_t nchunks, size_t *ofs, size_t *len, unsigned char *digests) {
+  const void *data[CHUNK_ANCHOR_PER_FETCH];
+  unsigned char *digest[CHUNK_ANCHOR_PER_FETCH];
+  size_t i, j, nbatch;
+
+  for(i=0; i<nchunks; i+=nbatch) {
+    nbatch = MIN(nchunks - i, (size_t)CHUNK_ANCHOR_PER_FETCH);
+    if(impl == SHA1_SCALAR) {
+      for(j=0; j<nbatch; j++) SHA1_Digest(p + ofs[i+j], len[i+j], digests + (i+j)*SHA1_LEN);
+    } else {
+      for(j=0; j<nbatch; j++) {
+        data[j] = p + ofs[i+j];
+        digest[j] = digests + (i+j)*SHA1_LEN;
+      }
+      SHA1_Digest_mb(data, len + i, digest, (int)nbatch);
+    }
+  }
+}
+
+static void usage(char *prog) {
+  printf("usage: %s [-i file] [-s size_in_MB] [-r repetitions]\n", prog);
+  printf("-i file\t\t\tsegment contents of file instead of random data\n");
+  printf("-s size\t\t\tsize of random data in MB (default: 256)\n");
+  printf("-r num\t\t\tnumber of repetitions (default: 5)\n");
+  printf("-h \t\t\thelp\n");
+}
+
+int main(int argc, char **argv) {
+  char *infile = NULL;
+  size_t n = 256UL*1024*1024;
+  int nreps = 5;
+  uchar *buf;
+  size_t i;
+  int ch, algo, rep;
+
+  while (-1 != (ch = getopt(argc, argv, "i:s:r:h"))) {
+    switch (ch) {
+    case 'i':
+      infile = optarg;
+      break;
+    case 's':
+      n = (size_t)atol(optarg) * 1024 * 1024;
+      break;
+    case 'r':
+      nreps = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if(n == 0 || nreps <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  //Prepare input
+  if(infile != NULL) {
+    struct stat filestat;
+    size_t bytes_read = 0;
+    int fd, r;
+
+    if(stat(infile, &filestat) < 0 || (fd = open(infile, O_RDONLY)) < 0)
+      EXIT_TRACE("Cannot open input file %s\n", infile);
+    n = filestat.st_size;
+    buf = (uchar *)malloc(n);
+    if(buf == NULL) EXIT_TRACE("Memory allocation failed.\n");
+    while(bytes_read < n) {
+      r = read(fd, buf + bytes_read, n - bytes_read);
+      if(r <= 0) EXIT_TRACE("I/O error\n");
+      bytes_read += r;
+    }
+    close(fd);
+  } else {
+    u32int x = 2463534242u;
+    buf = (uchar *)malloc(n);
+    if(buf == NULL) EXIT_TRACE("Memory allocation failed.\n");
+    for(i=0; i<n; i++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      buf[i] = (uchar)(x >> 24);
+    }
+  }
+
+  rabininit(0, rabintab, rabinwintab);
+  gearinit();
+  SHA1_mb_init();
+
+  printf("Input size:                    %14.2f MB\n", (double)n / (1024.0*1024.0));
+  printf("Vectorized gear scan:          %14s\n", gearseg_is_vectorized() ? "yes" : "no");
+  printf("\n");
+  for(algo=0; algo<NALGOS; algo++) {
+    double best = 0.0;
+    size_t nchunks = 0;
+
+    for(rep=0; rep<nreps; rep++) {
+      double t = wtime();
+      nchunks = segment_all(algo, buf, n);
+      t = wtime() - t;
+      if(rep == 0 || t < best) best = t;
+    }
+    printf("%-14s %8.3f GB/s  (%lu chunks, mean chunk size: %.2f KB)\n", algo_str[algo],
+           (double)n / best / 1e9, (unsigned long)nchunks, (double)n / (double)nchunks / 1024.0);
+  }
+
+  //Fingerprint the chunks found by the gear hash
+  {
+    size_t *ofs, *len;
+    unsigned char *digests[NSHA1];
+    size_t nchunks;
+    int impl;
+
+    //Every chunk but the last one has at least NWINDOW bytes
+    ofs = (size_t *)malloc((n / NWINDOW + 1) * sizeof(size_t));
+    len = (size_t *)malloc((n / NWINDOW + 1) * sizeof(size_t));
+    if(ofs == NULL || len == NULL) EXIT_TRACE("Memory allocation failed.\n");
+    nchunks = chunk_all(buf, n, ofs, len);
+
+    printf("\n");
+    printf("Multi-buffer SHA1 lanes:       %14d (%s)\n", SHA1_MB_LANES, SHA1_mb_isa());
+    printf("\n");
+    for(impl=0; impl<NSHA1; impl++) {
+      double best = 0.0;
+
+      digests[impl] = (unsigned char *)malloc(nchunks * SHA1_LEN);
+      if(digests[impl] == NULL) EXIT_TRACE("Memory allocation failed.\n");
+      for(rep=0; rep<nreps; rep++) {
+        double t = wtime();
+        hash_all(impl, buf, nchunks, ofs, len, digests[impl]);
+        t = wtime() - t;
+        if(rep == 0 || t < best) best = t;
+      }
+      printf("%-14s %8.3f GB/s  (%lu chunks)\n", sha1_str[impl], (double)n / best / 1e9, (unsigned long)nchunks);
+    }
+    if(memcmp(digests[SHA1_SCALAR], digests[SHA1_MB], nchunks * SHA1_LEN) != 0)
+      EXIT_TRACE("SHA1 sums of multi-buffer implementation differ from scalar implementation\n");
+
+    for(impl=0; impl<NSHA1; impl++) free(digests[impl]);
+    free(ofs);
+    free(len);
+  }
+
+  free(buf);
+  return 0;
+}
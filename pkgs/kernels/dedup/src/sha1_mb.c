@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "sha1_mb.h"
+
+//Use AVX2 for the compression function if the CPU supports it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENABLE_SHA1_MB_AVX2
+#endif
+
+#define SHA1_BLOCK_LEN 64
+
+typedef uint32_t vec_t __attribute__ ((vector_size (4*SHA1_MB_LANES)));
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32-(n))))
+
+//State of a lane while it is processing a buffer
+typedef struct {
+  const unsigned char *data; //next full block of the buffer
+  size_t nfull; //number of full blocks left
+  int ntail; //number of padding blocks left
+  int tail_idx; //index of next padding block
+  unsigned char tail[2*SHA1_BLOCK_LEN]; //last bytes of the buffer with SHA1 padding
+  int job; //index of the buffer in the batch, -1 if lane is idle
+} lane_t;
+
+static const uint32_t sha1_iv[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+static inline uint32_t load_be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(unsigned char *p, uint32_t x) {
+  p[0] = (unsigned char)(x >> 24);
+  p[1] = (unsigned char)(x >> 16);
+  p[2] = (unsigned char)(x >> 8);
+  p[3] = (unsigned char)x;
+}
+
+//Compression function, processes one block for each lane
+//NOTE: Vectors are never passed by value so both variants can share one calling convention
+#define SHA1_MB_COMPRESS_BODY                                                      \
+  vec_t a, b, c, d, e, f, t, w[16];                                                \
+  int i;                                                                           \
+                                                                                   \
+  memcpy(&a, state[0], sizeof(vec_t));                                             \
+  memcpy(&b, state[1], sizeof(vec_t));                                             \
+  memcpy(&c, state[2], sizeof(vec_t));                                             \
+  memcpy(&d, state[3], sizeof(vec_t));                                             \
+  memcpy(&e, state[4], sizeof(vec_t));                                             \
+  for(i=0; i<16; i++) memcpy(&w[i], block[i], sizeof(vec_t));                      \
+                                                                                   \
+  for(i=0; i<80; i++) {                                                            \
+    if(i >= 16) {                                                                  \
+      t = w[(i-3)&15] ^ w[(i-8)&15] ^ w[(i-14)&15] ^ w[i&15];                      \
+      w[i&15] = ROL(t, 1);                                                         \
+    }                                                                              \
+    if(i < 20) {                                                                   \
+      f = (b & c) | (~b & d);                                                      \
+      t = ROL(a, 5) + f + e + 0x5a827999 + w[i&15];                                \
+    } else if(i < 40) {                                                            \
+      f = b ^ c ^ d;                                                               \
+      t = ROL(a, 5) + f + e + 0x6ed9eba1 + w[i&15];                                \
+    } else if(i < 60) {                                                            \
+      f = (b & c) | (b & d) | (c & d);                                             \
+      t = ROL(a, 5) + f + e + 0x8f1bbcdc + w[i&15];                                \
+    } else {                                                                       \
+      f = b ^ c ^ d;                                                               \
+      t = ROL(a, 5) + f + e + 0xca62c1d6 + w[i&15];                                \
+    }                                                                              \
+    e = d;                                                                         \
+    d = c;                                                                         \
+    c = ROL(b, 30);                                                                \
+    b = a;                                                                         \
+    a = t;                                                                         \
+  }                                                                                \
+                                                                                   \
+  for(i=0; i<5; i++) {                                                             \
+    vec_t s;                                                                       \
+    memcpy(&s, state[i], sizeof(vec_t));                                           \
+    s += (i==0) ? a : (i==1) ? b : (i==2) ? c : (i==3) ? d : e;                    \
+    memcpy(state[i], &s, sizeof(vec_t));                                           \
+  }
+
+static void sha1_mb_compress(uint32_t state[5][SHA1_MB_LANES], uint32_t block[16][SHA1_MB_LANES]) {
+  SHA1_MB_COMPRESS_BODY
+}
+
+#ifdef ENABLE_SHA1_MB_AVX2
+__attribute__ ((target ("avx2")))
+static void sha1_mb_compress_avx2(uint32_t state[5][SHA1_MB_LANES], uint32_t block[16][SHA1_MB_LANES]) {
+  SHA1_MB_COMPRESS_BODY
+}
+#endif //ENABLE_SHA1_MB_AVX2
+
+static void (*compress_fn)(uint32_t [5][SHA1_MB_LANES], uint32_t [16][SHA1_MB_LANES]) = NULL;
+static const char *isa_str = NULL;
+
+//Select compression function for this CPU
+void SHA1_mb_init() {
+#ifdef ENABLE_SHA1_MB_AVX2
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    isa_str = "avx2";
+    compress_fn = sha1_mb_compress_avx2;
+    return;
+  }
+#endif //ENABLE_SHA1_MB_AVX2
+  isa_str = "generic";
+  compress_fn = sha1_mb_compress;
+}
+
+const char *SHA1_mb_isa() {
+  return isa_str;
+}
+
+//Assign a buffer to a lane and prepare the padding blocks
+static void lane_start(lane_t *l, int job, const unsigned char *data, size_t len) {
+  size_t rem = len % SHA1_BLOCK_LEN;
+  uint64_t bits = (uint64_t)len * 8;
+  int i;
+
+  l->job = job;
+  l->data = data;
+  l->nfull = len / SHA1_BLOCK_LEN;
+  l->ntail = (rem + 9 <= SHA1_BLOCK_LEN) ? 1 : 2;
+  l->tail_idx = 0;
+  memset(l->tail, 0, sizeof(l->tail));
+  memcpy(l->tail, data + l->nfull * SHA1_BLOCK_LEN, rem);
+  l->tail[rem] = 0x80;
+  for(i=0; i<8; i++) {
+    l->tail[l->ntail*SHA1_BLOCK_LEN - 1 - i] = (unsigned char)(bits >> (8*i));
+  }
+}
+
+//Return next block of a lane and advance, NULL if the lane has no blocks left
+static inline const unsigned char *lane_next(lane_t *l) {
+  const unsigned char *p;
+
+  if(l->nfull > 0) {
+    p = l->data;
+    l->data += SHA1_BLOCK_LEN;
+    l->nfull--;
+    return p;
+  }
+  if(l->tail_idx < l->ntail) {
+    return &l->tail[SHA1_BLOCK_LEN * l->tail_idx++];
+  }
+  return NULL;
+}
+
+void SHA1_Digest_mb(const void **data, const size_t *len, unsigned char **digest, int n) {
+  uint32_t state[5][SHA1_MB_LANES] __attribute__ ((aligned (32)));
+  uint32_t block[16][SHA1_MB_LANES] __attribute__ ((aligned (32)));
+  lane_t lanes[SHA1_MB_LANES];
+  int next = 0; //next buffer to assign to a lane
+  int active = 0; //number of lanes with a buffer
+  int i, j, k;
+
+  //Buffers which don't fill all lanes are cheaper to do with the scalar code
+  if(n < SHA1_MB_LANES/2) {
+    for(i=0; i<n; i++) SHA1_Digest(data[i], len[i], digest[i]);
+    return;
+  }
+
+  for(j=0; j<SHA1_MB_LANES; j++) {
+    lanes[j].job = -1;
+    if(next < n) {
+      lane_start(&lanes[j], next, (const unsigned char *)data[next], len[next]);
+      for(k=0; k<5; k++) state[k][j] = sha1_iv[k];
+      next++;
+      active++;
+    }
+  }
+
+  while(active > 0) {
+    //Gather next block of each lane, refill lanes whose buffer is done
+    for(j=0; j<SHA1_MB_LANES; j++) {
+      const unsigned char *p = NULL;
+
+      while(lanes[j].job >= 0 && (p = lane_next(&lanes[j])) == NULL) {
+        //Lane finished its buffer, write digest and start next buffer
+        for(k=0; k<5; k++) store_be32(digest[lanes[j].job] + 4*k, state[k][j]);
+        lanes[j].job = -1;
+        active--;
+        if(next < n) {
+          lane_start(&lanes[j], next, (const unsigned char *)data[next], len[next]);
+          for(k=0; k<5; k++) state[k][j] = sha1_iv[k];
+          next++;
+          active++;
+        }
+      }
+      if(p != NULL) {
+        for(i=0; i<16; i++) block[i][j] = load_be32(p + 4*i);
+      } else {
+        //Idle lane, results are ignored
+        for(i=0; i<16; i++) block[i][j] = 0;
+      }
+    }
+    if(active == 0) break;
+    compress_fn(state, block);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef _SHA1_MB_H_
+#define _SHA1_MB_H_
+
+#include <stddef.h>
+
+#include "sha.h"
+
+/* Multi-buffer SHA1 for dedup
+ *
+ * Computes the SHA1 sums of several independent buffers at the same time.
+ * Each buffer is assigned to one lane of a SIMD register, so the compression
+ * function processes one block of SHA1_MB_LANES buffers with every call.
+ * Whenever a buffer is finished its lane is refilled with the next buffer of
+ * the batch, which keeps the lanes busy even if the buffer sizes differ.
+ *
+ * The implementation uses GCC vector extensions. On x86 CPUs with AVX2 all
+ * lanes fit into one register, otherwise the compiler splits each vector
+ * operation into several SSE (or scalar) instructions.
+ */
+
+//Number of buffers which are hashed in parallel
+#define SHA1_MB_LANES 8
+
+//Select the implementation for this CPU. Must be called once before any
+//thread uses SHA1_Digest_mb or SHA1_mb_isa.
+void SHA1_mb_init();
+
+//Compute the SHA1 sums of `n' buffers. Digest i is written to digest[i] and
+//is identical to the result of SHA1_Digest(data[i], len[i], digest[i]).
+void SHA1_Digest_mb(const void **data, const size_t *len, unsigned char **digest, int n);
+
+//Returns a short description of the instruction set used by SHA1_Digest_mb
+const char *SHA1_mb_isa();
+
+#endif //_SHA1_MB_H_
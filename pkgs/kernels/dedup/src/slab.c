@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef ENABLE_PTHREADS
+#include <pthread.h>
+#endif //ENABLE_PTHREADS
+
+#ifdef ENABLE_DMALLOC
+#include <dmalloc.h>
+#endif //ENABLE_DMALLOC
+
+#include "slab.h"
+
+//Alignment of objects
+#define SLAB_ALIGN 16
+//Space reserved at the beginning of each slab for the list of slabs
+#define SLAB_HEADER 64
+
+//Free objects are linked through their first word, the first object of
+//a batch in the depot links to the next batch with its second word
+#define NEXT_OBJ(p) (((void **)(p))[0])
+#define NEXT_BATCH(p) (((void **)(p))[1])
+
+//Thread-local state of an allocator
+//A cache holds up to two batches of free objects: `loaded' is used for
+//allocations and frees, `previous' is either empty or a full batch.
+struct _slab_cache_t {
+  void *loaded;
+  int nloaded;
+  void *previous;
+  size_t nAllocs;
+  size_t nFrees;
+  slab_cache_t *next; //next cache of the same allocator
+};
+
+//The thread caches of all allocators of the calling thread
+static __thread struct {
+  unsigned int gen;
+  slab_cache_t *cache;
+} tls_caches[SLAB_MAX_ALLOCATORS];
+
+//Cache slots which are in use and generation of the next allocator
+static int slots_used[SLAB_MAX_ALLOCATORS];
+static unsigned int next_gen = 1;
+#ifdef ENABLE_PTHREADS
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif //ENABLE_PTHREADS
+
+static inline void slab_lock(slab_t *s) {
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_lock(&s->lock);
+#endif //ENABLE_PTHREADS
+}
+
+static inline void slab_unlock(slab_t *s) {
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_unlock(&s->lock);
+#endif //ENABLE_PTHREADS
+}
+
+int slab_init(slab_t *s, size_t size) {
+  int i;
+
+  assert(s!=NULL);
+  assert(size > 0);
+
+  //Objects must be able to hold the list pointers while they are free
+  if(size < 2*sizeof(void *)) size = 2*sizeof(void *);
+  s->objsize = (size + SLAB_ALIGN - 1) & ~((size_t)SLAB_ALIGN - 1);
+  if(SLAB_HEADER + SLAB_BATCH * s->objsize > SLAB_SIZE) return -1;
+
+  s->slabs = NULL;
+  s->depot = NULL;
+  s->caches = NULL;
+  s->nBatchesReturned = 0;
+  s->nBatchesFetched = 0;
+  s->nSlabs = 0;
+
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_lock(&slots_lock);
+#endif //ENABLE_PTHREADS
+  for(i=0; i<SLAB_MAX_ALLOCATORS && slots_used[i]; i++);
+  if(i < SLAB_MAX_ALLOCATORS) {
+    slots_used[i] = 1;
+    s->slot = i;
+    s->gen = next_gen++;
+  }
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_unlock(&slots_lock);
+#endif //ENABLE_PTHREADS
+  if(i == SLAB_MAX_ALLOCATORS) return -1;
+
+#ifdef ENABLE_PTHREADS
+  if(pthread_mutex_init(&s->lock, NULL) != 0) {
+    pthread_mutex_lock(&slots_lock);
+    slots_used[s->slot] = 0;
+    pthread_mutex_unlock(&slots_lock);
+    return -1;
+  }
+#endif //ENABLE_PTHREADS
+
+  return 0;
+}
+
+void slab_destroy(slab_t *s) {
+  void *p, *next;
+  slab_cache_t *c, *cnext;
+
+  assert(s!=NULL);
+
+  for(p=s->slabs; p!=NULL; p=next) {
+    next = NEXT_OBJ(p);
+    free(p);
+  }
+  for(c=s->caches; c!=NULL; c=cnext) {
+    cnext = c->next;
+    free(c);
+  }
+  s->slabs = NULL;
+  s->depot = NULL;
+  s->caches = NULL;
+
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_destroy(&s->lock);
+  pthread_mutex_lock(&slots_lock);
+#endif //ENABLE_PTHREADS
+  slots_used[s->slot] = 0;
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_unlock(&slots_lock);
+#endif //ENABLE_PTHREADS
+}
+
+//Get the cache of the calling thread, creates it on first use
+static inline slab_cache_t *get_cache(slab_t *s) {
+  slab_cache_t *c;
+
+  if(tls_caches[s->slot].gen == s->gen) return tls_caches[s->slot].cache;
+
+  c = (slab_cache_t *)malloc(sizeof(slab_cache_t));
+  if(c == NULL) return NULL;
+  memset(c, 0, sizeof(slab_cache_t));
+  slab_lock(s);
+  c->next = s->caches;
+  s->caches = c;
+  slab_unlock(s);
+
+  tls_caches[s->slot].gen = s->gen;
+  tls_caches[s->slot].cache = c;
+  return c;
+}
+
+//Fill an empty cache with objects from the depot or a new slab
+//Returns 0 if the operation was successful
+static int refill(slab_t *s, slab_cache_t *c) {
+  assert(c->nloaded == 0);
+
+  slab_lock(s);
+  if(s->depot == NULL) {
+    //Carve a new slab into batches, the remainder goes directly to the cache
+    char *slab = (char *)malloc(SLAB_SIZE);
+    size_t nobjs, i;
+
+    if(slab == NULL) {
+      slab_unlock(s);
+      return -1;
+    }
+    NEXT_OBJ(slab) = s->slabs;
+    s->slabs = slab;
+    s->nSlabs++;
+
+    nobjs = (SLAB_SIZE - SLAB_HEADER) / s->objsize;
+    for(i=0; i<nobjs; i++) {
+      void *p = slab + SLAB_HEADER + i * s->objsize;
+      if(i < nobjs % SLAB_BATCH) {
+        NEXT_OBJ(p) = c->loaded;
+        c->loaded = p;
+        c->nloaded++;
+      } else {
+        //Objects are added in order, so the first object of a batch is its last one
+        int k = (int)((i - nobjs % SLAB_BATCH) % SLAB_BATCH);
+        if(k == 0) {
+          NEXT_OBJ(p) = NULL;
+        } else {
+          NEXT_OBJ(p) = p - s->objsize;
+        }
+        if(k == SLAB_BATCH-1) {
+          NEXT_BATCH(p) = s->depot;
+          s->depot = p;
+        }
+      }
+    }
+  }
+  if(c->nloaded == 0) {
+    assert(s->depot != NULL);
+    c->loaded = s->depot;
+    c->nloaded = SLAB_BATCH;
+    s->depot = NEXT_BATCH(c->loaded);
+    s->nBatchesFetched++;
+  }
+  slab_unlock(s);
+
+  return 0;
+}
+
+void *slab_alloc(slab_t *s) {
+  slab_cache_t *c;
+  void *p;
+
+  assert(s!=NULL);
+
+  c = get_cache(s);
+  if(c == NULL) return NULL;
+
+  if(c->nloaded == 0) {
+    if(c->previous != NULL) {
+      c->loaded = c->previous;
+      c->nloaded = SLAB_BATCH;
+      c->previous = NULL;
+    } else if(refill(s, c) != 0) {
+      return NULL;
+    }
+  }
+
+  p = c->loaded;
+  c->loaded = NEXT_OBJ(p);
+  c->nloaded--;
+  c->nAllocs++;
+  return p;
+}
+
+void slab_free(slab_t *s, void *p) {
+  slab_cache_t *c;
+
+  assert(s!=NULL);
+  if(p == NULL) return;
+
+  c = get_cache(s);
+  //Without a cache the object cannot be recycled, it is released with the slab
+  if(c == NULL) return;
+
+  if(c->nloaded == SLAB_BATCH) {
+    //Loaded batch is full, return the older full batch to the depot
+    if(c->previous != NULL) {
+      slab_lock(s);
+      NEXT_BATCH(c->previous) = s->depot;
+      s->depot = c->previous;
+      s->nBatchesReturned++;
+      slab_unlock(s);
+    }
+    c->previous = c->loaded;
+    c->loaded = NULL;
+    c->nloaded = 0;
+  }
+
+  NEXT_OBJ(p) = c->loaded;
+  c->loaded = p;
+  c->nloaded++;
+  c->nFrees++;
+}
+
+void slab_get_stats(slab_t *s, slab_stats_t *stats) {
+  slab_cache_t *c;
+
+  assert(s!=NULL);
+  assert(stats!=NULL);
+
+  memset(stats, 0, sizeof(slab_stats_t));
+  stats->objsize = s->objsize;
+  for(c=s->caches; c!=NULL; c=c->next) {
+    stats->nAllocs += c->nAllocs;
+    stats->nFrees += c->nFrees;
+  }
+  stats->nBatchesReturned = s->nBatchesReturned;
+  stats->nBatchesFetched = s->nBatchesFetched;
+  stats->nSlabs = s->nSlabs;
+  stats->nBytes = s->nSlabs * SLAB_SIZE;
+}
@@ -0,0 +1,84 @@
+/* Slab allocator for small objects of a fixed size
+ *
+ * Dedup allocates and frees a chunk_t and a memory control block for each
+ * chunk, usually in different threads: Objects are allocated by the
+ * fragmentation stages and released by the reorder stage. Doing this with
+ * malloc/free causes a lot of contention in the system allocator.
+ *
+ * Each thread keeps a private cache of free objects which serves allocations
+ * and frees without any synchronization. Objects are carved out of large
+ * slabs. If the cache of a thread grows too big because the thread frees
+ * objects allocated by other threads, it returns them in batches of
+ * SLAB_BATCH objects to a shared depot. A thread whose cache is empty takes
+ * a whole batch from the depot before it allocates a new slab. The depot is
+ * the only part protected by a lock.
+ *
+ * Objects still held in the cache of a terminated thread are not reused.
+ * All memory is released at once with slab_destroy.
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stdlib.h>
+
+#ifdef ENABLE_PTHREADS
+#include <pthread.h>
+#endif //ENABLE_PTHREADS
+
+//Number of objects moved between the thread caches and the depot at a time
+#define SLAB_BATCH 64
+
+//Size of the memory blocks from which objects are allocated
+#define SLAB_SIZE (64*1024)
+
+//Maximum number of allocators that can exist at the same time
+#define SLAB_MAX_ALLOCATORS 8
+
+typedef struct _slab_cache_t slab_cache_t;
+
+//Allocation statistics
+typedef struct {
+  size_t objsize; //Size of an object in bytes, including padding
+  size_t nAllocs; //Number of objects allocated
+  size_t nFrees; //Number of objects freed
+  size_t nBatchesReturned; //Number of batches of free objects returned to the depot
+  size_t nBatchesFetched; //Number of batches of free objects taken from the depot
+  size_t nSlabs; //Number of slabs allocated from the system
+  size_t nBytes; //Number of bytes allocated from the system
+} slab_stats_t;
+
+//A slab allocator for objects of one size
+typedef struct {
+  size_t objsize; //size of an object in bytes, including padding
+  int slot; //thread-local cache slot used by the allocator
+  unsigned int gen; //generation of the allocator, identifies stale thread-local caches
+  void *slabs; //list of slabs allocated from the system
+  void *depot; //list of batches with free objects
+  slab_cache_t *caches; //list of thread caches
+  size_t nBatchesReturned;
+  size_t nBatchesFetched;
+  size_t nSlabs;
+#ifdef ENABLE_PTHREADS
+  pthread_mutex_t lock; //protects depot, slabs and caches
+#endif //ENABLE_PTHREADS
+} slab_t;
+
+//Initialize an allocator for objects of `size' bytes
+//Returns 0 if the operation was successful
+int slab_init(slab_t *s, size_t size);
+
+//Release all memory of an allocator, including objects which have not been freed
+void slab_destroy(slab_t *s);
+
+//Allocate an object, returns NULL if out of memory
+void *slab_alloc(slab_t *s);
+
+//Free an object, can be called by any thread
+void slab_free(slab_t *s, void *p);
+
+//Collect the allocation statistics of all threads
+//No other thread may use the allocator at the same time
+void slab_get_stats(slab_t *s, slab_stats_t *stats);
+
+#endif //_SLAB_H_
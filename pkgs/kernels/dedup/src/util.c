@@ -42,6 +42,31 @@ int xwrite(int sd, const void *buf, size_t len) {
   return nsent;
 }
 
+int xwritev(int sd, struct iovec *iov, int iovcnt) {
+  size_t nsent = 0;
+  ssize_t rv;
+
+  while (iovcnt > 0) {
+    rv = writev(sd, iov, iovcnt);
+    if (0 > rv && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (0 > rv)
+      return -1;
+    nsent += rv;
+    //skip buffers which have been written completely, adjust partially written one
+    while (iovcnt > 0 && (size_t)rv >= iov->iov_len) {
+      rv -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + rv;
+      iov->iov_len -= rv;
+    }
+  }
+  return nsent;
+}
+
 int read_header(int fd, byte *compress_type) {
   int checkbit;
 
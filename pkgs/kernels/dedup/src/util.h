@@ -1,11 +1,15 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+#include <sys/uio.h>
+
 #include "dedupdef.h"
 
 /* File I/O with error checking */
 int xread(int sd, void *buf, size_t len);
 int xwrite(int sd, const void *buf, size_t len);
+//Write all buffers of an I/O vector, the vector is modified on partial writes
+int xwritev(int sd, struct iovec *iov, int iovcnt);
 
 /* Process file header */
 int read_header(int fd, byte *compress_type);
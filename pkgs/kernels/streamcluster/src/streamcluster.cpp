@@ -15,6 +15,10 @@
 #include <math.h>
 #include <sys/resource.h>
 #include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifdef ENABLE_THREADS
 #include <pthread.h>
@@ -948,7 +952,7 @@ double pgain(long x, Points *points, double z, long int *numcenters)
 
 #else //!TBB_VERSION
 
-
+#ifdef ORIGINAL_PGAIN
 double pgain(long x, Points *points, double z, long int *numcenters, int pid, pthread_barrier_t* barrier)
 {
   //  printf("pgain pthread %d begin\n",pid);
@@ -1160,6 +1164,273 @@ double pgain(long x, Points *points, double z, long int *numcenters, int pid, pt
   return -gl_cost_of_opening_x;
 }
 
+
+#else //!ORIGINAL_PGAIN
+
+/* Dynamically scheduled pgain
+ *
+ * The coordinates are copied into a blocked structure-of-arrays layout once
+ * the order of the points is fixed for a call of pkmedian: each group of
+ * SOA_LANES consecutive points stores coordinate d of all its points next to
+ * each other, so the distances of a whole group to x take one SIMD operation
+ * per dimension. Each distance is summed up in the same order as in dist().
+ *
+ * Threads take chunks of PGAIN_CHUNK points from a shared counter instead of
+ * working on a fixed block. The savings of each chunk are stored separately
+ * and every thread sums them up in chunk order, so the result neither depends
+ * on which thread processed a chunk nor needs a thread to collect it. The
+ * centers are kept in a compact list that only changes if x is opened. A
+ * call of pgain needs one barrier, three if x is opened.
+ *
+ * Compile with -DORIGINAL_PGAIN to use the original static partitioning.
+ */
+
+#define SOA_LANES 8 // points per group of the SoA layout
+#define PGAIN_CHUNK 512 // points per unit of work, multiple of SOA_LANES
+
+typedef float soa_vec __attribute__((vector_size(SOA_LANES*sizeof(float))));
+
+static float *soa_coord; //coordinates in blocked SoA layout
+static float *x_cost; //cost of assigning each point to x in the current pgain call
+static int *center_list; //the current centers, center_table maps them to their position
+static int num_listed; //number of entries in center_list
+static double *gain_mem[2]; //savings per chunk and per thread, one buffer for odd and even calls
+static int gain_stride; //doubles per row of gain_mem, room for the centers and the cost
+static volatile long next_chunk[2]; //next chunk to process, one counter for odd and even calls
+static __thread unsigned int gain_round; //number of pgain calls of this thread
+
+//Allocate both buffers of gain_mem with room for `ncenters' centers
+static void pgain_alloc(long num, int ncenters)
+{
+  long nrows = (num + PGAIN_CHUNK - 1) / PGAIN_CHUNK + nproc;
+  int cl = CACHE_LINE/sizeof(double);
+
+  gain_stride = ((ncenters + 1) / cl + 1) * cl;
+  for( int r = 0; r < 2; r++ ) {
+    free(gain_mem[r]);
+    gain_mem[r] = (double *)malloc(nrows * gain_stride * sizeof(double));
+    if( gain_mem[r] == NULL ) {
+      fprintf(stderr, "not enough memory for pgain!\n");
+      exit(1);
+    }
+  }
+}
+
+//Set up the center list and the work memory, called by one thread
+static void pgain_init(Points *points)
+{
+  center_list = (int *)malloc(points->num * sizeof(int));
+  num_listed = 0;
+  for( int i = 0; i < points->num; i++ ) {
+    if( is_center[i] ) {
+      center_table[i] = num_listed;
+      center_list[num_listed++] = i;
+    }
+  }
+  gain_mem[0] = gain_mem[1] = NULL;
+  pgain_alloc(points->num, 2*num_listed);
+  next_chunk[0] = next_chunk[1] = 0;
+}
+
+static void pgain_free()
+{
+  free(center_list);
+  free(gain_mem[0]);
+  free(gain_mem[1]);
+}
+
+//Copy the coordinates of my block of points into the SoA layout
+static void pgain_transpose(Points *points, int pid)
+{
+  const int dim = points->dim;
+  long bsize = points->num/nproc;
+  long k1 = bsize * pid;
+  long k2 = k1 + bsize;
+  if( pid == nproc-1 ) {
+    k2 = points->num;
+    //unused lanes of the last group
+    for( long i = k2; i % SOA_LANES != 0; i++ ) {
+      for( int d = 0; d < dim; d++ ) {
+	soa_coord[(i/SOA_LANES)*dim*SOA_LANES + d*SOA_LANES + i%SOA_LANES] = 0.0;
+      }
+    }
+  }
+
+  for( long i = k1; i < k2; i++ ) {
+    float *dst = &soa_coord[(i/SOA_LANES)*dim*SOA_LANES + i%SOA_LANES];
+    for( int d = 0; d < dim; d++ ) {
+      dst[d*SOA_LANES] = points->p[i].coord[d];
+    }
+  }
+  gain_round = 0;
+}
+
+/* compute Euclidean distance squared between point x and the points of groups g1 to g2 */
+static inline __attribute__((always_inline))
+void dist_soa_body(const float *px, int dim, long g1, long g2, float *out)
+{
+  long g = g1;
+
+  //four groups at a time to hide the latency of the additions
+  for( ; g + 4 <= g2; g += 4 ) {
+    const soa_vec *b0 = (const soa_vec *)&soa_coord[g*dim*SOA_LANES];
+    const soa_vec *b1 = b0 + dim, *b2 = b1 + dim, *b3 = b2 + dim;
+    soa_vec a0 = {0}, a1 = {0}, a2 = {0}, a3 = {0};
+    for( int d = 0; d < dim; d++ ) {
+      soa_vec t0 = b0[d] - px[d], t1 = b1[d] - px[d];
+      soa_vec t2 = b2[d] - px[d], t3 = b3[d] - px[d];
+      a0 += t0*t0; a1 += t1*t1; a2 += t2*t2; a3 += t3*t3;
+    }
+    memcpy(&out[(g-g1)*SOA_LANES], &a0, sizeof(soa_vec));
+    memcpy(&out[(g-g1+1)*SOA_LANES], &a1, sizeof(soa_vec));
+    memcpy(&out[(g-g1+2)*SOA_LANES], &a2, sizeof(soa_vec));
+    memcpy(&out[(g-g1+3)*SOA_LANES], &a3, sizeof(soa_vec));
+  }
+  for( ; g < g2; g++ ) {
+    const soa_vec *b0 = (const soa_vec *)&soa_coord[g*dim*SOA_LANES];
+    soa_vec a0 = {0};
+    for( int d = 0; d < dim; d++ ) {
+      soa_vec t0 = b0[d] - px[d];
+      a0 += t0*t0;
+    }
+    memcpy(&out[(g-g1)*SOA_LANES], &a0, sizeof(soa_vec));
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void dist_soa_avx2(const float *px, int dim, long g1, long g2, float *out)
+{
+  dist_soa_body(px, dim, g1, g2, out);
+}
+#endif
+
+static void dist_soa_generic(const float *px, int dim, long g1, long g2, float *out)
+{
+  dist_soa_body(px, dim, g1, g2, out);
+}
+
+static void dist_soa(const float *px, int dim, long g1, long g2, float *out)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static int has_avx2 = -1;
+  if( has_avx2 < 0 ) has_avx2 = __builtin_cpu_supports("avx2");
+  if( has_avx2 ) {
+    dist_soa_avx2(px, dim, g1, g2, out);
+    return;
+  }
+#endif
+  dist_soa_generic(px, dim, g1, g2, out);
+}
+
+double pgain(long x, Points *points, double z, long int *numcenters, int pid, pthread_barrier_t* barrier)
+{
+  const long nchunks = (points->num + PGAIN_CHUNK - 1) / PGAIN_CHUNK;
+  const int round = gain_round++ & 1;
+  const int stride = gain_stride;
+  const int K = num_listed;
+  double *mem = gain_mem[round];
+  long c;
+
+  //the counter of the other buffer was last used before the previous barrier
+  if( pid == 0 ) next_chunk[round^1] = 0;
+
+  while( (c = __sync_fetch_and_add(&next_chunk[round], 1)) < nchunks ) {
+    long k1 = c * PGAIN_CHUNK;
+    long k2 = k1 + PGAIN_CHUNK < points->num ? k1 + PGAIN_CHUNK : points->num;
+    double *lower = &mem[c*stride];
+    double cost_of_opening_x = 0;
+
+    memset(lower, 0, K*sizeof(double));
+    dist_soa(points->p[x].coord, points->dim, k1/SOA_LANES, (k2+SOA_LANES-1)/SOA_LANES, &x_cost[k1]);
+    for( long i = k1; i < k2; i++ ) {
+      float cost = x_cost[i] * points->p[i].weight;
+      float current_cost = points->p[i].cost;
+
+      x_cost[i] = cost;
+      if ( cost < current_cost ) {
+	// point i would save cost just by switching to x
+	cost_of_opening_x += cost - current_cost;
+      } else {
+	// the current median of i would save less by closing
+	lower[center_table[points->p[i].assign]] += current_cost - cost;
+      }
+    }
+    mem[c*stride + K] = cost_of_opening_x;
+  }
+
+#ifdef ENABLE_THREADS
+  pthread_barrier_wait(barrier);
+#endif
+
+  //sum up the savings of all chunks, every thread gets the same result
+  double *gl_lower = &mem[(nchunks+pid)*stride];
+  double gl_cost_of_opening_x = z;
+  int gl_number_of_centers_to_close = 0;
+
+  for( int j = 0; j < K; j++ ) gl_lower[j] = z;
+  for( c = 0; c < nchunks; c++ ) {
+    const double *lower = &mem[c*stride];
+    for( int j = 0; j < K; j++ ) gl_lower[j] += lower[j];
+    gl_cost_of_opening_x += lower[K];
+  }
+  for( int j = 0; j < K; j++ ) {
+    if( gl_lower[j] > 0 ) {
+      // center j would close if we opened x
+      ++gl_number_of_centers_to_close;
+      gl_cost_of_opening_x -= gl_lower[j];
+    }
+  }
+
+  if ( gl_cost_of_opening_x >= 0 ) {
+    return 0;
+  }
+
+  //  we'd save money by opening x; we'll do it
+  long bsize = points->num/nproc;
+  long k1 = bsize * pid;
+  long k2 = k1 + bsize;
+  if( pid == nproc-1 ) k2 = points->num;
+
+  for ( long i = k1; i < k2; i++ ) {
+    bool close_center = gl_lower[center_table[points->p[i].assign]] > 0;
+    if ( x_cost[i] < points->p[i].cost || close_center ) {
+      points->p[i].cost = x_cost[i];
+      points->p[i].assign = x;
+    }
+  }
+
+#ifdef ENABLE_THREADS
+  pthread_barrier_wait(barrier);
+#endif
+
+  if( pid == 0 ) {
+    int n = 0;
+    for( int j = 0; j < K; j++ ) {
+      int center = center_list[j];
+      if( gl_lower[j] > 0 ) {
+	is_center[center] = false;
+      } else {
+	center_table[center] = n;
+	center_list[n++] = center;
+      }
+    }
+    is_center[x] = true;
+    center_table[x] = n;
+    center_list[n++] = x;
+    num_listed = n;
+    if( n + 1 >= gain_stride ) pgain_alloc(points->num, 2*n);
+    *numcenters = *numcenters + 1 - gl_number_of_centers_to_close;
+  }
+
+#ifdef ENABLE_THREADS
+  pthread_barrier_wait(barrier);
+#endif
+
+  return -gl_cost_of_opening_x;
+}
+
+#endif // ORIGINAL_PGAIN
 #endif // TBB_VERSION
 
 
@@ -1563,7 +1834,13 @@ float pkmedian(Points *points, long kmin, long kmax, long* kfinal,
       for( int i = 0; i< points->num; i++ ) {
 	is_center[points->p[i].assign]= true;
       }
+#ifndef ORIGINAL_PGAIN
+      pgain_init(points);
+#endif
     }
+#ifndef ORIGINAL_PGAIN
+  pgain_transpose(points, pid);
+#endif
 
 #ifdef ENABLE_THREADS
   pthread_barrier_wait(barrier);
@@ -1613,6 +1890,9 @@ float pkmedian(Points *points, long kmin, long kmax, long* kfinal,
   if( pid==0 ) {
     free(feasible); 
     free(hizs);
+#ifndef ORIGINAL_PGAIN
+    pgain_free();
+#endif
     *kfinal = k;
   }
 
@@ -1754,13 +2034,161 @@ public:
   }
 };
 
+#ifndef LRAND48_SIMSTREAM
+/* Counter-based generator of SimStream
+ *
+ * Coordinate i of the stream (counting the coordinates of all points) is a
+ * hash of i, so any part of the stream can be generated independently. The
+ * blocks are split among the threads and vectorized, and the points neither
+ * depend on the number of threads nor take numbers from lrand48, whose
+ * sequence is left to the clustering. Like lrand48 the hash yields 31 bits.
+ * Compile with -DLRAND48_SIMSTREAM to generate the points with lrand48.
+ */
+
+#define SIM_LANES 8 // coordinates generated at once
+#define SIM_GRAIN (64*1024) // minimum number of coordinates per thread
+
+typedef unsigned int sim_uvec __attribute__((vector_size(SIM_LANES*sizeof(unsigned int))));
+typedef int sim_ivec __attribute__((vector_size(SIM_LANES*sizeof(int))));
+typedef float sim_fvec __attribute__((vector_size(SIM_LANES*sizeof(float))));
+
+//integer hash with good avalanche, a bijection on 32 bits
+template<typename T>
+static inline __attribute__((always_inline)) void sim_hash(T &x)
+{
+  x ^= x >> 17;
+  x *= 0xed5ad4bbU;
+  x ^= x >> 11;
+  x *= 0xac4c1b51U;
+  x ^= x >> 15;
+  x *= 0x31848babU;
+  x ^= x >> 14;
+}
+
+//generate coordinates first..first+count-1 of the stream into dest
+static inline __attribute__((always_inline))
+void sim_fill_body(float *dest, unsigned long first, long count)
+{
+  long i = 0;
+  while( i < count ) {
+    //the upper half of the index selects the key for the lower half
+    unsigned long c = first + i;
+    unsigned int lo = (unsigned int)c;
+    unsigned int key = (unsigned int)(c >> 32) + SEED;
+    sim_hash(key);
+    long end = count - i < 0x100000000L - lo ? count : i + (long)(0x100000000L - lo);
+#if defined(__clang__) || __GNUC__ >= 9 //__builtin_convertvector, older compilers use the scalar loop
+    sim_uvec idx;
+    for( int l = 0; l < SIM_LANES; l++ ) idx[l] = lo + l;
+    for( ; i + SIM_LANES <= end; i += SIM_LANES ) {
+      sim_uvec v = idx ^ key;
+      sim_hash(v);
+      sim_fvec f = __builtin_convertvector((sim_ivec)(v >> 1), sim_fvec) / (float)INT_MAX;
+      memcpy(&dest[i], &f, sizeof(f));
+      idx += SIM_LANES;
+    }
+#endif
+    for( ; i < end; i++ ) {
+      unsigned int v = (unsigned int)(first + i) ^ key;
+      sim_hash(v);
+      dest[i] = (int)(v >> 1) / (float)INT_MAX;
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void sim_fill_avx2(float *dest, unsigned long first, long count)
+{
+  sim_fill_body(dest, first, count);
+}
+#endif
+
+static void sim_fill_generic(float *dest, unsigned long first, long count)
+{
+  sim_fill_body(dest, first, count);
+}
+
+//the same values are generated with and without AVX2
+static void sim_fill(float *dest, unsigned long first, long count)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static int has_avx2 = -1;
+  if( has_avx2 < 0 ) has_avx2 = __builtin_cpu_supports("avx2");
+  if( has_avx2 ) {
+    sim_fill_avx2(dest, first, count);
+    return;
+  }
+#endif
+  sim_fill_generic(dest, first, count);
+}
+
+#ifdef TBB_VERSION
+struct SimFill {
+  float *dest;
+  unsigned long first;
+  SimFill(float *dest_, unsigned long first_): dest(dest_), first(first_) {}
+  void operator()(const tbb::blocked_range<long>& range) const {
+    sim_fill(&dest[range.begin()], first + range.begin(), range.end() - range.begin());
+  }
+};
+#elif defined(ENABLE_THREADS)
+struct sim_fill_arg_t {
+  float *dest;
+  unsigned long first;
+  long count;
+};
+
+void* sim_fill_thread(void *arg)
+{
+  sim_fill_arg_t *a = (sim_fill_arg_t *)arg;
+  sim_fill(a->dest, a->first, a->count);
+  return NULL;
+}
+#endif
+
+//generate count coordinates in parallel
+static void sim_fill_par(float *dest, unsigned long first, long count)
+{
+#ifdef TBB_VERSION
+  tbb::parallel_for(tbb::blocked_range<long>(0, count, SIM_GRAIN), SimFill(dest, first));
+#elif defined(ENABLE_THREADS)
+  long nthreads = count / SIM_GRAIN;
+  if( nthreads > nproc ) nthreads = nproc;
+  if( nthreads < 1 ) nthreads = 1;
+  //split on vector boundaries
+  long bsize = (count / nthreads + SIM_LANES - 1) / SIM_LANES * SIM_LANES;
+  pthread_t* threads = new pthread_t[nthreads];
+  sim_fill_arg_t* arg = new sim_fill_arg_t[nthreads];
+  for( long t = 0; t < nthreads; t++ ) {
+    long k1 = t*bsize < count ? t*bsize : count;
+    long k2 = t == nthreads-1 || (t+1)*bsize > count ? count : (t+1)*bsize;
+    arg[t].dest = &dest[k1];
+    arg[t].first = first + k1;
+    arg[t].count = k2 - k1;
+    if( t > 0 ) pthread_create(&threads[t], NULL, sim_fill_thread, &arg[t]);
+  }
+  sim_fill_thread(&arg[0]);
+  for( long t = 1; t < nthreads; t++ ) {
+    pthread_join(threads[t], NULL);
+  }
+  delete[] threads;
+  delete[] arg;
+#else
+  sim_fill(dest, first, count);
+#endif
+}
+#endif //LRAND48_SIMSTREAM
+
 //synthetic stream
 class SimStream : public PStream {
 public:
   SimStream(long n_ ) {
     n = n_;
+    next = 0;
   }
   size_t read( float* dest, int dim, int num ) {
+#ifdef LRAND48_SIMSTREAM
     size_t count = 0;
     for( int i = 0; i < num && n > 0; i++ ) {
       for( int k = 0; k < dim; k++ ) {
@@ -1770,6 +2198,14 @@ public:
       count++;
     }
     return count;
+#else
+    if( n <= 0 || num <= 0 ) return 0;
+    size_t count = num < n ? num : n;
+    sim_fill_par(dest, next, count*dim);
+    next += count*dim;
+    n -= count;
+    return count;
+#endif
   }
   int ferror() {
     return 0;
@@ -1781,6 +2217,7 @@ public:
   }
 private:
   long n;
+  unsigned long next; //index of the next coordinate
 };
 
 class FileStream : public PStream {
@@ -1809,6 +2246,141 @@ private:
   FILE* fp;
 };
 
+//memory-mapped file stream
+//reads the same format as FileStream, which avoids copying the data
+//through the stdio buffer and lets the kernel read ahead of the next block
+class MMapStream : public PStream {
+public:
+  MMapStream(char* filename) {
+    struct stat st;
+    base = NULL;
+    size = pos = 0;
+    eof = false;
+    int fd = open(filename, O_RDONLY);
+    if( fd < 0 ) return;
+    if( fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 ) {
+      void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if( p != MAP_FAILED ) {
+	base = (char *)p;
+	size = st.st_size;
+      }
+    }
+    close(fd);
+  }
+  //whether the file could be mapped
+  bool mapped() {
+    return base != NULL;
+  }
+  size_t read( float* dest, int dim, int num ) {
+    size_t len = sizeof(float)*dim;
+    size_t count = (size - pos) / len;
+    if( count < (size_t)num ) {
+      //same as fread, end of file is only detected when reading past it
+      eof = true;
+    } else {
+      count = num;
+    }
+    memcpy(dest, base + pos, count*len);
+    pos += count*len;
+    //let the kernel fetch the next block while this one is processed
+    if( pos < size ) {
+      size_t next = num*len < size - pos ? num*len : size - pos;
+      size_t page = sysconf(_SC_PAGESIZE);
+      size_t start = pos / page * page;
+      posix_madvise(base + start, pos + next - start, POSIX_MADV_WILLNEED);
+    }
+    return count;
+  }
+  int ferror() {
+    return 0;
+  }
+  int feof() {
+    return eof;
+  }
+  ~MMapStream() {
+    if( base != NULL ) munmap(base, size);
+  }
+private:
+  char* base;
+  size_t size;
+  size_t pos;
+  bool eof;
+};
+
+#ifdef ENABLE_THREADS
+//double-buffered stream
+//reads the next block of another stream on a background thread while the
+//current block is clustered, the other stream is only accessed by that thread
+class PrefetchStream : public PStream {
+public:
+  PrefetchStream(PStream* stream_) {
+    stream = stream_;
+    buf = NULL;
+    pending = false;
+    count = 0;
+    eof = error = 0;
+  }
+  size_t read( float* dest, int dim, int num ) {
+    if( !pending ) {
+      //first block, nothing has been fetched yet
+      this->dim = dim;
+      this->num = num;
+      buf = (float*)malloc(sizeof(float)*dim*num);
+      if( buf == NULL ) {
+	fprintf(stderr,"not enough memory for a chunk!\n");
+	exit(1);
+      }
+      fetch(this);
+    } else {
+      pthread_join(thread, NULL);
+      pending = false;
+    }
+    //the background thread always fetches blocks of the size of the last request
+    assert(dim == this->dim && num == this->num);
+
+    size_t n = count;
+    memcpy(dest, buf, sizeof(float)*dim*n);
+    eof = next_eof;
+    error = next_error;
+    if( !eof && !error ) {
+      if( pthread_create(&thread, NULL, fetch, this) != 0 ) {
+	fetch(this);
+      } else {
+	pending = true;
+      }
+    }
+    return n;
+  }
+  int ferror() {
+    return error;
+  }
+  int feof() {
+    return eof;
+  }
+  ~PrefetchStream() {
+    if( pending ) pthread_join(thread, NULL);
+    free(buf);
+    delete stream;
+  }
+private:
+  static void* fetch(void* arg) {
+    PrefetchStream* s = (PrefetchStream*)arg;
+    s->count = s->stream->read(s->buf, s->dim, s->num);
+    s->next_eof = s->stream->feof();
+    s->next_error = s->stream->ferror();
+    return NULL;
+  }
+  PStream* stream;
+  float* buf; //block fetched ahead
+  int dim, num;
+  pthread_t thread;
+  bool pending; //whether the background thread is running
+  size_t count; //number of points in buf
+  int next_eof, next_error; //state of the stream after fetching buf
+  int eof, error; //state of the stream as seen by the reader
+};
+#endif
+
 void outcenterIDs( Points* centers, long* centerIDs, char* outfile ) {
   FILE* fp = fopen(outfile, "w");
   if( fp==NULL ) {
@@ -1853,6 +2425,17 @@ void streamCluster( PStream* stream,
     exit(1);
   }
 
+#if !defined(TBB_VERSION) && !defined(ORIGINAL_PGAIN)
+  //room for the chunk or the centers, whichever is larger, padded to full groups
+  long soa_points = chunksize > centersize ? chunksize : centersize;
+  soa_points = (soa_points + SOA_LANES - 1) / SOA_LANES * SOA_LANES;
+  if( posix_memalign((void **)&soa_coord, 64, soa_points*dim*sizeof(float)) != 0 ||
+      posix_memalign((void **)&x_cost, 64, soa_points*sizeof(float)) != 0 ) {
+    fprintf(stderr,"not enough memory for a chunk!\n");
+    exit(1);
+  }
+#endif
+
   Points points;
   points.dim = dim;
   points.num = chunksize;
@@ -1955,6 +2538,11 @@ void streamCluster( PStream* stream,
   localSearch( &centers, kmin, kmax ,&kfinal ); // parallel
   contcenters(&centers);
   outcenterIDs( &centers, centerIDs, outfile);
+
+#if !defined(TBB_VERSION) && !defined(ORIGINAL_PGAIN)
+  free(soa_coord);
+  free(x_cost);
+#endif
 }
 
 int main(int argc, char **argv)
@@ -2019,7 +2607,16 @@ int main(int argc, char **argv)
     stream = new SimStream(n);
   }
   else {
-    stream = new FileStream(infilename);
+    MMapStream* mstream = new MMapStream(infilename);
+    if( mstream->mapped() ) {
+      stream = mstream;
+    } else {
+      delete mstream;
+      stream = new FileStream(infilename);
+    }
+#ifdef ENABLE_THREADS
+    stream = new PrefetchStream(stream);
+#endif
   }
 
 